@@ -5,6 +5,35 @@
 #include <unordered_map>
 #include <string>
 #include <fstream>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cerrno>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <list>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
@@ -57,6 +86,8 @@ bool  gGrounded = true;
 const float kEyeHeight = 1.8f;
 const float kGravity = -18.0f;
 const float kJumpSpeed = 6.5f;
+const float kMaxSlopeCos = 0.7f;        // ~45 degrees; steeper ground can't be climbed
+const float kSlopeSlideSpeed = 4.0f;
 
 // Fullscreen toggle state
 bool gFullscreen = false;
@@ -182,12 +213,24 @@ GLuint compile(GLenum type, const char* src) {
     return s;
 }
 
-GLuint linkProgram(const char* vs, const char* fs) {
+// UBO binding of the per-frame FrameData block (see FRAME_BLOCK_GLSL).
+const GLuint kFrameBlockBinding = 0;
+
+// Points a program's FrameData block at the shared binding; a no-op for
+// programs that don't declare it. compileAndLink and loadCachedProgram call
+// it, so every program from linkProgram is already bound.
+void bindFrameBlock(GLuint program) {
+    GLuint block = glGetUniformBlockIndex(program, "FrameData");
+    if (block != GL_INVALID_INDEX) glUniformBlockBinding(program, block, kFrameBlockBinding);
+}
+
+GLuint compileAndLink(const char* vs, const char* fs, bool retrievable) {
     GLuint v = compile(GL_VERTEX_SHADER, vs);
     GLuint f = compile(GL_FRAGMENT_SHADER, fs);
     GLuint p = glCreateProgram();
     glAttachShader(p, v);
     glAttachShader(p, f);
+    if (retrievable) glProgramParameteri(p, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(p);
     glDeleteShader(v);
     glDeleteShader(f);
@@ -199,526 +242,7603 @@ GLuint linkProgram(const char* vs, const char* fs) {
         glGetProgramInfoLog(p, len, nullptr, log.data());
         std::cerr << "Program link error:\n" << log.data() << "\n";
     }
+    else {
+        bindFrameBlock(p);
+    }
     return p;
 }
 
-// ---------- Texture loader ----------
-GLuint gNPCTexture = 0;
+// ---------- Timing ----------
+inline double nowMs() {
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
 
-GLuint loadTexture2D(const std::string& path) {
-    int w, h, channels;
-    stbi_set_flip_vertically_on_load(true);
-    unsigned char* data = stbi_load(path.c_str(), &w, &h, &channels, 4);
-    if (!data) {
-        std::cerr << "Failed to load texture: " << path << "\n";
-        return 0;
-    }
+double medianOf(std::vector<double> v) {
+    if (v.empty()) return 0.0;
+    std::sort(v.begin(), v.end());
+    return v[v.size() / 2];
+}
 
-    GLuint tex;
-    glGenTextures(1, &tex);
-    glBindTexture(GL_TEXTURE_2D, tex);
+// ---------- CPU features ----------
+// The 8-wide AVX kernels are always compiled in and picked at runtime, so
+// one build uses them where the CPU and OS allow and falls back to SSE2
+// elsewhere. MSVC accepts AVX intrinsics without /arch; GCC and Clang need
+// the target attribute.
+#ifdef _MSC_VER
+#define TARGET_AVX
+#else
+#define TARGET_AVX __attribute__((target("avx")))
+#endif
 
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0,
-        GL_RGBA, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
+inline bool detectAvx() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0, avx = (info[2] & (1 << 28)) != 0;
+    return osxsave && avx && (_xgetbv(0) & 6) == 6;     // OS saves the YMM state
+#else
+    return __builtin_cpu_supports("avx");
+#endif
+}
+const bool gCpuAvx = detectAvx();
+
+// Frame-time histogram with fixed millisecond buckets plus percentiles.
+struct FrameHistogram {
+    static const int kBuckets = 12;
+    static const size_t kRecent = 1 << 16;     // ~18 minutes at 60 fps for the percentiles
+    const float edges[kBuckets] = { 2, 4, 8, 12, 16.7f, 20, 25, 33.3f, 50, 66.7f, 100, 1e30f };
+    int counts[kBuckets] = {};
+    std::vector<float> samples;             // ring of the last kRecent frames
+    size_t next = 0;
+    long long frames = 0;
+    double sum = 0.0;
+    float worst = 0.0f;
+
+    void record(float ms) {
+        int b = 0;
+        while (b < kBuckets - 1 && ms > edges[b]) ++b;
+        counts[b]++;
+        ++frames;
+        sum += ms;
+        worst = std::max(worst, ms);
+        if (samples.size() < kRecent) {
+            samples.push_back(ms);
+        }
+        else {
+            samples[next] = ms;
+            next = (next + 1) % kRecent;
+        }
+    }
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    void report(const std::string& title) const {
+        if (samples.empty()) return;
+        std::vector<float> sorted = samples;
+        std::sort(sorted.begin(), sorted.end());
+        auto pct = [&sorted](float q) { return sorted[std::min(sorted.size() - 1, (size_t)(q * sorted.size()))]; };
+
+        std::cout << title << ": " << frames << " frames, mean " << sum / frames
+            << " ms, p50 " << pct(0.50f) << ", p95 " << pct(0.95f) << ", p99 " << pct(0.99f);
+        if ((long long)sorted.size() < frames) std::cout << " (last " << sorted.size() << ")";
+        std::cout << ", max " << worst << " ms\n";
+        int peak = *std::max_element(counts, counts + kBuckets);
+        float lo = 0.0f;
+        for (int b = 0; b < kBuckets; ++b) {
+            if (counts[b]) {
+                std::ostringstream label;
+                label << "  " << lo << "-";
+                if (b == kBuckets - 1) label << "inf"; else label << edges[b];
+                std::string bar((size_t)(40.0 * counts[b] / peak + 0.5), '#');
+                std::cout << label.str() << " ms\t" << counts[b] << "\t" << bar << "\n";
+            }
+            lo = edges[b];
+        }
+    }
+};
 
-    stbi_image_free(data);
-    return tex;
+// ---------- File helpers ----------
+inline bool hostIsLittleEndian() {
+    const uint16_t probe = 1;
+    return *(const unsigned char*)&probe == 1;
 }
 
-// ---------- Meshes ----------
-struct Mesh { GLuint vao = 0, vbo = 0; GLsizei count = 0; };
-
-Mesh makeGroundPlane(float half = 50.f) {
-    float y = 0, s = half;
-    float v[] = {
-        -s,y,-s, .35,.38,.40,  s,y,-s, .35,.38,.40,  s,y, s, .35,.38,.40,
-        -s,y,-s, .35,.38,.40,  s,y, s, .35,.38,.40, -s,y, s, .35,.38,.40
-    };
-    Mesh m;
-    glGenVertexArrays(1, &m.vao);
-    glGenBuffers(1, &m.vbo);
-    glBindVertexArray(m.vao);
-    glBindBuffer(GL_ARRAY_BUFFER, m.vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(v), v, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-    glBindVertexArray(0);
-    m.count = 6;
-    return m;
+inline std::string folderOf(const std::string& path) {
+    size_t slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
 }
 
-// ---------- World-space shader ----------
-const char* kVS = R"(#version 330 core
-layout (location=0) in vec3 aPos;
-layout (location=1) in vec3 aCol;
-uniform mat4 uMVP;
-out vec3 vCol;
-void main(){
-    vCol = aCol;
-    gl_Position = uMVP * vec4(aPos,1.0);
-})";
+// Read-only memory mapping of a whole file.
+struct MappedFile {
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int fd = -1;
+#endif
 
-const char* kFS = R"(#version 330 core
-in vec3 vCol;
-out vec4 FragColor;
-void main(){ FragColor = vec4(vCol,1.0); })";
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    bool open(const std::string& path) {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+            OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER len;
+        if (!GetFileSizeEx(file, &len) || len.QuadPart == 0) { close(); return false; }
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping) { close(); return false; }
+        data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        size = (size_t)len.QuadPart;
+#else
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) { close(); return false; }
+        void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        data = p == MAP_FAILED ? nullptr : (const unsigned char*)p;
+        size = (size_t)st.st_size;
+#endif
+        if (!data) { close(); return false; }
+        return true;
+    }
 
-// ---------- Ray vs AABB (for NPC look-at) ----------
-float rayAABB(const glm::vec3& ro, const glm::vec3& rd, const AABB& b) {
-    glm::vec3 t1 = (b.min - ro) / rd;
-    glm::vec3 t2 = (b.max - ro) / rd;
-    glm::vec3 tmin = glm::min(t1, t2);
-    glm::vec3 tmax = glm::max(t1, t2);
+    void close() {
+#ifdef _WIN32
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (data) munmap((void*)data, size);
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+#endif
+        data = nullptr;
+        size = 0;
+    }
+};
 
-    float tN = std::max(std::max(tmin.x, tmin.y), tmin.z);
-    float tF = std::min(std::min(tmax.x, tmax.y), tmax.z);
-    if (tF < 0.0f || tN > tF) return -1.0f;
-    return tN;
+inline bool makeDirectory(const std::string& path) {
+#ifdef _WIN32
+    return CreateDirectoryA(path.c_str(), nullptr) || GetLastError() == ERROR_ALREADY_EXISTS;
+#else
+    return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
 }
 
-// ---------- Crosshair ----------
-GLuint gCrossVAO = 0, gCrossVBO = 0, gCrossProg = 0;
-GLint  gCrossColorLoc = -1;
-
-const char* kCrossVS = R"(#version 330 core
-layout (location=0) in vec2 aPos;
-void main(){
-    gl_Position = vec4(aPos, 0.0, 1.0);
-})";
-
-const char* kCrossFS = R"(#version 330 core
-uniform vec3 uColor;
-out vec4 FragColor;
-void main(){ FragColor = vec4(uColor, 1.0); }
-)";
+// Size and last-write time of a source file; cooked assets record it so a
+// later edit of the source is noticed.
+struct FileStamp {
+    uint64_t size = 0;
+    uint64_t time = 0;              // platform ticks, only compared for equality
+};
 
-void initCrosshair() {
-    gCrossProg = linkProgram(kCrossVS, kCrossFS);
-    gCrossColorLoc = glGetUniformLocation(gCrossProg, "uColor");
+inline bool fileStamp(const std::string& path, FileStamp& out) {
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA attr;
+    if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &attr)) return false;
+    out.size = (uint64_t)attr.nFileSizeHigh << 32 | attr.nFileSizeLow;
+    out.time = (uint64_t)attr.ftLastWriteTime.dwHighDateTime << 32 | attr.ftLastWriteTime.dwLowDateTime;
+#else
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return false;
+    out.size = (uint64_t)st.st_size;
+    out.time = (uint64_t)st.st_mtime;
+#endif
+    return true;
+}
 
-    glGenVertexArrays(1, &gCrossVAO);
-    glGenBuffers(1, &gCrossVBO);
-    glBindVertexArray(gCrossVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, gCrossVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 8, nullptr, GL_DYNAMIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
-    glBindVertexArray(0);
+// True when source is missing (only the cooked file ships) or unchanged.
+inline bool sourceUnchanged(const std::string& source, uint64_t size, uint64_t time) {
+    FileStamp now;
+    return !fileStamp(source, now) || (now.size == size && now.time == time);
 }
 
-void drawCrosshairNDC(int fbw, int fbh) {
-    if (!gCrossProg) return;
-    const int sizePx = 8;
-    float sx = sizePx / (fbw * 0.5f);
-    float sy = sizePx / (fbh * 0.5f);
+// "assets/npc.obj", ".esm" -> "assets/npc.esm"
+inline std::string replaceExtension(const std::string& path, const char* ext) {
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return path + ext;
+    return path.substr(0, dot) + ext;
+}
 
-    float verts[8] = {
-        -sx, 0.0f,   sx, 0.0f,
-         0.0f,-sy,   0.0f, sy
-    };
+// ================= SHADER PROGRAM BINARY CACHE =================
+//
+// Linked programs are saved with glGetProgramBinary under
+// shader_cache/<hash>.bin, where the hash covers both shader sources and
+// the GL vendor, renderer and version strings. Later launches hand the
+// blob to glProgramBinary and only compile when the driver rejects it.
+
+const char     kProgramCacheMagic[4] = { 'E', 'S', 'P', 'B' };
+const uint32_t kProgramCacheVersion = 1;
+const char*    kProgramCacheDir = "shader_cache";
+
+struct ProgramCacheHeader {
+    char     magic[4];
+    uint32_t version;
+    uint32_t binaryFormat;
+    uint32_t length;
+    float    compileMs;           // what a miss cost, to report savings
+};
 
-    glBindBuffer(GL_ARRAY_BUFFER, gCrossVBO);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(verts), verts);
+struct ShaderCacheStats {
+    int hits = 0, misses = 0, rejected = 0;
+    double savedMs = 0.0;
+};
+ShaderCacheStats gShaderCache;
 
-    glUseProgram(gCrossProg);
-    glUniform3f(gCrossColorLoc, 0.95f, 0.95f, 0.95f);
-    glBindVertexArray(gCrossVAO);
+inline uint64_t fnv1a64(const void* data, size_t n, uint64_t h = 14695981039346656037ull) {
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i = 0; i < n; ++i) { h ^= p[i]; h *= 1099511628211ull; }
+    return h;
+}
 
-    glDisable(GL_DEPTH_TEST);
-    glLineWidth(2.0f);
-    glDrawArrays(GL_LINES, 0, 4);
-    glEnable(GL_DEPTH_TEST);
+inline uint64_t fnv1a64(const char* str, uint64_t h) {
+    return fnv1a64(str ? str : "", (str ? strlen(str) : 0) + 1, h); // NUL separates fields
+}
 
-    glBindVertexArray(0);
+bool programBinarySupported() {
+    if (!GLEW_ARB_get_program_binary && !GLEW_VERSION_4_1) return false;
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
 }
 
-// ================= HUD TEXT (stb_easy_font) =================
+std::string programCachePath(const char* vs, const char* fs) {
+    uint64_t h = fnv1a64(vs, 14695981039346656037ull);
+    h = fnv1a64(fs, h);
+    h = fnv1a64((const char*)glGetString(GL_VENDOR), h);
+    h = fnv1a64((const char*)glGetString(GL_RENDERER), h);
+    h = fnv1a64((const char*)glGetString(GL_VERSION), h);
+    std::ostringstream name;
+    name << kProgramCacheDir << "/" << std::hex;
+    name.width(16);
+    name.fill('0');
+    name << h << ".bin";
+    return name.str();
+}
 
-GLuint gHudVAO = 0, gHudVBO = 0, gHudProg = 0;
-GLint  gHudColorLoc = -1;
-GLint  gHudScreenSizeLoc = -1;
+GLuint loadCachedProgram(const std::string& path, float& compileMs) {
+    MappedFile file;
+    if (!file.open(path) || file.size < sizeof(ProgramCacheHeader)) return 0;
+    const ProgramCacheHeader& h = *(const ProgramCacheHeader*)file.data;
+    if (memcmp(h.magic, kProgramCacheMagic, 4) != 0 || h.version != kProgramCacheVersion ||
+        sizeof(ProgramCacheHeader) + (uint64_t)h.length > file.size) return 0;
 
-const char* kHudVS = R"(#version 330 core
-layout (location=0) in vec2 aPos;
-uniform vec2 uScreenSize;
-void main(){
-    vec2 ndc;
-    ndc.x = (aPos.x / (uScreenSize.x * 0.5)) - 1.0;
-    ndc.y = 1.0 - (aPos.y / (uScreenSize.y * 0.5));
-    gl_Position = vec4(ndc, 0.0, 1.0);
+    GLuint p = glCreateProgram();
+    glProgramBinary(p, h.binaryFormat, file.data + sizeof(ProgramCacheHeader), (GLsizei)h.length);
+    GLint ok = 0;
+    glGetProgramiv(p, GL_LINK_STATUS, &ok);
+    if (!ok) {
+        glDeleteProgram(p);
+        return 0;
+    }
+    compileMs = h.compileMs;
+    bindFrameBlock(p);
+    return p;
 }
-)";
 
-const char* kHudFS = R"(#version 330 core
-uniform vec3 uColor;
-out vec4 FragColor;
-void main(){
-    FragColor = vec4(uColor, 1.0);
+void storeCachedProgram(const std::string& path, GLuint p, float compileMs) {
+    GLint length = 0;
+    glGetProgramiv(p, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+
+    std::vector<unsigned char> blob((size_t)length);
+    GLenum format = 0;
+    glGetProgramBinary(p, length, nullptr, &format, blob.data());
+
+    makeDirectory(kProgramCacheDir);
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) return;
+    ProgramCacheHeader h{};
+    memcpy(h.magic, kProgramCacheMagic, 4);
+    h.version = kProgramCacheVersion;
+    h.binaryFormat = format;
+    h.length = (uint32_t)length;
+    h.compileMs = compileMs;
+    out.write((const char*)&h, sizeof(h));
+    out.write((const char*)blob.data(), blob.size());
 }
-)";
-
-void initHudText() {
-    gHudProg = linkProgram(kHudVS, kHudFS);
-    gHudColorLoc = glGetUniformLocation(gHudProg, "uColor");
-    gHudScreenSizeLoc = glGetUniformLocation(gHudProg, "uScreenSize");
 
-    glGenVertexArrays(1, &gHudVAO);
-    glGenBuffers(1, &gHudVBO);
+GLuint linkProgram(const char* vs, const char* fs) {
+    static const bool supported = programBinarySupported();
+    if (!supported) return compileAndLink(vs, fs, false);
+
+    std::string path = programCachePath(vs, fs);
+    double t0 = nowMs();
+    float compileMs = 0.0f;
+    GLuint p = loadCachedProgram(path, compileMs);
+    if (p) {
+        double loadMs = nowMs() - t0;
+        gShaderCache.hits++;
+        gShaderCache.savedMs += std::max(0.0, compileMs - loadMs);
+        return p;
+    }
 
-    glBindVertexArray(gHudVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, gHudVBO);
-    glBufferData(GL_ARRAY_BUFFER, 0, nullptr, GL_DYNAMIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
-    glBindVertexArray(0);
+    // a file that exists but failed to load was rejected by this driver
+    {
+        MappedFile probe;
+        if (probe.open(path)) gShaderCache.rejected++;
+    }
+    gShaderCache.misses++;
+    t0 = nowMs();
+    p = compileAndLink(vs, fs, true);
+    GLint ok = 0;
+    glGetProgramiv(p, GL_LINK_STATUS, &ok);
+    if (ok) storeCachedProgram(path, p, (float)(nowMs() - t0));
+    return p;
 }
 
-void drawTextScreen(const std::string& text,
-    float x, float y,
-    int fbw, int fbh,
-    const glm::vec3& color,
-    float scale = 1.0f)
-{
-    if (text.empty()) return;
+void reportShaderCache() {
+    std::cout << "Shader cache: " << gShaderCache.hits << " hits, "
+        << gShaderCache.misses << " misses";
+    if (gShaderCache.rejected) std::cout << " (" << gShaderCache.rejected << " stale)";
+    std::cout << ", saved " << gShaderCache.savedMs << " ms of compile/link\n";
+}
 
-    static char rawBuffer[20000];
+// ================= TEXTURES (.etx cooked container + PNG fallback) =================
+//
+// .etx is a small KTX2-style container: header, level table, then every mip
+// level already in its GPU format (RGBA8 or BC1/BC3), largest first, rows
+// bottom-up like stbi_set_flip_vertically_on_load. Nothing is decoded at
+// runtime; each level goes straight to glTexImage2D/glCompressedTexImage2D.
 
-    // Generate the geometry at origin (0,0)
-    int num_quads = stb_easy_font_print(
-        0.0f, 0.0f,
-        (char*)text.c_str(),
-        nullptr,
-        rawBuffer,
-        sizeof(rawBuffer)
-    );
-    if (num_quads <= 0) return;
+const char     kBakedTexMagic[4] = { 'E', 'T', 'X', '2' };
+const uint32_t kBakedTexVersion = 2;      // 2: source stamp
 
-    int num_verts = num_quads * 4;
-    std::vector<float> verts;
-    verts.resize(num_verts * 2);
+enum BakedTexFormat : uint32_t {
+    kTexRGBA8 = 0,
+    kTexBC1 = 1,   // DXT1, opaque
+    kTexBC3 = 2,   // DXT5, interpolated alpha
+};
 
-    float* src = (float*)rawBuffer;
-    for (int i = 0; i < num_verts; ++i) {
-        float vx = src[i * 4 + 0];
-        float vy = src[i * 4 + 1];
+struct BakedTexHeader {
+    char     magic[4];
+    uint32_t version;
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t levelCount;
+    uint32_t levelOffset;     // BakedTexLevel[levelCount]
+    uint32_t reserved;
+    uint64_t sourceSize;      // FileStamp of the cooked image
+    uint64_t sourceTime;
+};
 
-        // scale around (0,0) then offset to (x,y)
-        verts[i * 2 + 0] = x + vx * scale;
-        verts[i * 2 + 1] = y + vy * scale;
-    }
+struct BakedTexLevel {
+    uint32_t offset;
+    uint32_t size;
+    uint32_t width;
+    uint32_t height;
+};
 
-    std::vector<unsigned int> indices;
-    indices.reserve(num_quads * 6);
-    for (int q = 0; q < num_quads; ++q) {
-        unsigned int base = q * 4;
-        indices.push_back(base + 0);
-        indices.push_back(base + 1);
-        indices.push_back(base + 2);
-        indices.push_back(base + 0);
-        indices.push_back(base + 2);
-        indices.push_back(base + 3);
-    }
+static_assert(sizeof(BakedTexHeader) == 48, "BakedTexHeader layout changed");
 
-    GLuint ebo = 0;
-    glGenBuffers(1, &ebo);
+inline size_t texLevelBytes(uint32_t format, uint32_t w, uint32_t h) {
+    if (format == kTexRGBA8) return (size_t)w * h * 4;
+    size_t blocks = (size_t)((w + 3) / 4) * ((h + 3) / 4);
+    return blocks * (format == kTexBC1 ? 8 : 16);
+}
 
-    glUseProgram(gHudProg);
-    glUniform3f(gHudColorLoc, color.r, color.g, color.b);
-    glUniform2f(gHudScreenSizeLoc, (float)fbw, (float)fbh);
+// Bytes for an RGBA8 texture with a full mip chain, what loadTexture2D
+// used to cost.
+inline size_t rgba8ChainBytes(uint32_t w, uint32_t h) {
+    size_t total = 0;
+    for (;;) {
+        total += (size_t)w * h * 4;
+        if (w == 1 && h == 1) break;
+        w = std::max(1u, w / 2);
+        h = std::max(1u, h / 2);
+    }
+    return total;
+}
 
-    glBindVertexArray(gHudVAO);
+// ---------- Mip chain ----------
+inline float srgbToLinear(unsigned char c) {
+    float v = c / 255.0f;
+    return v <= 0.04045f ? v / 12.92f : powf((v + 0.055f) / 1.055f, 2.4f);
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, gHudVBO);
-    glBufferData(GL_ARRAY_BUFFER,
-        verts.size() * sizeof(float),
-        verts.data(),
-        GL_DYNAMIC_DRAW);
+inline unsigned char linearToSrgb(float v) {
+    v = glm::clamp(v, 0.0f, 1.0f);
+    float s = v <= 0.0031308f ? v * 12.92f : 1.055f * powf(v, 1.0f / 2.4f) - 0.055f;
+    return (unsigned char)(s * 255.0f + 0.5f);
+}
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-        indices.size() * sizeof(unsigned int),
-        indices.data(),
-        GL_DYNAMIC_DRAW);
+// 2x2 box filter, colour averaged in linear light, odd edges clamped.
+std::vector<unsigned char> downsampleRGBA(const std::vector<unsigned char>& src,
+    uint32_t w, uint32_t h, uint32_t& outW, uint32_t& outH)
+{
+    static float toLinear[256];
+    static bool tableReady = false;
+    if (!tableReady) {
+        for (int i = 0; i < 256; ++i) toLinear[i] = srgbToLinear((unsigned char)i);
+        tableReady = true;
+    }
 
-    glDisable(GL_DEPTH_TEST);
-    glDrawElements(GL_TRIANGLES,
-        (GLsizei)indices.size(),
-        GL_UNSIGNED_INT,
-        nullptr);
-    glEnable(GL_DEPTH_TEST);
+    outW = std::max(1u, w / 2);
+    outH = std::max(1u, h / 2);
+    std::vector<unsigned char> dst((size_t)outW * outH * 4);
+
+    for (uint32_t y = 0; y < outH; ++y) {
+        for (uint32_t x = 0; x < outW; ++x) {
+            uint32_t x0 = std::min(x * 2, w - 1), x1 = std::min(x * 2 + 1, w - 1);
+            uint32_t y0 = std::min(y * 2, h - 1), y1 = std::min(y * 2 + 1, h - 1);
+            const unsigned char* p[4] = {
+                &src[((size_t)y0 * w + x0) * 4], &src[((size_t)y0 * w + x1) * 4],
+                &src[((size_t)y1 * w + x0) * 4], &src[((size_t)y1 * w + x1) * 4]
+            };
+            unsigned char* d = &dst[((size_t)y * outW + x) * 4];
+            for (int c = 0; c < 3; ++c) {
+                float sum = toLinear[p[0][c]] + toLinear[p[1][c]] + toLinear[p[2][c]] + toLinear[p[3][c]];
+                d[c] = linearToSrgb(sum * 0.25f);
+            }
+            d[3] = (unsigned char)((p[0][3] + p[1][3] + p[2][3] + p[3][3] + 2) / 4);
+        }
+    }
+    return dst;
+}
 
-    glBindVertexArray(0);
-    glDeleteBuffers(1, &ebo);
+// ---------- BC1 / BC3 block encoders ----------
+inline uint16_t packRGB565(const float c[3]) {
+    int r = (int)(glm::clamp(c[0], 0.0f, 255.0f) * 31.0f / 255.0f + 0.5f);
+    int g = (int)(glm::clamp(c[1], 0.0f, 255.0f) * 63.0f / 255.0f + 0.5f);
+    int b = (int)(glm::clamp(c[2], 0.0f, 255.0f) * 31.0f / 255.0f + 0.5f);
+    return (uint16_t)((r << 11) | (g << 5) | b);
 }
 
-// ============ Dialog box (Pokemon style) using same HUD shader ============
+inline void unpackRGB565(uint16_t v, float c[3]) {
+    c[0] = ((v >> 11) & 31) * 255.0f / 31.0f;
+    c[1] = ((v >> 5) & 63) * 255.0f / 63.0f;
+    c[2] = (v & 31) * 255.0f / 31.0f;
+}
 
-GLuint gDialogVAO = 0, gDialogVBO = 0;
+// Endpoints from the block's bounding box, inset by 1/16 to cut the error
+// at the extremes; always 4-colour mode (c0 > c1).
+void encodeBC1Block(const unsigned char px[16][4], unsigned char out[8]) {
+    float lo[3] = { 255, 255, 255 }, hi[3] = { 0, 0, 0 };
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < 3; ++c) {
+            lo[c] = std::min(lo[c], (float)px[i][c]);
+            hi[c] = std::max(hi[c], (float)px[i][c]);
+        }
+    for (int c = 0; c < 3; ++c) {
+        float inset = (hi[c] - lo[c]) / 16.0f;
+        lo[c] += inset;
+        hi[c] -= inset;
+    }
 
-void initDialogBox() {
-    glGenVertexArrays(1, &gDialogVAO);
-    glGenBuffers(1, &gDialogVBO);
+    uint16_t c0 = packRGB565(hi), c1 = packRGB565(lo);
+    if (c0 < c1) std::swap(c0, c1);
+
+    uint32_t bits = 0;
+    if (c0 != c1) {
+        float pal[4][3];
+        unpackRGB565(c0, pal[0]);
+        unpackRGB565(c1, pal[1]);
+        for (int c = 0; c < 3; ++c) {
+            pal[2][c] = (2.0f * pal[0][c] + pal[1][c]) / 3.0f;
+            pal[3][c] = (pal[0][c] + 2.0f * pal[1][c]) / 3.0f;
+        }
+        for (int i = 0; i < 16; ++i) {
+            int best = 0;
+            float bestErr = 1e30f;
+            for (int k = 0; k < 4; ++k) {
+                float dr = px[i][0] - pal[k][0], dg = px[i][1] - pal[k][1], db = px[i][2] - pal[k][2];
+                float err = dr * dr + dg * dg + db * db;
+                if (err < bestErr) { bestErr = err; best = k; }
+            }
+            bits |= (uint32_t)best << (i * 2);
+        }
+    }
 
-    glBindVertexArray(gDialogVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, gDialogVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 8, nullptr, GL_DYNAMIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
-    glBindVertexArray(0);
+    out[0] = (unsigned char)(c0 & 0xFF); out[1] = (unsigned char)(c0 >> 8);
+    out[2] = (unsigned char)(c1 & 0xFF); out[3] = (unsigned char)(c1 >> 8);
+    out[4] = (unsigned char)(bits & 0xFF); out[5] = (unsigned char)((bits >> 8) & 0xFF);
+    out[6] = (unsigned char)((bits >> 16) & 0xFF); out[7] = (unsigned char)(bits >> 24);
 }
 
-void drawDialogBoxWithText(const std::string& text, int fbw, int fbh) {
-    if (text.empty() || !gHudProg || !gDialogVAO) return;
-
-    float marginX = fbw * 0.05f;
-    float marginY = fbh * 0.05f;
-    float boxHeight = fbh * 0.22f;
-
-    float x0 = marginX;
-    float x1 = fbw - marginX;
-    float y1 = fbh - marginY;
-    float y0 = y1 - boxHeight;
+// BC3 alpha: 8-value ramp between block min and max (a0 > a1 mode).
+void encodeBC3AlphaBlock(const unsigned char px[16][4], unsigned char out[8]) {
+    int a0 = 0, a1 = 255;
+    for (int i = 0; i < 16; ++i) {
+        a0 = std::max(a0, (int)px[i][3]);
+        a1 = std::min(a1, (int)px[i][3]);
+    }
+    out[0] = (unsigned char)a0;
+    out[1] = (unsigned char)a1;
+
+    uint64_t bits = 0;
+    if (a0 != a1) {
+        int ramp[8] = { a0, a1 };
+        for (int k = 1; k < 7; ++k) ramp[k + 1] = ((7 - k) * a0 + k * a1) / 7;
+        for (int i = 0; i < 16; ++i) {
+            int best = 0, bestErr = 1 << 30;
+            for (int k = 0; k < 8; ++k) {
+                int err = abs((int)px[i][3] - ramp[k]);
+                if (err < bestErr) { bestErr = err; best = k; }
+            }
+            bits |= (uint64_t)best << (i * 3);
+        }
+    }
+    for (int b = 0; b < 6; ++b) out[2 + b] = (unsigned char)((bits >> (b * 8)) & 0xFF);
+}
 
-    float verts[8] = {
-        x0, y0,
-        x1, y0,
-        x1, y1,
-        x0, y1
-    };
+std::vector<unsigned char> encodeBlocks(const std::vector<unsigned char>& rgba,
+    uint32_t w, uint32_t h, uint32_t format)
+{
+    std::vector<unsigned char> out(texLevelBytes(format, w, h));
+    size_t blockBytes = format == kTexBC1 ? 8 : 16;
+    unsigned char* dst = out.data();
+
+    for (uint32_t by = 0; by < h; by += 4) {
+        for (uint32_t bx = 0; bx < w; bx += 4) {
+            unsigned char px[16][4];
+            for (int i = 0; i < 16; ++i) {
+                uint32_t x = std::min(bx + (i & 3), w - 1);
+                uint32_t y = std::min(by + (i >> 2), h - 1);
+                memcpy(px[i], &rgba[((size_t)y * w + x) * 4], 4);
+            }
+            if (format == kTexBC3) {
+                encodeBC3AlphaBlock(px, dst);
+                encodeBC1Block(px, dst + 8);
+            }
+            else {
+                encodeBC1Block(px, dst);
+            }
+            dst += blockBytes;
+        }
+    }
+    return out;
+}
 
-    glUseProgram(gHudProg);
-    glUniform2f(gHudScreenSizeLoc, (float)fbw, (float)fbh);
+// ---------- Cooker / loader ----------
+// mode: "rgba", "bc1", "bc3" or "auto" (BC1 when fully opaque, else BC3)
+bool cookTexture(const std::string& in, const std::string& outPath, const std::string& mode) {
+    int w, h, channels;
+    stbi_set_flip_vertically_on_load_thread(1);
+    unsigned char* pixels = stbi_load(in.c_str(), &w, &h, &channels, 4);
+    if (!pixels) {
+        std::cerr << "Texture cooker: failed to load " << in << "\n";
+        return false;
+    }
+    std::vector<unsigned char> level(pixels, pixels + (size_t)w * h * 4);
+    stbi_image_free(pixels);
+
+    uint32_t format = kTexRGBA8;
+    if (mode == "bc1") format = kTexBC1;
+    else if (mode == "bc3") format = kTexBC3;
+    else if (mode == "auto") {
+        bool opaque = true;
+        for (size_t i = 3; i < level.size(); i += 4) if (level[i] != 255) { opaque = false; break; }
+        format = opaque ? kTexBC1 : kTexBC3;
+    }
+    else if (mode != "rgba") {
+        std::cerr << "Texture cooker: unknown format '" << mode << "' (rgba|bc1|bc3|auto)\n";
+        return false;
+    }
 
-    glBindVertexArray(gDialogVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, gDialogVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_DYNAMIC_DRAW);
+    std::vector<std::vector<unsigned char>> levels;
+    std::vector<BakedTexLevel> table;
+    uint32_t lw = (uint32_t)w, lh = (uint32_t)h;
+    for (;;) {
+        levels.push_back(format == kTexRGBA8 ? level : encodeBlocks(level, lw, lh, format));
+        table.push_back(BakedTexLevel{ 0, (uint32_t)levels.back().size(), lw, lh });
+        if (lw == 1 && lh == 1) break;
+        uint32_t nw, nh;
+        level = downsampleRGBA(level, lw, lh, nw, nh);
+        lw = nw;
+        lh = nh;
+    }
 
-    glDisable(GL_DEPTH_TEST);
+    std::ofstream out(outPath, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        std::cerr << "Texture cooker: cannot write " << outPath << "\n";
+        return false;
+    }
 
-    // fill
-    glUniform3f(gHudColorLoc, 0.03f, 0.03f, 0.08f);
-    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+    BakedTexHeader hdr{};
+    memcpy(hdr.magic, kBakedTexMagic, 4);
+    hdr.version = kBakedTexVersion;
+    hdr.format = format;
+    hdr.width = (uint32_t)w;
+    hdr.height = (uint32_t)h;
+    hdr.levelCount = (uint32_t)levels.size();
+    hdr.levelOffset = sizeof(BakedTexHeader);
+    FileStamp stamp;
+    if (fileStamp(in, stamp)) {
+        hdr.sourceSize = stamp.size;
+        hdr.sourceTime = stamp.time;
+    }
 
-    // border
-    glLineWidth(3.0f);
-    glUniform3f(gHudColorLoc, 1.0f, 1.0f, 1.0f);
-    glDrawArrays(GL_LINE_LOOP, 0, 4);
+    uint32_t offset = hdr.levelOffset + (uint32_t)(table.size() * sizeof(BakedTexLevel));
+    for (BakedTexLevel& l : table) {
+        offset = (offset + 15) & ~15u;
+        l.offset = offset;
+        offset += l.size;
+    }
 
-    glEnable(GL_DEPTH_TEST);
+    static const char zeros[16] = {};
+    out.write((const char*)&hdr, sizeof(hdr));
+    out.write((const char*)table.data(), table.size() * sizeof(BakedTexLevel));
+    for (size_t i = 0; i < levels.size(); ++i) {
+        size_t pad = table[i].offset - (size_t)out.tellp();
+        out.write(zeros, pad);
+        out.write((const char*)levels[i].data(), levels[i].size());
+    }
 
-    float textX = x0 + 20.0f;
-    float textY = y0 + 24.0f;
-    drawTextScreen(text, textX, textY, fbw, fbh, glm::vec3(1.0f, 1.0f, 1.0f),2.5f);
+    size_t bytes = 0;
+    for (const BakedTexLevel& l : table) bytes += l.size;
+    const char* names[] = { "RGBA8", "BC1", "BC3" };
+    std::cout << "Cooked " << in << " -> " << outPath << " " << w << "x" << h
+        << " " << names[format] << " " << levels.size() << " mips, "
+        << bytes / 1024 << " KiB (RGBA8 chain " << rgba8ChainBytes(w, h) / 1024 << " KiB)\n";
+    return (bool)out;
 }
 
-// ================= ASSIMP TEXTURED MODEL =================
-
-struct SimpleVertex {
-    glm::vec3 pos;
-    glm::vec2 uv;
+// CPU side of a texture load, safe on any thread. Levels point either into
+// a mapped .etx or into pixels (stb_image output, level 0 only).
+struct TexLevelRef {
+    const unsigned char* data = nullptr;
+    uint32_t size = 0, width = 0, height = 0;
 };
 
-struct AssimpModel {
-    GLuint vao = 0;
-    GLuint vbo = 0;
-    GLsizei vertexCount = 0;
-
-    bool load(const std::string& path) {
-        Assimp::Importer importer;
+struct TexturePayload {
+    std::string path;
+    uint32_t format = kTexRGBA8;
+    bool generateMips = false;          // decoded images only carry level 0
+    std::vector<TexLevelRef> levels;
+    std::unique_ptr<MappedFile> file;
+    std::vector<unsigned char> pixels;
+    int width = 0, height = 0;
+
+    size_t totalBytes() const {
+        size_t n = 0;
+        for (const TexLevelRef& l : levels) n += l.size;
+        return n;
+    }
+};
 
-        const aiScene* scene = importer.ReadFile(
-            path,
-            aiProcess_Triangulate |
-            aiProcess_JoinIdenticalVertices
-        );
+// With a source path, a cook older than that image is refused.
+bool readBakedTexture(const std::string& path, TexturePayload& out, bool quietIfMissing = false,
+    const std::string& source = std::string())
+{
+    std::unique_ptr<MappedFile> file(new MappedFile());
+    if (!file->open(path)) {
+        if (!quietIfMissing) std::cerr << "Baked texture: cannot open " << path << "\n";
+        return false;
+    }
+    if (file->size < sizeof(BakedTexHeader)) return false;
+    const BakedTexHeader& hdr = *(const BakedTexHeader*)file->data;
+    if (memcmp(hdr.magic, kBakedTexMagic, 4) != 0 || hdr.version != kBakedTexVersion ||
+        hdr.format > kTexBC3 || hdr.levelCount == 0 || !hostIsLittleEndian() ||
+        hdr.levelOffset + (uint64_t)hdr.levelCount * sizeof(BakedTexLevel) > file->size) {
+        std::cerr << "Baked texture: unsupported format or version in " << path << "\n";
+        return false;
+    }
+    if (!source.empty() && !sourceUnchanged(source, hdr.sourceSize, hdr.sourceTime)) {
+        std::cerr << "Baked texture: " << path << " is older than " << source << ", decoding the source\n";
+        return false;
+    }
 
-        if (!scene || !scene->HasMeshes()) {
-            std::cerr << "Assimp failed: " << importer.GetErrorString() << "\n";
+    const BakedTexLevel* levels = (const BakedTexLevel*)(file->data + hdr.levelOffset);
+    out.levels.clear();
+    for (uint32_t i = 0; i < hdr.levelCount; ++i) {
+        if (levels[i].offset + (uint64_t)levels[i].size > file->size ||
+            levels[i].size != texLevelBytes(hdr.format, levels[i].width, levels[i].height)) {
+            std::cerr << "Baked texture: corrupt level table in " << path << "\n";
             return false;
         }
+        out.levels.push_back(TexLevelRef{ file->data + levels[i].offset,
+            levels[i].size, levels[i].width, levels[i].height });
+    }
 
-        aiMesh* mesh = scene->mMeshes[0];
-
-        std::vector<SimpleVertex> verts;
-        verts.reserve(mesh->mNumFaces * 3);
-
-        for (unsigned int f = 0; f < mesh->mNumFaces; ++f) {
-            const aiFace& face = mesh->mFaces[f];
-            if (face.mNumIndices != 3) continue;
-
-            for (unsigned int i = 0; i < 3; ++i) {
-                unsigned int idx = face.mIndices[i];
+    out.path = path;
+    out.format = hdr.format;
+    out.generateMips = false;
+    out.width = (int)hdr.width;
+    out.height = (int)hdr.height;
+    out.file = std::move(file);
+    return true;
+}
 
-                SimpleVertex v{};
-                const aiVector3D& p = mesh->mVertices[idx];
-                v.pos = glm::vec3(p.x, p.y, p.z);
+// Prefers a cooked .etx next to the image unless the image changed since
+// it was cooked; falls back to decoding it.
+bool readTexture(const std::string& path, TexturePayload& out) {
+    std::string baked = replaceExtension(path, ".etx");
+    if (baked != path && readBakedTexture(baked, out, true, path)) return true;
 
-                if (mesh->mTextureCoords[0]) {
-                    const aiVector3D& t = mesh->mTextureCoords[0][idx];
-                    v.uv = glm::vec2(t.x, t.y);
-                }
-                else {
-                    v.uv = glm::vec2(0.0f);
-                }
+    int w, h, channels;
+    stbi_set_flip_vertically_on_load_thread(1);
+    unsigned char* data = stbi_load(path.c_str(), &w, &h, &channels, 4);
+    if (!data) {
+        std::cerr << "Failed to load texture: " << path << "\n";
+        return false;
+    }
+    out.path = path;
+    out.format = kTexRGBA8;
+    out.generateMips = true;
+    out.pixels.assign(data, data + (size_t)w * h * 4);
+    out.levels.assign(1, TexLevelRef{ out.pixels.data(), (uint32_t)out.pixels.size(),
+        (uint32_t)w, (uint32_t)h });
+    out.width = w;
+    out.height = h;
+    stbi_image_free(data);
+    return true;
+}
+
+inline GLenum glCompressedFormatFor(uint32_t format) {
+    return format == kTexBC1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+}
+
+inline void setTextureSampling() {
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+void logTextureVRAM(const TexturePayload& p) {
+    if (p.generateMips) return; // decoded PNG: the driver builds the chain
+    size_t vram = p.totalBytes();
+    size_t full = rgba8ChainBytes((uint32_t)p.width, (uint32_t)p.height);
+    std::cout << "Baked texture loaded: " << p.path << " " << p.width << "x" << p.height
+        << " " << p.levels.size() << " mips, VRAM " << vram / 1024 << " KiB"
+        << " (saved " << (full - std::min(full, vram)) / 1024 << " KiB vs RGBA8)\n";
+}
+
+// GL side in one go; must run on the context thread. Large textures go
+// through the streaming ring instead (TextureStreamer).
+GLuint uploadTexture(const TexturePayload& p) {
+    if (p.levels.empty()) return 0;
+    if (p.format != kTexRGBA8 && !GLEW_EXT_texture_compression_s3tc) {
+        std::cerr << "Baked texture: no S3TC support for " << p.path << "\n";
+        return 0;
+    }
+
+    GLuint tex;
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+
+    for (size_t i = 0; i < p.levels.size(); ++i) {
+        const TexLevelRef& l = p.levels[i];
+        if (p.format == kTexRGBA8) {
+            glTexImage2D(GL_TEXTURE_2D, (GLint)i, GL_RGBA8, l.width, l.height, 0,
+                GL_RGBA, GL_UNSIGNED_BYTE, l.data);
+        }
+        else {
+            glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)i, glCompressedFormatFor(p.format),
+                l.width, l.height, 0, l.size, l.data);
+        }
+    }
+    if (p.generateMips) glGenerateMipmap(GL_TEXTURE_2D);
+    else glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)p.levels.size() - 1);
+
+    setTextureSampling();
+    logTextureVRAM(p);
+    return tex;
+}
+
+GLuint loadTexture2D(const std::string& path) {
+    TexturePayload p;
+    if (!readTexture(path, p)) return 0;
+    return uploadTexture(p);
+}
+
+// ---------- Worker threads ----------
+struct WorkerPool {
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    void start(unsigned int count) {
+        stopping = false;
+        for (unsigned int i = 0; i < count; ++i) {
+            workers.emplace_back([this]() {
+                for (;;) {
+                    std::function<void()> job;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        wake.wait(lock, [this]() { return stopping || !jobs.empty(); });
+                        if (stopping) return;
+                        job = std::move(jobs.front());
+                        jobs.pop_front();
+                    }
+                    job();
+                }
+            });
+        }
+    }
+
+    void submit(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+        wake.notify_one();
+    }
+
+    // Running jobs finish, queued ones are dropped.
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            jobs.clear();
+        }
+        wake.notify_all();
+        for (std::thread& t : workers) t.join();
+        workers.clear();
+    }
+};
+
+// ================= TEXTURE STREAMING (PBO staging ring) =================
+//
+// Large textures are uploaded in chunks through a ring of pixel-unpack
+// buffers. The render thread maps a free slot and hands the pointer to a
+// worker, which copies the chunk straight into it (for a cooked .etx that
+// copy is also where the mapped file is read). Once the copy is done the
+// render thread unmaps the slot and glTex(Sub)Image sources from it, so the
+// driver transfer runs asynchronously and the render thread only maps,
+// unmaps and issues GL calls. Every slot has a fence and is only mapped
+// again once the GPU is done with it; if the next slot is still busy the
+// streamer simply waits for the next frame. At most budgetBytes are staged
+// per frame, and chunks are uploaded in the order they were staged.
+
+const size_t kStreamThresholdBytes = 512 * 1024;  // smaller textures upload directly
+
+struct TextureStreamer {
+    struct Slot {
+        GLuint pbo = 0;
+        GLsync fence = nullptr;
+        bool mapped = false;        // handed to a copy, not unmapped yet
+    };
+    struct Job {
+        GLuint tex = 0;
+        std::shared_ptr<TexturePayload> payload;
+        size_t level = 0;
+        uint32_t row = 0;           // next pixel row (RGBA8) or block row (BC) to stage
+        std::function<void(GLuint)> onDone;
+    };
+    // Copy state, shared with the worker: a copy still queued can be called
+    // off, one that is running has to be waited for.
+    enum { kCopyQueued, kCopyRunning, kCopyDone, kCopyCancelled };
+    struct Chunk {
+        size_t slot = 0;
+        size_t level = 0;
+        uint32_t row = 0, rows = 0;
+        size_t bytes = 0;
+        bool last = false;          // the job's final chunk
+        bool failed = false;        // nothing staged: drop the job
+        std::shared_ptr<std::atomic<int>> copy;
+    };
+
+    WorkerPool* pool = nullptr;     // copies run inline without one
+    std::vector<Slot> slots;
+    size_t slotBytes = 0;
+    size_t budgetBytes = 0;
+    size_t nextSlot = 0;
+    std::deque<Job> jobs;           // the front one is being uploaded
+    size_t staging = 0;             // jobs[staging] gets the next chunk
+    std::deque<Chunk> chunks;       // staged, in upload order
+
+    size_t bytesThisFrame = 0;
+    size_t totalBytes = 0;
+    int    busyFrames = 0;          // frames cut short because the next slot was in flight
+
+    void init(size_t slotCount, size_t bytesPerSlot, size_t bytesPerFrame, WorkerPool* copyPool = nullptr) {
+        pool = copyPool;
+        slotBytes = bytesPerSlot;
+        budgetBytes = bytesPerFrame;
+        slots.resize(slotCount);
+        for (Slot& slot : slots) {
+            glGenBuffers(1, &slot.pbo);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, slotBytes, nullptr, GL_STREAM_DRAW);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    // Safe after the pool has stopped: its dropped copies are still queued
+    // here and get called off.
+    void shutdown() {
+        for (Chunk& c : chunks) {
+            if (!c.copy) continue;
+            int expected = kCopyQueued;
+            if (c.copy->compare_exchange_strong(expected, kCopyCancelled)) continue;
+            while (c.copy->load(std::memory_order_acquire) != kCopyDone) std::this_thread::yield();
+        }
+        for (Slot& slot : slots) {
+            if (slot.mapped) {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            }
+            if (slot.fence) glDeleteSync(slot.fence);
+            glDeleteBuffers(1, &slot.pbo);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        for (Job& job : jobs) glDeleteTextures(1, &job.tex);
+        slots.clear();
+        jobs.clear();
+        chunks.clear();
+        staging = 0;
+    }
+
+    bool idle() const { return jobs.empty(); }
+
+    void enqueue(std::shared_ptr<TexturePayload> payload, std::function<void(GLuint)> onDone) {
+        if (payload->levels.empty()) { onDone(0); return; }
+        if (payload->format != kTexRGBA8 && !GLEW_EXT_texture_compression_s3tc) {
+            std::cerr << "Baked texture: no S3TC support for " << payload->path << "\n";
+            onDone(0);
+            return;
+        }
+        Job job;
+        glGenTextures(1, &job.tex);
+        job.payload = std::move(payload);
+        job.onDone = std::move(onDone);
+        jobs.push_back(std::move(job));
+    }
+
+    // Bytes per pixel row (RGBA8) or block row (BC) of a level, and how many.
+    static void bands(const TexturePayload& p, const TexLevelRef& lvl, uint32_t& rowBytes, uint32_t& totalRows) {
+        bool bc = p.format != kTexRGBA8;
+        rowBytes = bc ? (uint32_t)texLevelBytes(p.format, lvl.width, 4) : lvl.width * 4;
+        totalRows = bc ? (lvl.height + 3) / 4 : lvl.height;
+    }
+
+    // Uploads finished copies, then stages more chunks until the byte
+    // budget is spent or the ring is full.
+    void pump() {
+        bytesThisFrame = 0;
+        if (jobs.empty() || slots.empty()) return;
+        upload();
+        stage();
+        upload();                   // copies that ran inline or finished already
+    }
+
+    // Maps the next free slot for each chunk and queues the copy into it.
+    void stage() {
+        while (staging < jobs.size()) {
+            Job& job = jobs[staging];
+            const TexturePayload& p = *job.payload;
+            const TexLevelRef& lvl = p.levels[job.level];
+            uint32_t rowBytes, totalRows;
+            bands(p, lvl, rowBytes, totalRows);
+            uint32_t rowsPerChunk = std::max<uint32_t>(1, (uint32_t)(slotBytes / rowBytes));
+            uint32_t rows = std::min(rowsPerChunk, totalRows - job.row);
+            size_t bytes = (size_t)rows * rowBytes;
+
+            if (bytes > slotBytes) {
+                std::cerr << "Texture streamer: row of " << p.path << " exceeds slot size\n";
+                Chunk c;
+                c.failed = c.last = true;
+                chunks.push_back(c);
+                ++staging;
+                continue;
+            }
+            if (bytesThisFrame > 0 && bytesThisFrame + bytes > budgetBytes) break;
+
+            Slot& slot = slots[nextSlot];
+            if (slot.mapped) { ++busyFrames; break; }
+            if (slot.fence) {
+                GLenum r = glClientWaitSync(slot.fence, 0, 0);
+                if (r == GL_TIMEOUT_EXPIRED) { ++busyFrames; break; }
+                glDeleteSync(slot.fence);
+                slot.fence = nullptr;
+            }
+
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+            unsigned char* dst = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes,
+                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+            if (!dst) break;
+            slot.mapped = true;
+
+            Chunk c;
+            c.slot = nextSlot;
+            c.level = job.level;
+            c.row = job.row;
+            c.rows = rows;
+            c.bytes = bytes;
+            c.copy = std::make_shared<std::atomic<int>>(kCopyQueued);
+            const unsigned char* src = lvl.data + (size_t)job.row * rowBytes;
+            std::shared_ptr<std::atomic<int>> state = c.copy;
+            std::shared_ptr<TexturePayload> keep = job.payload;
+            auto copy = [dst, src, bytes, state, keep]() {
+                int expected = kCopyQueued;
+                if (!state->compare_exchange_strong(expected, kCopyRunning)) return;
+                memcpy(dst, src, bytes);
+                state->store(kCopyDone, std::memory_order_release);
+            };
+
+            job.row += rows;
+            if (job.row >= totalRows) {
+                job.row = 0;
+                if (++job.level >= p.levels.size()) {
+                    c.last = true;
+                    ++staging;
+                }
+            }
+            chunks.push_back(c);
+            if (pool) pool->submit(copy);
+            else copy();
+
+            nextSlot = (nextSlot + 1) % slots.size();
+            bytesThisFrame += bytes;
+            totalBytes += bytes;
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    // Unmaps and uploads chunks in staging order; a copy still running
+    // holds back the ones behind it.
+    void upload() {
+        while (!chunks.empty()) {
+            Chunk& c = chunks.front();
+            Job& job = jobs.front();
+            const TexturePayload& p = *job.payload;
+            if (c.failed) {
+                glDeleteTextures(1, &job.tex);
+                job.onDone(0);
+                jobs.pop_front();
+                --staging;
+                chunks.pop_front();
+                continue;
+            }
+            if (c.copy->load(std::memory_order_acquire) != kCopyDone) break;
+
+            Slot& slot = slots[c.slot];
+            const TexLevelRef& lvl = p.levels[c.level];
+            uint32_t rowBytes, totalRows;
+            bands(p, lvl, rowBytes, totalRows);
+            bool bc = p.format != kTexRGBA8;
+
+            glBindTexture(GL_TEXTURE_2D, job.tex);
+            bool whole = c.row == 0 && c.rows == totalRows;
+            if (c.row == 0 && !whole) {
+                // allocate the level first; sub-uploads fill it band by band
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                if (bc) {
+                    glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)c.level, glCompressedFormatFor(p.format),
+                        lvl.width, lvl.height, 0, lvl.size, nullptr);
+                }
+                else {
+                    glTexImage2D(GL_TEXTURE_2D, (GLint)c.level, GL_RGBA8, lvl.width, lvl.height, 0,
+                        GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+                }
+            }
+
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            slot.mapped = false;
+
+            if (whole && bc) {
+                glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)c.level, glCompressedFormatFor(p.format),
+                    lvl.width, lvl.height, 0, (GLsizei)c.bytes, (void*)0);
+            }
+            else if (whole) {
+                glTexImage2D(GL_TEXTURE_2D, (GLint)c.level, GL_RGBA8, lvl.width, lvl.height, 0,
+                    GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+            }
+            else if (bc) {
+                uint32_t y = c.row * 4;
+                glCompressedTexSubImage2D(GL_TEXTURE_2D, (GLint)c.level, 0, y,
+                    lvl.width, std::min(c.rows * 4, lvl.height - y),
+                    glCompressedFormatFor(p.format), (GLsizei)c.bytes, (void*)0);
+            }
+            else {
+                glTexSubImage2D(GL_TEXTURE_2D, (GLint)c.level, 0, c.row,
+                    lvl.width, c.rows, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+            }
+            slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+            bool last = c.last;
+            chunks.pop_front();
+            if (!last) continue;
+
+            // every level is in; the texture can be sampled now
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            if (p.generateMips) glGenerateMipmap(GL_TEXTURE_2D);
+            else glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)p.levels.size() - 1);
+            setTextureSampling();
+            logTextureVRAM(p);
+            job.onDone(job.tex);
+            jobs.pop_front();
+            --staging;
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+};
+TextureStreamer gStreamer;
+
+const size_t kStreamSlotCount = 4;
+const size_t kStreamSlotBytes = 4 * 1024 * 1024;
+size_t gStreamBudgetBytes = 8 * 1024 * 1024;      // per frame
+
+// ---------- Meshes ----------
+struct Mesh { GLuint vao = 0, vbo = 0; GLsizei count = 0; };
+
+// ---------- Per-frame uniforms (std140 block at a fixed binding) ----------
+//
+// Camera data is uploaded once per frame into one UBO bound at
+// kFrameBlockBinding. World shaders paste FRAME_BLOCK_GLSL after their
+// #version line and only take a model matrix (or instance data) per draw.
+
+#define FRAME_BLOCK_GLSL \
+    "layout (std140) uniform FrameData {\n" \
+    "    mat4 uView;\n" \
+    "    mat4 uProj;\n" \
+    "    mat4 uViewProj;\n" \
+    "    vec4 uCamPos;\n" \
+    "};\n"
+
+struct FrameUniforms {
+    glm::mat4 view;
+    glm::mat4 proj;
+    glm::mat4 viewProj;
+    glm::vec4 camPos;               // w unused
+};
+static_assert(sizeof(FrameUniforms) == 208, "FrameUniforms must match the std140 FrameData block");
+
+struct FrameUniformBuffer {
+    GLuint ubo = 0;
+
+    void init() {
+        glGenBuffers(1, &ubo);
+        glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, kFrameBlockBinding, ubo);
+    }
+
+    void update(const glm::mat4& view, const glm::mat4& proj, const glm::vec3& camPos) {
+        FrameUniforms u;
+        u.view = view;
+        u.proj = proj;
+        u.viewProj = proj * view;
+        u.camPos = glm::vec4(camPos, 1.0f);
+        glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(u), nullptr, GL_DYNAMIC_DRAW);   // orphan
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(u), &u);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    void release() {
+        glDeleteBuffers(1, &ubo);
+        ubo = 0;
+    }
+};
+FrameUniformBuffer gFrameUniforms;
+
+// Unit box corners are indexed x | y << 1 | z << 2; faces wind CCW seen
+// from outside, -X +X -Y +Y -Z +Z.
+const int kBoxFaces[6][4] = {
+    { 0, 4, 6, 2 }, { 1, 3, 7, 5 }, { 0, 1, 5, 4 },
+    { 2, 6, 7, 3 }, { 0, 2, 3, 1 }, { 4, 5, 7, 6 }
+};
+
+inline glm::vec3 boxCorner(const glm::vec3& mn, const glm::vec3& mx, int i) {
+    return glm::vec3(i & 1 ? mx.x : mn.x, i & 2 ? mx.y : mn.y, i & 4 ? mx.z : mn.z);
+}
+
+// Unit cube centred on the origin with flat-shaded faces (kVS layout);
+// level boxes scale and place it through uModel.
+Mesh makeBoxMesh(const glm::vec3& color) {
+    const float shade[6] = { 0.80f, 0.70f, 0.45f, 1.0f, 0.75f, 0.85f };
+    std::vector<float> v;
+    for (int f = 0; f < 6; ++f) {
+        const int tri[6] = { 0, 1, 2, 0, 2, 3 };
+        for (int k : tri) {
+            glm::vec3 p = boxCorner(glm::vec3(-0.5f), glm::vec3(0.5f), kBoxFaces[f][k]);
+            glm::vec3 c = color * shade[f];
+            v.insert(v.end(), { p.x, p.y, p.z, c.r, c.g, c.b });
+        }
+    }
+    Mesh m;
+    glGenVertexArrays(1, &m.vao);
+    glGenBuffers(1, &m.vbo);
+    glBindVertexArray(m.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, m.vbo);
+    glBufferData(GL_ARRAY_BUFFER, v.size() * sizeof(float), v.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+    glBindVertexArray(0);
+    m.count = 36;
+    return m;
+}
+
+// ---------- World-space shader ----------
+const char* kVS = "#version 330 core\n" FRAME_BLOCK_GLSL R"(
+layout (location=0) in vec3 aPos;
+layout (location=1) in vec3 aCol;
+uniform mat4 uModel;
+out vec3 vCol;
+void main(){
+    vCol = aCol;
+    gl_Position = uViewProj * uModel * vec4(aPos,1.0);
+})";
+
+const char* kFS = R"(#version 330 core
+in vec3 vCol;
+out vec4 FragColor;
+void main(){ FragColor = vec4(vCol,1.0); })";
+
+// ---------- Ray vs AABB (for NPC look-at) ----------
+float rayAABB(const glm::vec3& ro, const glm::vec3& rd, const AABB& b) {
+    glm::vec3 t1 = (b.min - ro) / rd;
+    glm::vec3 t2 = (b.max - ro) / rd;
+    glm::vec3 tmin = glm::min(t1, t2);
+    glm::vec3 tmax = glm::max(t1, t2);
+
+    float tN = std::max(std::max(tmin.x, tmin.y), tmin.z);
+    float tF = std::min(std::min(tmax.x, tmax.y), tmax.z);
+    if (tF < 0.0f || tN > tF) return -1.0f;
+    return tN;
+}
+
+// ---------- View frustum (planes point inward) ----------
+struct Frustum {
+    glm::vec4 planes[6];
+
+    // Gribb/Hartmann extraction from a clip matrix (P * V).
+    static Frustum fromMatrix(const glm::mat4& m) {
+        Frustum f;
+        glm::vec4 r0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        glm::vec4 r1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        glm::vec4 r2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        glm::vec4 r3(m[0][3], m[1][3], m[2][3], m[3][3]);
+        f.planes[0] = r3 + r0; f.planes[1] = r3 - r0;
+        f.planes[2] = r3 + r1; f.planes[3] = r3 - r1;
+        f.planes[4] = r3 + r2; f.planes[5] = r3 - r2;
+        for (glm::vec4& p : f.planes) p /= glm::length(glm::vec3(p));
+        return f;
+    }
+
+    bool sphereVisible(const glm::vec3& c, float r) const {
+        for (const glm::vec4& p : planes)
+            if (glm::dot(glm::vec3(p), c) + p.w < -r) return false;
+        return true;
+    }
+};
+
+// ---------- Batched sphere culling (SoA, SSE / AVX) ----------
+//
+// Bounding spheres live in separate x/y/z/r arrays padded to a multiple of
+// 8, so one load pulls 4 (SSE) or 8 (AVX) spheres. Padding lanes carry a
+// huge negative radius and always fail. The AVX path is picked at runtime
+// when gCpuAvx is set; SSE2 is always available on x64.
+struct SphereSoA {
+    std::vector<float> x, y, z, r;
+    size_t count = 0;
+
+    void resize(size_t n) {
+        count = n;
+        size_t padded = (n + 7) & ~size_t(7);
+        x.assign(padded, 0.0f);
+        y.assign(padded, 0.0f);
+        z.assign(padded, 0.0f);
+        r.assign(padded, -1e30f);
+    }
+
+    void set(size_t i, const glm::vec3& c, float radius) {
+        x[i] = c.x; y[i] = c.y; z[i] = c.z; r[i] = radius;
+    }
+};
+
+// AVX part of cullSpheres: whole groups of 8; returns where it stopped.
+TARGET_AVX size_t cullSpheresAVX(const Frustum& f, const SphereSoA& s, std::vector<uint32_t>& visible) {
+    size_t padded = s.x.size();
+    size_t i = 0;
+    __m256 px[6], py[6], pz[6], pw[6];
+    for (int k = 0; k < 6; ++k) {
+        px[k] = _mm256_set1_ps(f.planes[k].x);
+        py[k] = _mm256_set1_ps(f.planes[k].y);
+        pz[k] = _mm256_set1_ps(f.planes[k].z);
+        pw[k] = _mm256_set1_ps(f.planes[k].w);
+    }
+    for (; i + 8 <= padded; i += 8) {
+        __m256 x = _mm256_loadu_ps(&s.x[i]);
+        __m256 y = _mm256_loadu_ps(&s.y[i]);
+        __m256 z = _mm256_loadu_ps(&s.z[i]);
+        __m256 nr = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&s.r[i]));
+        __m256 in = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int k = 0; k < 6; ++k) {
+            __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px[k], x), _mm256_mul_ps(py[k], y)),
+                _mm256_add_ps(_mm256_mul_ps(pz[k], z), pw[k]));
+            in = _mm256_and_ps(in, _mm256_cmp_ps(d, nr, _CMP_GE_OQ));
+        }
+        for (unsigned m = (unsigned)_mm256_movemask_ps(in); m; m &= m - 1) {
+            unsigned lane = 0;
+            while (!((m >> lane) & 1u)) ++lane;
+            visible.push_back((uint32_t)(i + lane));
+        }
+    }
+    return i;
+}
+
+// Appends the index of every sphere touching the frustum; returns how many.
+size_t cullSpheres(const Frustum& f, const SphereSoA& s, std::vector<uint32_t>& visible) {
+    size_t before = visible.size();
+    size_t padded = s.x.size();
+    size_t i = gCpuAvx ? cullSpheresAVX(f, s, visible) : 0;
+    __m128 qx[6], qy[6], qz[6], qw[6];
+    for (int k = 0; k < 6; ++k) {
+        qx[k] = _mm_set1_ps(f.planes[k].x);
+        qy[k] = _mm_set1_ps(f.planes[k].y);
+        qz[k] = _mm_set1_ps(f.planes[k].z);
+        qw[k] = _mm_set1_ps(f.planes[k].w);
+    }
+    for (; i + 4 <= padded; i += 4) {
+        __m128 x = _mm_loadu_ps(&s.x[i]);
+        __m128 y = _mm_loadu_ps(&s.y[i]);
+        __m128 z = _mm_loadu_ps(&s.z[i]);
+        __m128 nr = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&s.r[i]));
+        __m128 in = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int k = 0; k < 6; ++k) {
+            __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(qx[k], x), _mm_mul_ps(qy[k], y)),
+                _mm_add_ps(_mm_mul_ps(qz[k], z), qw[k]));
+            in = _mm_and_ps(in, _mm_cmpge_ps(d, nr));
+        }
+        int m = _mm_movemask_ps(in);
+        if (m & 1) visible.push_back((uint32_t)i);
+        if (m & 2) visible.push_back((uint32_t)i + 1);
+        if (m & 4) visible.push_back((uint32_t)i + 2);
+        if (m & 8) visible.push_back((uint32_t)i + 3);
+    }
+    return visible.size() - before;
+}
+
+// Scalar reference, used by --bench-cull to check and time the SIMD path.
+size_t cullSpheresScalar(const Frustum& f, const SphereSoA& s, std::vector<uint32_t>& visible) {
+    size_t before = visible.size();
+    for (size_t i = 0; i < s.count; ++i)
+        if (f.sphereVisible(glm::vec3(s.x[i], s.y[i], s.z[i]), s.r[i])) visible.push_back((uint32_t)i);
+    return visible.size() - before;
+}
+
+// Per-frame counters shown by the stats overlay (F3).
+struct RenderStats {
+    int visible = 0;
+    int culled = 0;
+    double cullMs = 0.0;
+    long long triangles = 0;        // submitted after LOD selection
+    long long trianglesFull = 0;    // the same objects at LOD 0
+    int drawCalls = 0;
+    int stateChanges = 0;           // program / texture / VAO binds issued
+    int stateChangesAvoided = 0;    // binds the render queue skipped
+    int occluded = 0;               // in the frustum but behind occluders
+    double rasterMs = 0.0;          // occluder rasterization
+    double occlusionTestMs = 0.0;
+};
+RenderStats gRenderStats;
+bool gShowStats = false;
+
+// ================= HUD / UI BATCH (kHudVS + kHudFS) =================
+//
+// Every screen-space shape (crosshair lines, dialog panel) is emitted as a
+// coloured quad into one per-frame vertex stream and drawn with a single
+// glDrawElements over a shared quad index buffer. Text goes into a second
+// stream of glyph instances drawn with one instanced call on top of the
+// shapes. Each GPU copy is only rewritten when its stream changes.
+
+struct UIVertex {
+    float x, y;
+    float r, g, b;
+};
+
+struct GlyphInstance {
+    float x, y, scale, glyph;
+    float r, g, b;
+};
+
+const int kUIMaxQuads = 16384; // 16-bit quad indices top out at 65536 verts
+const int kUIMaxGlyphs = 16384;
+
+GLuint gHudProg = 0;
+GLint  gHudScreenSizeLoc = -1;
+GLuint gHudQuadIBO = 0;
+
+GLuint gTextProg = 0;
+GLint  gTextScreenSizeLoc = -1;
+GLuint gTextAtlas = 0;
+
+struct UIBatch {
+    GLuint vao = 0, vbo = 0;
+    std::vector<UIVertex> verts;     // this frame
+    std::vector<UIVertex> uploaded;  // what the VBO currently holds
+
+    GLuint textVAO = 0, textVBO = 0;
+    std::vector<GlyphInstance> glyphs;
+    std::vector<GlyphInstance> uploadedGlyphs;
+
+    int fbw = 0, fbh = 0;
+    int uploads = 0;                 // re-uploads since start, for stats
+};
+UIBatch gUI;
+
+const char* kHudVS = R"(#version 330 core
+layout (location=0) in vec2 aPos;
+layout (location=1) in vec3 aColor;
+uniform vec2 uScreenSize;
+out vec3 vColor;
+void main(){
+    vColor = aColor;
+    vec2 ndc;
+    ndc.x = (aPos.x / (uScreenSize.x * 0.5)) - 1.0;
+    ndc.y = 1.0 - (aPos.y / (uScreenSize.y * 0.5));
+    gl_Position = vec4(ndc, 0.0, 1.0);
+}
+)";
+
+const char* kHudFS = R"(#version 330 core
+in vec3 vColor;
+out vec4 FragColor;
+void main(){
+    FragColor = vec4(vColor, 1.0);
+}
+)";
+
+// ---------- SDF glyph atlas ----------
+//
+// Glyph shapes come from stb_easy_font: each character is a handful of
+// 1-unit-thick axis-aligned bars. At startup every printable ASCII glyph is
+// turned into a signed distance field (min of the bars' box distances) and
+// packed into one R8 atlas. A glyph is then one instanced quad at any scale.
+
+const int   kGlyphFirst = 32;
+const int   kGlyphCount = 95;      // ' ' .. '~'
+const int   kAtlasCols = 16;
+const int   kAtlasRows = 6;
+const int   kGlyphPxPerUnit = 4;
+const float kGlyphCellX0 = -2.0f;  // cell origin in font units (glyphs span 0..7 x 0..9)
+const float kGlyphCellY0 = -2.0f;
+const float kGlyphCellW = 11.0f;
+const float kGlyphCellH = 13.0f;
+const float kGlyphSpread = 2.0f;   // font units mapped to the 0..1 SDF range
+const float kGlyphLineHeight = 12.0f;
+
+const char* kTextVS = R"(#version 330 core
+layout (location=0) in vec2 aCorner;
+layout (location=1) in vec4 aGlyph;   // x, y, scale, index
+layout (location=2) in vec3 aColor;
+uniform vec2 uScreenSize;
+uniform vec2 uCellOrigin;
+uniform vec2 uCellSize;
+uniform vec2 uAtlasGrid;
+out vec2 vUV;
+out vec3 vColor;
+void main(){
+    vec2 p = aGlyph.xy + (uCellOrigin + aCorner * uCellSize) * aGlyph.z;
+    vec2 cell = vec2(mod(aGlyph.w, uAtlasGrid.x), floor(aGlyph.w / uAtlasGrid.x));
+    vUV = (cell + aCorner) / uAtlasGrid;
+    vColor = aColor;
+    vec2 ndc;
+    ndc.x = (p.x / (uScreenSize.x * 0.5)) - 1.0;
+    ndc.y = 1.0 - (p.y / (uScreenSize.y * 0.5));
+    gl_Position = vec4(ndc, 0.0, 1.0);
+}
+)";
+
+const char* kTextFS = R"(#version 330 core
+in vec2 vUV;
+in vec3 vColor;
+uniform sampler2D uAtlas;
+out vec4 FragColor;
+void main(){
+    float d = texture(uAtlas, vUV).r;
+    float w = max(fwidth(d) * 0.75, 1e-4);
+    float a = smoothstep(0.5 - w, 0.5 + w, d);
+    FragColor = vec4(vColor, a);
+}
+)";
+
+GLuint bakeGlyphAtlas() {
+    const int cellW = (int)kGlyphCellW * kGlyphPxPerUnit;
+    const int cellH = (int)kGlyphCellH * kGlyphPxPerUnit;
+    const int atlasW = cellW * kAtlasCols;
+    const int atlasH = cellH * kAtlasRows;
+
+    std::vector<unsigned char> pixels(atlasW * atlasH, 0);
+    static char rawBuffer[64 * 64]; // the widest glyph is 11 quads
+
+    for (int g = 0; g < kGlyphCount; ++g) {
+        char text[2] = { (char)(kGlyphFirst + g), 0 };
+        // stb_easy_font pushes descenders down a unit; keep that in the cell
+        int quads = stb_easy_font_print(0.0f, 0.0f, text, nullptr, rawBuffer, sizeof(rawBuffer));
+
+        const float* q = (const float*)rawBuffer;
+        int ox = (g % kAtlasCols) * cellW;
+        int oy = (g / kAtlasCols) * cellH;
+
+        for (int py = 0; py < cellH; ++py) {
+            for (int px = 0; px < cellW; ++px) {
+                float ux = kGlyphCellX0 + (px + 0.5f) / kGlyphPxPerUnit;
+                float uy = kGlyphCellY0 + (py + 0.5f) / kGlyphPxPerUnit;
+
+                float d = kGlyphSpread;
+                for (int i = 0; i < quads; ++i) {
+                    // quad corners 0 and 2 are opposite
+                    float x0 = q[i * 16 + 0], y0 = q[i * 16 + 1];
+                    float x1 = q[i * 16 + 8], y1 = q[i * 16 + 9];
+                    float cx = 0.5f * (x0 + x1), cy = 0.5f * (y0 + y1);
+                    float hx = 0.5f * fabsf(x1 - x0), hy = 0.5f * fabsf(y1 - y0);
+                    float qx = fabsf(ux - cx) - hx, qy = fabsf(uy - cy) - hy;
+                    float outside = sqrtf(std::max(qx, 0.0f) * std::max(qx, 0.0f) +
+                        std::max(qy, 0.0f) * std::max(qy, 0.0f));
+                    float inside = std::min(std::max(qx, qy), 0.0f);
+                    d = std::min(d, outside + inside);
+                }
+
+                float v = glm::clamp(0.5f - d / (2.0f * kGlyphSpread), 0.0f, 1.0f);
+                pixels[(oy + py) * atlasW + ox + px] = (unsigned char)(v * 255.0f + 0.5f);
+            }
+        }
+    }
+
+    GLuint tex;
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, atlasW, atlasH, 0,
+        GL_RED, GL_UNSIGNED_BYTE, pixels.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    std::cout << "Glyph atlas baked: " << atlasW << "x" << atlasH
+        << " (" << kGlyphCount << " SDF glyphs)\n";
+    return tex;
+}
+
+// ---------- Batch setup ----------
+void initHudText() {
+    gHudProg = linkProgram(kHudVS, kHudFS);
+    gHudScreenSizeLoc = glGetUniformLocation(gHudProg, "uScreenSize");
+
+    std::vector<GLushort> indices;
+    indices.reserve(kUIMaxQuads * 6);
+    for (int q = 0; q < kUIMaxQuads; ++q) {
+        GLushort base = (GLushort)(q * 4);
+        indices.push_back(base + 0);
+        indices.push_back(base + 1);
+        indices.push_back(base + 2);
+        indices.push_back(base + 0);
+        indices.push_back(base + 2);
+        indices.push_back(base + 3);
+    }
+
+    glGenVertexArrays(1, &gUI.vao);
+    glGenBuffers(1, &gUI.vbo);
+    glGenBuffers(1, &gHudQuadIBO);
+
+    glBindVertexArray(gUI.vao);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gHudQuadIBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+        indices.size() * sizeof(GLushort),
+        indices.data(),
+        GL_STATIC_DRAW);
+
+    glBindBuffer(GL_ARRAY_BUFFER, gUI.vbo);
+    glBufferData(GL_ARRAY_BUFFER,
+        kUIMaxQuads * 4 * sizeof(UIVertex),
+        nullptr,
+        GL_DYNAMIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(UIVertex), (void*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(UIVertex),
+        (void*)offsetof(UIVertex, r));
+    glBindVertexArray(0);
+
+    gUI.verts.reserve(kUIMaxQuads * 4);
+    gUI.uploaded.reserve(kUIMaxQuads * 4);
+
+    // Text: a unit quad as triangle strip, everything else per instance
+    gTextProg = linkProgram(kTextVS, kTextFS);
+    gTextScreenSizeLoc = glGetUniformLocation(gTextProg, "uScreenSize");
+    glUseProgram(gTextProg);
+    glUniform2f(glGetUniformLocation(gTextProg, "uCellOrigin"), kGlyphCellX0, kGlyphCellY0);
+    glUniform2f(glGetUniformLocation(gTextProg, "uCellSize"), kGlyphCellW, kGlyphCellH);
+    glUniform2f(glGetUniformLocation(gTextProg, "uAtlasGrid"), (float)kAtlasCols, (float)kAtlasRows);
+    glUniform1i(glGetUniformLocation(gTextProg, "uAtlas"), 0);
+    gTextAtlas = bakeGlyphAtlas();
+
+    const float corners[8] = { 0,0, 1,0, 0,1, 1,1 };
+    GLuint cornerVBO = 0;
+    glGenVertexArrays(1, &gUI.textVAO);
+    glGenBuffers(1, &cornerVBO);
+    glGenBuffers(1, &gUI.textVBO);
+
+    glBindVertexArray(gUI.textVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, cornerVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+
+    glBindBuffer(GL_ARRAY_BUFFER, gUI.textVBO);
+    glBufferData(GL_ARRAY_BUFFER,
+        kUIMaxGlyphs * sizeof(GlyphInstance),
+        nullptr,
+        GL_DYNAMIC_DRAW);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(GlyphInstance), (void*)0);
+    glVertexAttribDivisor(1, 1);
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(GlyphInstance),
+        (void*)offsetof(GlyphInstance, r));
+    glVertexAttribDivisor(2, 1);
+    glBindVertexArray(0);
+
+    // The VAO keeps the corner buffer alive after this name goes away
+    glDeleteBuffers(1, &cornerVBO);
+
+    gUI.glyphs.reserve(kUIMaxGlyphs);
+    gUI.uploadedGlyphs.reserve(kUIMaxGlyphs);
+}
+
+void shutdownHudText() {
+    glDeleteVertexArrays(1, &gUI.vao);
+    glDeleteBuffers(1, &gUI.vbo);
+    glDeleteBuffers(1, &gHudQuadIBO);
+    glDeleteProgram(gHudProg);
+    gUI.vao = gUI.vbo = gHudQuadIBO = gHudProg = 0;
+
+    glDeleteVertexArrays(1, &gUI.textVAO);
+    glDeleteBuffers(1, &gUI.textVBO);
+    glDeleteTextures(1, &gTextAtlas);
+    glDeleteProgram(gTextProg);
+    gUI.textVAO = gUI.textVBO = gTextAtlas = gTextProg = 0;
+}
+
+// ---------- Batch primitives ----------
+void uiBegin(int fbw, int fbh) {
+    gUI.verts.clear();
+    gUI.glyphs.clear();
+    gUI.fbw = fbw;
+    gUI.fbh = fbh;
+}
+
+inline bool uiHasRoom(int quads) {
+    return (int)gUI.verts.size() + quads * 4 <= kUIMaxQuads * 4;
+}
+
+void uiQuad(const glm::vec2& a, const glm::vec2& b,
+    const glm::vec2& c, const glm::vec2& d, const glm::vec3& color)
+{
+    if (!uiHasRoom(1)) return;
+    gUI.verts.push_back(UIVertex{ a.x, a.y, color.r, color.g, color.b });
+    gUI.verts.push_back(UIVertex{ b.x, b.y, color.r, color.g, color.b });
+    gUI.verts.push_back(UIVertex{ c.x, c.y, color.r, color.g, color.b });
+    gUI.verts.push_back(UIVertex{ d.x, d.y, color.r, color.g, color.b });
+}
+
+void uiRect(float x0, float y0, float x1, float y1, const glm::vec3& color) {
+    uiQuad({ x0, y0 }, { x1, y0 }, { x1, y1 }, { x0, y1 }, color);
+}
+
+// Lines are thin quads so width no longer depends on glLineWidth support.
+void uiLine(float x0, float y0, float x1, float y1, float width, const glm::vec3& color) {
+    glm::vec2 d(x1 - x0, y1 - y0);
+    float len = glm::length(d);
+    if (len <= 0.0f) return;
+    glm::vec2 n = glm::vec2(-d.y, d.x) * (0.5f * width / len);
+    glm::vec2 p0(x0, y0), p1(x1, y1);
+    uiQuad(p0 - n, p1 - n, p1 + n, p0 + n, color);
+}
+
+void uiRectOutline(float x0, float y0, float x1, float y1, float width, const glm::vec3& color) {
+    float h = width * 0.5f;
+    uiLine(x0 - h, y0, x1 + h, y0, width, color);
+    uiLine(x0 - h, y1, x1 + h, y1, width, color);
+    uiLine(x0, y0, x0, y1, width, color);
+    uiLine(x1, y0, x1, y1, width, color);
+}
+
+// One glyph instance per visible character; layout follows stb_easy_font
+// (advance from its char table, descenders one unit lower, 12-unit lines).
+void drawTextScreen(const std::string& text,
+    float x, float y,
+    const glm::vec3& color,
+    float scale = 1.0f)
+{
+    float penX = x, penY = y;
+    for (char ch : text) {
+        if (ch == '\n') {
+            penX = x;
+            penY += kGlyphLineHeight * scale;
+            continue;
+        }
+        int g = (unsigned char)ch - kGlyphFirst;
+        if (g < 0 || g >= kGlyphCount) continue;
+
+        unsigned char advance = stb_easy_font_charinfo[g].advance;
+        if (ch != ' ' && (int)gUI.glyphs.size() < kUIMaxGlyphs) {
+            gUI.glyphs.push_back(GlyphInstance{ penX, penY, scale, (float)g,
+                color.r, color.g, color.b });
+        }
+        penX += (advance & 15) * scale;
+    }
+}
+
+// Submits everything recorded since uiBegin: one draw for shapes, one
+// instanced draw for text.
+void uiFlush() {
+    if (gUI.verts.empty() && gUI.glyphs.empty()) return;
+
+    glDisable(GL_DEPTH_TEST);
+
+    if (!gUI.verts.empty() && gHudProg) {
+        size_t bytes = gUI.verts.size() * sizeof(UIVertex);
+        if (gUI.verts.size() != gUI.uploaded.size() ||
+            memcmp(gUI.verts.data(), gUI.uploaded.data(), bytes) != 0) {
+            glBindBuffer(GL_ARRAY_BUFFER, gUI.vbo);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, gUI.verts.data());
+            gUI.uploaded.assign(gUI.verts.begin(), gUI.verts.end());
+            gUI.uploads++;
+        }
+
+        glUseProgram(gHudProg);
+        glUniform2f(gHudScreenSizeLoc, (float)gUI.fbw, (float)gUI.fbh);
+        glBindVertexArray(gUI.vao);
+        glDrawElements(GL_TRIANGLES,
+            (GLsizei)(gUI.verts.size() / 4 * 6),
+            GL_UNSIGNED_SHORT,
+            nullptr);
+    }
+
+    if (!gUI.glyphs.empty() && gTextProg) {
+        size_t bytes = gUI.glyphs.size() * sizeof(GlyphInstance);
+        if (gUI.glyphs.size() != gUI.uploadedGlyphs.size() ||
+            memcmp(gUI.glyphs.data(), gUI.uploadedGlyphs.data(), bytes) != 0) {
+            glBindBuffer(GL_ARRAY_BUFFER, gUI.textVBO);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, gUI.glyphs.data());
+            gUI.uploadedGlyphs.assign(gUI.glyphs.begin(), gUI.glyphs.end());
+            gUI.uploads++;
+        }
+
+        glUseProgram(gTextProg);
+        glUniform2f(gTextScreenSizeLoc, (float)gUI.fbw, (float)gUI.fbh);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, gTextAtlas);
+        glBindVertexArray(gUI.textVAO);
+
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei)gUI.glyphs.size());
+        glDisable(GL_BLEND);
+    }
+
+    glEnable(GL_DEPTH_TEST);
+    glBindVertexArray(0);
+}
+
+// ---------- Crosshair ----------
+void drawCrosshair() {
+    const float sizePx = 8.0f;
+    float cx = gUI.fbw * 0.5f;
+    float cy = gUI.fbh * 0.5f;
+    glm::vec3 color(0.95f, 0.95f, 0.95f);
+
+    uiLine(cx - sizePx, cy, cx + sizePx, cy, 2.0f, color);
+    uiLine(cx, cy - sizePx, cx, cy + sizePx, 2.0f, color);
+}
+
+// ============ Dialog box (Pokemon style) ============
+
+void drawDialogBoxWithText(const std::string& text) {
+    if (text.empty()) return;
+
+    int fbw = gUI.fbw, fbh = gUI.fbh;
+    float marginX = fbw * 0.05f;
+    float marginY = fbh * 0.05f;
+    float boxHeight = fbh * 0.22f;
+
+    float x0 = marginX;
+    float x1 = fbw - marginX;
+    float y1 = fbh - marginY;
+    float y0 = y1 - boxHeight;
+
+    // fill
+    uiRect(x0, y0, x1, y1, glm::vec3(0.03f, 0.03f, 0.08f));
+
+    // border
+    uiRectOutline(x0, y0, x1, y1, 3.0f, glm::vec3(1.0f, 1.0f, 1.0f));
+
+    float textX = x0 + 20.0f;
+    float textY = y0 + 24.0f;
+    drawTextScreen(text, textX, textY, glm::vec3(1.0f, 1.0f, 1.0f), 2.5f);
+}
+
+// ================= ASSIMP TEXTURED MODEL =================
+
+struct SimpleVertex {
+    glm::vec3 pos;
+    glm::vec2 uv;
+};
+
+// Simulates a FIFO post-transform vertex cache over an index list.
+// Returns ACMR (vertex shader runs per triangle): 3.0 for unindexed soup,
+// approaching 0.5 for a well-ordered regular grid.
+float computeACMR(const std::vector<unsigned int>& indices,
+    unsigned int vertexCount, float* outATVR = nullptr, unsigned int cacheSize = 32)
+{
+    if (indices.empty() || !vertexCount) return 0.0f;
+
+    // A vertex is still in the FIFO if fewer than cacheSize misses
+    // happened since it was inserted.
+    std::vector<unsigned int> stamp(vertexCount, 0); // insertion tick, 0 = never
+    unsigned int tick = 0, misses = 0;
+
+    for (unsigned int idx : indices) {
+        bool cached = stamp[idx] != 0 && tick - stamp[idx] < cacheSize;
+        if (!cached) {
+            stamp[idx] = ++tick;
+            ++misses;
+        }
+    }
+
+    if (outATVR) *outATVR = float(misses) / float(vertexCount);
+    return float(misses) / float(indices.size() / 3);
+}
+
+// One draw range inside a model's shared vertex/index buffers.
+struct SubMesh {
+    unsigned int indexOffset = 0;   // first index in the shared IBO
+    unsigned int indexCount = 0;
+    unsigned int baseVertex = 0;    // indices are local to this vertex
+    unsigned int material = 0;
+};
+
+struct MeshMaterial {
+    std::string name;
+    std::string texturePath;        // resolved against the model's folder
+};
+
+// CPU-side model: every mesh in the scene, baked by its node transform and
+// packed into one vertex stream and one index stream, submeshes sorted by
+// material so each material is one contiguous run.
+struct MeshData {
+    std::vector<SimpleVertex> vertices;
+    std::vector<unsigned int> indices;
+    std::vector<SubMesh> submeshes;
+    std::vector<MeshMaterial> materials;
+    glm::vec3 boundsMin{ 0.0f }, boundsMax{ 0.0f };
+    // submeshes[lodStarts[l] .. lodStarts[l + 1]) draw LOD l; LOD 0 comes first
+    std::vector<uint32_t> lodStarts;
+};
+
+// ================= MESH LOD (quadric edge collapse) =================
+//
+// Each LOD is an extra index range over the same vertex buffer: a collapse
+// u -> v only rewrites indices, so no vertex data is duplicated. UV seams
+// (same position, different vertex) and open borders may only collapse
+// along themselves, so neither the outline nor the texture mapping tears.
+
+const int   kMaxMeshLods = 4;
+const float kLodTriangleRatio[kMaxMeshLods] = { 1.0f, 0.5f, 0.25f, 0.12f };
+const float kLodMaxError = 1e-2f;     // squared distance, mesh scaled to unit size
+
+struct Quadric {
+    double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0;
+
+    static Quadric plane(double a, double b, double c, double d) {
+        Quadric q;
+        q.a2 = a * a; q.ab = a * b; q.ac = a * c; q.ad = a * d;
+        q.b2 = b * b; q.bc = b * c; q.bd = b * d;
+        q.c2 = c * c; q.cd = c * d; q.d2 = d * d;
+        return q;
+    }
+
+    void add(const Quadric& o) {
+        a2 += o.a2; ab += o.ab; ac += o.ac; ad += o.ad;
+        b2 += o.b2; bc += o.bc; bd += o.bd;
+        c2 += o.c2; cd += o.cd; d2 += o.d2;
+    }
+
+    // Sum of squared distances from p to every accumulated plane.
+    double error(const glm::vec3& p) const {
+        double x = p.x, y = p.y, z = p.z;
+        return a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+            + b2 * y * y + 2 * bc * y * z + 2 * bd * y
+            + c2 * z * z + 2 * cd * z + d2;
+    }
+};
+
+// Simplifies one submesh's triangle list (indices local to verts) towards
+// targetIndexCount. Stops early once every remaining collapse costs more
+// than maxError.
+std::vector<uint32_t> simplifyIndices(const SimpleVertex* verts, size_t vertexCount,
+    const std::vector<uint32_t>& source, size_t targetIndexCount, float maxError)
+{
+    std::vector<uint32_t> indices = source;
+    if (indices.size() <= targetIndexCount || vertexCount == 0) return indices;
+
+    // Work in unit scale so maxError means the same for every model
+    glm::vec3 bmin(1e30f), bmax(-1e30f);
+    for (size_t i = 0; i < vertexCount; ++i) {
+        bmin = glm::min(bmin, verts[i].pos);
+        bmax = glm::max(bmax, verts[i].pos);
+    }
+    float extent = std::max(std::max(bmax.x - bmin.x, bmax.y - bmin.y), std::max(bmax.z - bmin.z, 1e-6f));
+    std::vector<glm::vec3> pos(vertexCount);
+    for (size_t i = 0; i < vertexCount; ++i) pos[i] = (verts[i].pos - bmin) / extent;
+
+    // Position groups: wedges of one corner that differ only in UV
+    std::vector<uint32_t> wedges(vertexCount);
+    for (size_t i = 0; i < vertexCount; ++i) wedges[i] = (uint32_t)i;
+    std::sort(wedges.begin(), wedges.end(), [&pos](uint32_t a, uint32_t b) {
+        if (pos[a].x != pos[b].x) return pos[a].x < pos[b].x;
+        if (pos[a].y != pos[b].y) return pos[a].y < pos[b].y;
+        return pos[a].z < pos[b].z;
+    });
+    std::vector<uint32_t> posId(vertexCount), groupStart(1, 0u);
+    for (size_t i = 0; i < vertexCount;) {
+        size_t j = i + 1;
+        while (j < vertexCount && pos[wedges[j]] == pos[wedges[i]]) ++j;
+        for (size_t k = i; k < j; ++k) posId[wedges[k]] = (uint32_t)groupStart.size() - 1;
+        groupStart.push_back((uint32_t)j);
+        i = j;
+    }
+    size_t groupCount = groupStart.size() - 1;
+
+    // Edge use counted on positions: 1 = border, >2 = non-manifold (locked).
+    // Recounted every round, since collapses make new edges.
+    std::unordered_map<uint64_t, int> edgeUse;
+    std::vector<char> border(groupCount), locked(groupCount);
+    auto edgeKey = [](uint32_t a, uint32_t b) { return ((uint64_t)std::min(a, b) << 32) | std::max(a, b); };
+    auto countEdges = [&]() {
+        edgeUse.clear();
+        for (size_t t = 0; t + 2 < indices.size(); t += 3)
+            for (int e = 0; e < 3; ++e)
+                edgeUse[edgeKey(posId[indices[t + e]], posId[indices[t + (e + 1) % 3]])]++;
+        std::fill(border.begin(), border.end(), 0);
+        std::fill(locked.begin(), locked.end(), 0);
+        for (const auto& e : edgeUse) {
+            uint32_t a = (uint32_t)(e.first >> 32), b = (uint32_t)e.first;
+            if (e.second == 1) border[a] = border[b] = 1;
+            if (e.second > 2) locked[a] = locked[b] = 1;
+        }
+    };
+
+    std::vector<Quadric> quadrics(groupCount);
+    for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+        const glm::vec3& p0 = pos[indices[t]];
+        glm::vec3 n = glm::cross(pos[indices[t + 1]] - p0, pos[indices[t + 2]] - p0);
+        float len = glm::length(n);
+        if (len <= 0.0f) continue;
+        n /= len;
+        Quadric q = Quadric::plane(n.x, n.y, n.z, -glm::dot(n, p0));
+        for (int k = 0; k < 3; ++k) quadrics[posId[indices[t + k]]].add(q);
+    }
+
+    // A collapse moves every wedge of position group A onto the wedge of B
+    // it shares an edge with. Seams may only slide along seams and borders
+    // along borders, which keeps UVs and open outlines intact.
+    struct Collapse { uint32_t from, to; double cost; };
+    std::vector<Collapse> candidates;
+    std::vector<uint32_t> remap(vertexCount), adjStart(vertexCount + 1), adj, target;
+    std::vector<char> touched(groupCount);
+
+    auto allowed = [&](uint32_t a, uint32_t b) {
+        if (locked[a]) return false;
+        bool seamA = groupStart[a + 1] - groupStart[a] > 1;
+        bool seamB = groupStart[b + 1] - groupStart[b] > 1;
+        if (seamA && !seamB) return false;
+        if (border[a]) {
+            auto e = edgeUse.find(edgeKey(a, b));
+            if (e == edgeUse.end() || e->second != 1) return false;
+        }
+        return true;
+    };
+
+    while (indices.size() > targetIndexCount) {
+        countEdges();
+        candidates.clear();
+        for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+            for (int e = 0; e < 3; ++e) {
+                uint32_t a = posId[indices[t + e]], b = posId[indices[t + (e + 1) % 3]];
+                if (a == b) continue;
+                Quadric q = quadrics[a];
+                q.add(quadrics[b]);
+                if (allowed(a, b)) candidates.push_back(Collapse{ a, b, q.error(pos[wedges[groupStart[b]]]) });
+                if (allowed(b, a)) candidates.push_back(Collapse{ b, a, q.error(pos[wedges[groupStart[a]]]) });
+            }
+        }
+        std::sort(candidates.begin(), candidates.end(),
+            [](const Collapse& x, const Collapse& y) { return x.cost < y.cost; });
+
+        // vertex -> triangle adjacency
+        std::fill(adjStart.begin(), adjStart.end(), 0u);
+        for (uint32_t v : indices) adjStart[v + 1]++;
+        for (size_t v = 0; v < vertexCount; ++v) adjStart[v + 1] += adjStart[v];
+        adj.resize(indices.size());
+        {
+            std::vector<uint32_t> fill(adjStart.begin(), adjStart.end() - 1);
+            for (size_t i = 0; i < indices.size(); ++i) adj[fill[indices[i]]++] = (uint32_t)(i / 3);
+        }
+
+        for (size_t v = 0; v < vertexCount; ++v) remap[v] = (uint32_t)v;
+        std::fill(touched.begin(), touched.end(), 0);
+        size_t needed = (indices.size() - targetIndexCount) / 3;
+        size_t removed = 0, collapses = 0;
+
+        for (const Collapse& c : candidates) {
+            if (c.cost > maxError || removed >= needed) break;
+            if (touched[c.from] || touched[c.to]) continue;
+
+            // pair each wedge of A with the wedge of B across an edge
+            bool ok = true;
+            target.clear();
+            for (uint32_t g = groupStart[c.from]; g < groupStart[c.from + 1] && ok; ++g) {
+                uint32_t w = wedges[g], to = UINT32_MAX;
+                for (uint32_t k = adjStart[w]; k < adjStart[w + 1] && to == UINT32_MAX; ++k) {
+                    const uint32_t* tri = &indices[adj[k] * 3];
+                    for (int j = 0; j < 3; ++j)
+                        if (posId[tri[j]] == c.to) { to = tri[j]; break; }
+                }
+                if (adjStart[w] != adjStart[w + 1] && to == UINT32_MAX) ok = false;
+                target.push_back(to);
+            }
+
+            // reject collapses that flip or squash a surviving triangle
+            size_t dying = 0;
+            for (uint32_t g = groupStart[c.from]; g < groupStart[c.from + 1] && ok; ++g) {
+                uint32_t w = wedges[g], to = target[g - groupStart[c.from]];
+                for (uint32_t k = adjStart[w]; k < adjStart[w + 1] && ok; ++k) {
+                    const uint32_t* tri = &indices[adj[k] * 3];
+                    if (tri[0] == to || tri[1] == to || tri[2] == to) { ++dying; continue; }
+                    glm::vec3 p[3], q[3];
+                    for (int j = 0; j < 3; ++j) {
+                        p[j] = pos[tri[j]];
+                        q[j] = tri[j] == w ? pos[to] : p[j];
+                    }
+                    glm::vec3 n0 = glm::cross(p[1] - p[0], p[2] - p[0]);
+                    glm::vec3 n1 = glm::cross(q[1] - q[0], q[2] - q[0]);
+                    float l0 = glm::length(n0), l1 = glm::length(n1);
+                    if (l1 <= 1e-12f || glm::dot(n0, n1) < 0.25f * l0 * l1) ok = false;
+                }
+            }
+            if (!ok) continue;
+
+            for (uint32_t g = groupStart[c.from]; g < groupStart[c.from + 1]; ++g) {
+                uint32_t w = wedges[g], to = target[g - groupStart[c.from]];
+                if (to != UINT32_MAX) remap[w] = to;
+                for (uint32_t k = adjStart[w]; k < adjStart[w + 1]; ++k) {
+                    const uint32_t* tri = &indices[adj[k] * 3];
+                    touched[posId[tri[0]]] = touched[posId[tri[1]]] = touched[posId[tri[2]]] = 1;
+                }
+            }
+            quadrics[c.to].add(quadrics[c.from]);
+            removed += dying;
+            ++collapses;
+        }
+        if (!collapses) break;
+
+        size_t out = 0;
+        for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+            uint32_t a = remap[indices[t]], b = remap[indices[t + 1]], c = remap[indices[t + 2]];
+            if (a == b || b == c || a == c) continue;
+            indices[out++] = a; indices[out++] = b; indices[out++] = c;
+        }
+        indices.resize(out);
+    }
+    return indices;
+}
+
+// Appends LOD 1..n submeshes (and their indices) after LOD 0. Levels that
+// fail to drop at least 10% more triangles are not emitted.
+void buildMeshLods(MeshData& data) {
+    size_t lod0 = data.submeshes.size();
+    data.lodStarts.assign(1, 0u);
+    data.lodStarts.push_back((uint32_t)lod0);
+
+    std::vector<std::vector<uint32_t>> previous(lod0);
+    size_t previousTris = data.indices.size() / 3;
+    for (size_t s = 0; s < lod0; ++s) {
+        const SubMesh& sub = data.submeshes[s];
+        previous[s].assign(data.indices.begin() + sub.indexOffset,
+            data.indices.begin() + sub.indexOffset + sub.indexCount);
+    }
+
+    for (int l = 1; l < kMaxMeshLods; ++l) {
+        std::vector<std::vector<uint32_t>> level(lod0);
+        size_t tris = 0;
+        for (size_t s = 0; s < lod0; ++s) {
+            const SubMesh& sub = data.submeshes[s];
+            size_t end = s + 1 < lod0 ? data.submeshes[s + 1].baseVertex : data.vertices.size();
+            if (end <= sub.baseVertex) end = data.vertices.size();
+            size_t target = (size_t)(sub.indexCount / 3 * kLodTriangleRatio[l]) * 3;
+            level[s] = simplifyIndices(&data.vertices[sub.baseVertex], end - sub.baseVertex,
+                previous[s], target, kLodMaxError);
+            tris += level[s].size() / 3;
+        }
+        if (tris == 0 || tris > previousTris * 9 / 10) break;
+
+        for (size_t s = 0; s < lod0; ++s) {
+            if (level[s].empty()) continue;
+            SubMesh sub = data.submeshes[s];
+            sub.indexOffset = (unsigned int)data.indices.size();
+            sub.indexCount = (unsigned int)level[s].size();
+            data.indices.insert(data.indices.end(), level[s].begin(), level[s].end());
+            data.submeshes.push_back(sub);
+        }
+        data.lodStarts.push_back((uint32_t)data.submeshes.size());
+        previous.swap(level);
+        previousTris = tris;
+    }
+}
+
+static void gatherNodeMeshes(const aiScene* scene, const aiNode* node,
+    const aiMatrix4x4& parent, std::vector<std::pair<unsigned int, aiMatrix4x4>>& out)
+{
+    aiMatrix4x4 world = parent * node->mTransformation;
+    for (unsigned int i = 0; i < node->mNumMeshes; ++i)
+        out.push_back({ node->mMeshes[i], world });
+    for (unsigned int c = 0; c < node->mNumChildren; ++c)
+        gatherNodeMeshes(scene, node->mChildren[c], world, out);
+}
+
+bool importMeshData(const std::string& path, MeshData& out) {
+    Assimp::Importer importer;
+
+    const aiScene* scene = importer.ReadFile(
+        path,
+        aiProcess_Triangulate |
+        aiProcess_JoinIdenticalVertices |
+        aiProcess_ImproveCacheLocality |
+        aiProcess_SortByPType
+    );
+
+    if (!scene || !scene->HasMeshes() || !scene->mRootNode) {
+        std::cerr << "Assimp failed: " << importer.GetErrorString() << "\n";
+        return false;
+    }
+
+    std::string dir;
+    size_t slash = path.find_last_of("/\\");
+    if (slash != std::string::npos) dir = path.substr(0, slash + 1);
+
+    out = MeshData{};
+    for (unsigned int m = 0; m < scene->mNumMaterials; ++m) {
+        const aiMaterial* mat = scene->mMaterials[m];
+        MeshMaterial slot;
+        aiString name, tex;
+        if (mat->Get(AI_MATKEY_NAME, name) == AI_SUCCESS) slot.name = name.C_Str();
+        if (mat->GetTexture(aiTextureType_DIFFUSE, 0, &tex) == AI_SUCCESS)
+            slot.texturePath = dir + tex.C_Str();
+        out.materials.push_back(slot);
+    }
+    if (out.materials.empty()) out.materials.push_back(MeshMaterial{ "default", "" });
+
+    std::vector<std::pair<unsigned int, aiMatrix4x4>> instances;
+    gatherNodeMeshes(scene, scene->mRootNode, aiMatrix4x4(), instances);
+
+    // stable sort keeps scene order within a material
+    std::stable_sort(instances.begin(), instances.end(),
+        [scene](const auto& a, const auto& b) {
+            return scene->mMeshes[a.first]->mMaterialIndex < scene->mMeshes[b.first]->mMaterialIndex;
+        });
+
+    glm::vec3 bmin(1e30f), bmax(-1e30f);
+    for (const auto& inst : instances) {
+        const aiMesh* mesh = scene->mMeshes[inst.first];
+        if (!(mesh->mPrimitiveTypes & aiPrimitiveType_TRIANGLE)) continue;
+
+        SubMesh sub;
+        sub.baseVertex = (unsigned int)out.vertices.size();
+        sub.indexOffset = (unsigned int)out.indices.size();
+        sub.material = std::min(mesh->mMaterialIndex, (unsigned int)out.materials.size() - 1);
+
+        for (unsigned int i = 0; i < mesh->mNumVertices; ++i) {
+            aiVector3D p = inst.second * mesh->mVertices[i];
+            SimpleVertex v{};
+            v.pos = glm::vec3(p.x, p.y, p.z);
+            if (mesh->mTextureCoords[0]) {
+                const aiVector3D& t = mesh->mTextureCoords[0][i];
+                v.uv = glm::vec2(t.x, t.y);
+            }
+            else {
+                v.uv = glm::vec2(0.0f);
+            }
+            bmin = glm::min(bmin, v.pos);
+            bmax = glm::max(bmax, v.pos);
+            out.vertices.push_back(v);
+        }
+
+        for (unsigned int f = 0; f < mesh->mNumFaces; ++f) {
+            const aiFace& face = mesh->mFaces[f];
+            if (face.mNumIndices != 3) continue;
+            out.indices.push_back(face.mIndices[0]);
+            out.indices.push_back(face.mIndices[1]);
+            out.indices.push_back(face.mIndices[2]);
+        }
+
+        sub.indexCount = (unsigned int)out.indices.size() - sub.indexOffset;
+        if (sub.indexCount) out.submeshes.push_back(sub);
+    }
+
+    if (out.vertices.empty() || out.indices.empty()) {
+        std::cerr << "Assimp: no triangles in " << path << "\n";
+        return false;
+    }
+
+    out.boundsMin = bmin;
+    out.boundsMax = bmax;
+    buildMeshLods(out);
+    return true;
+}
+
+// ================= BAKED MESH FORMAT (.esm) =================
+//
+// Little-endian blob laid out exactly as the GPU buffers want it:
+//   header | vertex stream | index stream (16/32-bit) | submesh table | materials | LOD table
+// Sections are 16-byte aligned and addressed by offsets from the file start,
+// so the runtime maps the file and hands the pointers straight to GL.
+
+const char     kBakedMeshMagic[4] = { 'E', 'S', 'M', 'B' };
+const uint32_t kBakedMeshVersion = 3;     // 2: LOD table, 3: source stamp
+
+struct BakedMeshHeader {
+    char     magic[4];
+    uint32_t version;
+    uint32_t vertexCount;
+    uint32_t vertexStride;
+    uint32_t indexCount;
+    uint32_t indexSize;       // 2 or 4
+    uint32_t submeshCount;
+    uint32_t materialCount;
+    float    boundsMin[3];
+    float    boundsMax[3];
+    uint32_t vertexOffset;
+    uint32_t indexOffset;
+    uint32_t submeshOffset;
+    uint32_t materialOffset;
+    uint32_t lodCount;
+    uint32_t lodOffset;       // lodCount + 1 submesh starts
+    uint64_t sourceSize;      // FileStamp of the cooked source
+    uint64_t sourceTime;
+};
+
+struct BakedMaterial {
+    char name[64];
+    char texture[192];        // relative to the .esm file's folder
+};
+
+static_assert(sizeof(SimpleVertex) == 20, "SimpleVertex layout is part of the .esm format");
+static_assert(sizeof(SubMesh) == 16, "SubMesh layout is part of the .esm format");
+static_assert(sizeof(BakedMeshHeader) == 96, "BakedMeshHeader layout changed");
+
+// Non-owning view of model streams, either from MeshData or a mapped blob.
+struct MeshView {
+    const SimpleVertex* vertices = nullptr;
+    size_t vertexCount = 0;
+    const void* indices = nullptr;
+    size_t indexCount = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+    const SubMesh* submeshes = nullptr;
+    size_t submeshCount = 0;
+    std::vector<std::string> materialTextures; // resolved paths, "" = none
+    std::vector<uint32_t> lodStarts;           // as MeshData::lodStarts
+    glm::vec3 boundsMin{ 0.0f }, boundsMax{ 0.0f };
+};
+
+// Indices are local to each submesh, so 16-bit works as long as every
+// submesh on its own fits.
+bool meshFits16Bit(const MeshData& data) {
+    size_t lod0 = data.lodStarts.size() > 1 ? data.lodStarts[1] : data.submeshes.size();
+    for (size_t i = 0; i < lod0; ++i) {
+        size_t end = i + 1 < lod0
+            ? data.submeshes[i + 1].baseVertex : data.vertices.size();
+        if (end - data.submeshes[i].baseVertex > 0x10000) return false;
+    }
+    return true;
+}
+
+static void writeAligned(std::ofstream& out, const void* bytes, size_t n, uint32_t& offset) {
+    static const char zeros[16] = {};
+    size_t pos = (size_t)out.tellp();
+    size_t pad = (16 - pos % 16) % 16;
+    out.write(zeros, pad);
+    offset = (uint32_t)(pos + pad);
+    out.write((const char*)bytes, n);
+}
+
+bool writeBakedMesh(const MeshData& data, const std::string& srcPath, const std::string& outPath) {
+    if (!hostIsLittleEndian()) {
+        std::cerr << "Mesh cooker: big-endian hosts are not supported\n";
+        return false;
+    }
+
+    std::ofstream out(outPath, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        std::cerr << "Mesh cooker: cannot write " << outPath << "\n";
+        return false;
+    }
+
+    bool small = meshFits16Bit(data);
+    BakedMeshHeader h{};
+    memcpy(h.magic, kBakedMeshMagic, 4);
+    h.version = kBakedMeshVersion;
+    h.vertexCount = (uint32_t)data.vertices.size();
+    h.vertexStride = sizeof(SimpleVertex);
+    h.indexCount = (uint32_t)data.indices.size();
+    h.indexSize = small ? 2 : 4;
+    h.submeshCount = (uint32_t)data.submeshes.size();
+    h.materialCount = (uint32_t)data.materials.size();
+    h.lodCount = data.lodStarts.size() > 1 ? (uint32_t)data.lodStarts.size() - 1 : 1;
+    memcpy(h.boundsMin, glm::value_ptr(data.boundsMin), sizeof(h.boundsMin));
+    memcpy(h.boundsMax, glm::value_ptr(data.boundsMax), sizeof(h.boundsMax));
+    FileStamp stamp;
+    if (fileStamp(srcPath, stamp)) {
+        h.sourceSize = stamp.size;
+        h.sourceTime = stamp.time;
+    }
+
+    // header first as a placeholder, rewritten once the offsets are known
+    out.write((const char*)&h, sizeof(h));
+
+    writeAligned(out, data.vertices.data(), data.vertices.size() * sizeof(SimpleVertex), h.vertexOffset);
+    if (small) {
+        std::vector<uint16_t> idx16(data.indices.begin(), data.indices.end());
+        writeAligned(out, idx16.data(), idx16.size() * 2, h.indexOffset);
+    }
+    else {
+        writeAligned(out, data.indices.data(), data.indices.size() * 4, h.indexOffset);
+    }
+    writeAligned(out, data.submeshes.data(), data.submeshes.size() * sizeof(SubMesh), h.submeshOffset);
+
+    std::string srcDir = folderOf(srcPath);
+    std::vector<BakedMaterial> mats(data.materials.size());
+    for (size_t m = 0; m < data.materials.size(); ++m) {
+        memset(&mats[m], 0, sizeof(BakedMaterial));
+        std::string tex = data.materials[m].texturePath;
+        if (!srcDir.empty() && tex.compare(0, srcDir.size(), srcDir) == 0) tex = tex.substr(srcDir.size());
+        if (tex.size() >= sizeof(mats[m].texture)) {
+            std::cerr << "Mesh cooker: texture path too long, dropped: " << tex << "\n";
+            tex.clear();
+        }
+        const std::string& name = data.materials[m].name;
+        memcpy(mats[m].name, name.data(), std::min(name.size(), sizeof(mats[m].name) - 1));
+        memcpy(mats[m].texture, tex.data(), tex.size());
+    }
+    writeAligned(out, mats.data(), mats.size() * sizeof(BakedMaterial), h.materialOffset);
+
+    std::vector<uint32_t> lodStarts = data.lodStarts;
+    if (lodStarts.size() < 2) lodStarts = { 0u, (uint32_t)data.submeshes.size() };
+    writeAligned(out, lodStarts.data(), lodStarts.size() * sizeof(uint32_t), h.lodOffset);
+
+    out.seekp(0);
+    out.write((const char*)&h, sizeof(h));
+    return (bool)out;
+}
+
+// Validates the header and points a MeshView into the mapped file.
+bool viewBakedMesh(const MappedFile& file, const std::string& path, MeshView& view) {
+    if (file.size < sizeof(BakedMeshHeader)) return false;
+    const BakedMeshHeader& h = *(const BakedMeshHeader*)file.data;
+
+    if (memcmp(h.magic, kBakedMeshMagic, 4) != 0 || h.version != kBakedMeshVersion ||
+        h.vertexStride != sizeof(SimpleVertex) || (h.indexSize != 2 && h.indexSize != 4) ||
+        !hostIsLittleEndian()) {
+        std::cerr << "Baked mesh: unsupported format or version in " << path << "\n";
+        return false;
+    }
+
+    auto inside = [&file](uint64_t offset, uint64_t bytes) {
+        return offset + bytes <= file.size;
+    };
+    if (!inside(h.vertexOffset, (uint64_t)h.vertexCount * h.vertexStride) ||
+        !inside(h.indexOffset, (uint64_t)h.indexCount * h.indexSize) ||
+        !inside(h.submeshOffset, (uint64_t)h.submeshCount * sizeof(SubMesh)) ||
+        !inside(h.materialOffset, (uint64_t)h.materialCount * sizeof(BakedMaterial)) ||
+        h.lodCount == 0 || !inside(h.lodOffset, ((uint64_t)h.lodCount + 1) * sizeof(uint32_t))) {
+        std::cerr << "Baked mesh: truncated file " << path << "\n";
+        return false;
+    }
+
+    view.vertices = (const SimpleVertex*)(file.data + h.vertexOffset);
+    view.vertexCount = h.vertexCount;
+    view.indices = file.data + h.indexOffset;
+    view.indexCount = h.indexCount;
+    view.indexType = h.indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    view.submeshes = (const SubMesh*)(file.data + h.submeshOffset);
+    view.submeshCount = h.submeshCount;
+    view.boundsMin = glm::vec3(h.boundsMin[0], h.boundsMin[1], h.boundsMin[2]);
+    view.boundsMax = glm::vec3(h.boundsMax[0], h.boundsMax[1], h.boundsMax[2]);
+
+    const uint32_t* lods = (const uint32_t*)(file.data + h.lodOffset);
+    view.lodStarts.assign(lods, lods + h.lodCount + 1);
+    for (size_t l = 1; l < view.lodStarts.size(); ++l) {
+        if (view.lodStarts[l] < view.lodStarts[l - 1] || view.lodStarts[l] > h.submeshCount) {
+            std::cerr << "Baked mesh: bad LOD table in " << path << "\n";
+            return false;
+        }
+    }
+
+    // every draw range, and every index in it, must stay inside the streams
+    for (uint32_t s = 0; s < h.submeshCount; ++s) {
+        const SubMesh& sm = view.submeshes[s];
+        if ((uint64_t)sm.indexOffset + sm.indexCount > h.indexCount) {
+            std::cerr << "Baked mesh: submesh " << s << " indexes past the index stream in " << path << "\n";
+            return false;
+        }
+        uint32_t top = 0;
+        if (h.indexSize == 2) {
+            const uint16_t* idx = (const uint16_t*)view.indices + sm.indexOffset;
+            for (uint32_t i = 0; i < sm.indexCount; ++i) top = std::max<uint32_t>(top, idx[i]);
+        }
+        else {
+            const uint32_t* idx = (const uint32_t*)view.indices + sm.indexOffset;
+            for (uint32_t i = 0; i < sm.indexCount; ++i) top = std::max(top, idx[i]);
+        }
+        if (sm.indexCount > 0 && (uint64_t)sm.baseVertex + top >= h.vertexCount) {
+            std::cerr << "Baked mesh: submesh " << s << " reads past the vertex stream in " << path << "\n";
+            return false;
+        }
+    }
+
+    std::string dir = folderOf(path);
+    const BakedMaterial* mats = (const BakedMaterial*)(file.data + h.materialOffset);
+    view.materialTextures.clear();
+    for (uint32_t m = 0; m < h.materialCount; ++m) {
+        std::string tex(mats[m].texture, strnlen(mats[m].texture, sizeof(mats[m].texture)));
+        view.materialTextures.push_back(tex.empty() ? tex : dir + tex);
+    }
+    return true;
+}
+
+// ================= TRIANGLE MESH COLLIDERS (quantized BVH) =================
+//
+// Built from a mesh's LOD 0 triangles when the model is imported or read
+// from its .esm. Nodes are 16 bytes: bounds quantized to 16 bits per axis
+// against the mesh bounds (rounded outward, so they stay conservative) and
+// one word that is either the right child (the left child is the next
+// node) or a leaf's triangle range. Triangles are stored in leaf order as
+// a vertex and two edges, ready for the ray test, so a leaf is one
+// contiguous read. Built top-down with a 12-bin SAH split; below
+// kCollisionSahDepth it switches to median splits, which bounds the depth
+// (and so the fixed traversal stacks) whatever the triangle soup looks like.
+//
+// Queries: nearest ray hit, capsule (or sphere, a == b) overlap, and a
+// swept capsule for the character controller. The sweep is a ray against
+// each nearby triangle grown by the capsule: the triangle extruded along
+// the capsule's segment, offset by the radius. That shape is covered by the
+// extruded faces pushed out by r on both sides plus capsules around all
+// nine prism edges; the first of those the ray meets is the first contact.
+
+const uint32_t kCollisionLeafBit = 0x80000000u;
+const int      kCollisionLeafTris = 4;
+const int      kCollisionSahBins = 12;
+const int      kCollisionSahDepth = 64;     // + at most 24 median levels
+const int      kCollisionStack = 256;
+static_assert(kCollisionSahDepth + 24 + 1 <= kCollisionStack, "collision traversal stack can overflow");
+
+struct CollisionNode {
+    uint16_t qmin[3], qmax[3];
+    uint32_t data;                  // leaf: bit 31 | count << 24 | first; else right child
+};
+static_assert(sizeof(CollisionNode) == 16, "CollisionNode layout changed");
+
+struct CollisionTri {
+    glm::vec3 v0, e1, e2;           // v1 = v0 + e1, v2 = v0 + e2
+};
+
+struct MeshHit {
+    float t = 1e30f;
+    glm::vec3 normal{ 0.0f, 1.0f, 0.0f };
+    int32_t triangle = -1;
+};
+
+struct MeshContact {
+    glm::vec3 normal;               // from the triangle towards the capsule
+    float depth = 0.0f;             // r - distance
+    int32_t triangle = -1;
+};
+
+// Ray p + t d, t in [0, 1], vs the capsule around segment [a, b]. Returns
+// the first t or -1. p must be outside the capsule.
+float rayCapsule(const glm::vec3& p, const glm::vec3& d, const glm::vec3& a, const glm::vec3& b, float r) {
+    glm::vec3 ba = b - a, oa = p - a;
+    float baba = glm::dot(ba, ba), bard = glm::dot(ba, d), baoa = glm::dot(ba, oa);
+    float dd = glm::dot(d, d), rdoa = glm::dot(d, oa), oaoa = glm::dot(oa, oa);
+    float qa = baba * dd - bard * bard;
+    if (qa > 1e-12f) {
+        float qb = baba * rdoa - baoa * bard;
+        float qc = baba * oaoa - baoa * baoa - r * r * baba;
+        float h = qb * qb - qa * qc;
+        if (h < 0.0f) return -1.0f;
+        float t = (-qb - sqrtf(h)) / qa;
+        float y = baoa + t * bard;
+        if (y > 0.0f && y < baba) return t >= 0.0f && t <= 1.0f ? t : -1.0f;
+    }
+    // end caps
+    float best = -1.0f;
+    for (const glm::vec3* c : { &a, &b }) {
+        glm::vec3 oc = p - *c;
+        float qb = glm::dot(d, oc), qc = glm::dot(oc, oc) - r * r;
+        float h = qb * qb - dd * qc;
+        if (h < 0.0f || dd <= 0.0f) continue;
+        float t = (-qb - sqrtf(h)) / dd;
+        if (t >= 0.0f && t <= 1.0f && (best < 0.0f || t < best)) best = t;
+    }
+    return best;
+}
+
+// Moller-Trumbore, both sides. Returns t in [tMin, tMax] or -1.
+inline float rayTriangle(const glm::vec3& o, const glm::vec3& d, const glm::vec3& v0,
+    const glm::vec3& e1, const glm::vec3& e2, float tMin, float tMax)
+{
+    glm::vec3 pv = glm::cross(d, e2);
+    float det = glm::dot(e1, pv);
+    if (fabsf(det) < 1e-12f) return -1.0f;
+    float inv = 1.0f / det;
+    glm::vec3 tv = o - v0;
+    float u = glm::dot(tv, pv) * inv;
+    if (u < 0.0f || u > 1.0f) return -1.0f;
+    glm::vec3 qv = glm::cross(tv, e1);
+    float v = glm::dot(d, qv) * inv;
+    if (v < 0.0f || u + v > 1.0f) return -1.0f;
+    float t = glm::dot(e2, qv) * inv;
+    return t >= tMin && t <= tMax ? t : -1.0f;
+}
+
+// Ericson, RTCD 5.1.5.
+glm::vec3 closestPointTriangle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+    glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+    float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f) return a;
+    glm::vec3 bp = p - b;
+    float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3) return b;
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) return a + ab * (d1 / (d1 - d3));
+    glm::vec3 cp = p - c;
+    float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6) return c;
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) return a + ac * (d2 / (d2 - d6));
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f)
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+    float denom = 1.0f / (va + vb + vc);
+    return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+// Ericson, RTCD 5.1.9: closest points c1 on [p1, q1] and c2 on [p2, q2].
+void closestSegmentSegment(const glm::vec3& p1, const glm::vec3& q1, const glm::vec3& p2, const glm::vec3& q2,
+    glm::vec3& c1, glm::vec3& c2)
+{
+    glm::vec3 d1 = q1 - p1, d2 = q2 - p2, r = p1 - p2;
+    float a = glm::dot(d1, d1), e = glm::dot(d2, d2), f = glm::dot(d2, r);
+    float s = 0.0f, t = 0.0f;
+    if (a <= 1e-12f && e <= 1e-12f) {
+        c1 = p1; c2 = p2;
+        return;
+    }
+    if (a <= 1e-12f) {
+        t = glm::clamp(f / e, 0.0f, 1.0f);
+    }
+    else {
+        float c = glm::dot(d1, r);
+        if (e <= 1e-12f) {
+            s = glm::clamp(-c / a, 0.0f, 1.0f);
+        }
+        else {
+            float b = glm::dot(d1, d2), denom = a * e - b * b;
+            s = denom > 1e-12f ? glm::clamp((b * f - c * e) / denom, 0.0f, 1.0f) : 0.0f;
+            t = (b * s + f) / e;
+            if (t < 0.0f) { t = 0.0f; s = glm::clamp(-c / a, 0.0f, 1.0f); }
+            else if (t > 1.0f) { t = 1.0f; s = glm::clamp((b - c) / a, 0.0f, 1.0f); }
+        }
+    }
+    c1 = p1 + d1 * s;
+    c2 = p2 + d2 * t;
+}
+
+// Squared distance between segment [p, q] and a triangle, with the closest
+// points (onSeg, onTri).
+float segmentTriangleDist2(const glm::vec3& p, const glm::vec3& q, const CollisionTri& tri,
+    glm::vec3& onSeg, glm::vec3& onTri)
+{
+    glm::vec3 v1 = tri.v0 + tri.e1, v2 = tri.v0 + tri.e2;
+    float t = rayTriangle(p, q - p, tri.v0, tri.e1, tri.e2, 0.0f, 1.0f);
+    if (t >= 0.0f) {
+        onSeg = onTri = p + (q - p) * t;
+        return 0.0f;
+    }
+    float best = 1e30f;
+    auto consider = [&](const glm::vec3& s, const glm::vec3& c) {
+        glm::vec3 d = s - c;
+        float d2 = glm::dot(d, d);
+        if (d2 < best) { best = d2; onSeg = s; onTri = c; }
+    };
+    consider(p, closestPointTriangle(p, tri.v0, v1, v2));
+    consider(q, closestPointTriangle(q, tri.v0, v1, v2));
+    const glm::vec3 corners[3] = { tri.v0, v1, v2 };
+    for (int k = 0; k < 3; ++k) {
+        glm::vec3 c1, c2;
+        closestSegmentSegment(p, q, corners[k], corners[(k + 1) % 3], c1, c2);
+        consider(c1, c2);
+    }
+    return best;
+}
+
+struct CollisionMesh {
+    std::vector<CollisionNode> nodes;
+    std::vector<CollisionTri> tris;
+    glm::vec3 origin{ 0.0f }, step{ 1.0f };     // world = origin + q * step
+    glm::vec3 boundsMin{ 0.0f }, boundsMax{ 0.0f };
+
+    bool empty() const { return tris.empty(); }
+
+    size_t memoryBytes() const {
+        return nodes.size() * sizeof(CollisionNode) + tris.size() * sizeof(CollisionTri);
+    }
+
+    // indices: 3 per triangle into positions.
+    void build(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices) {
+        nodes.clear();
+        tris.clear();
+        size_t count = indices.size() / 3;
+        if (!count) return;
+        if (count > 0xFFFFFF) {
+            std::cerr << "Collision mesh: " << count << " triangles, the limit is " << 0xFFFFFF << "\n";
+            return;
+        }
+        for (size_t i = 0; i < count * 3; ++i) {
+            if (indices[i] >= positions.size()) {
+                std::cerr << "Collision mesh: index " << indices[i] << " at " << i << " is past "
+                    << positions.size() << " vertices\n";
+                return;
+            }
+        }
+
+        std::vector<CollisionTri> source(count);
+        std::vector<glm::vec3> centroid(count), triMin(count), triMax(count);
+        boundsMin = glm::vec3(1e30f);
+        boundsMax = glm::vec3(-1e30f);
+        for (size_t i = 0; i < count; ++i) {
+            const glm::vec3& a = positions[indices[i * 3]];
+            const glm::vec3& b = positions[indices[i * 3 + 1]];
+            const glm::vec3& c = positions[indices[i * 3 + 2]];
+            source[i] = CollisionTri{ a, b - a, c - a };
+            triMin[i] = glm::min(a, glm::min(b, c));
+            triMax[i] = glm::max(a, glm::max(b, c));
+            centroid[i] = (a + b + c) * (1.0f / 3.0f);
+            boundsMin = glm::min(boundsMin, triMin[i]);
+            boundsMax = glm::max(boundsMax, triMax[i]);
+        }
+        origin = boundsMin;
+        step = glm::max(boundsMax - boundsMin, glm::vec3(1e-4f)) / 65535.0f;
+
+        std::vector<uint32_t> order(count);
+        for (uint32_t i = 0; i < (uint32_t)count; ++i) order[i] = i;
+        nodes.reserve(count / 2 + 1);
+        buildNode(order, 0, count, 0, centroid, triMin, triMax);
+
+        tris.resize(count);
+        for (size_t i = 0; i < count; ++i) tris[i] = source[order[i]];
+    }
+
+    // LOD 0 of a mesh as read for rendering (Assimp import or .esm view).
+    void buildFromView(const MeshView& view) {
+        std::vector<glm::vec3> positions(view.vertexCount);
+        for (size_t i = 0; i < view.vertexCount; ++i) positions[i] = view.vertices[i].pos;
+        size_t lod0 = view.lodStarts.size() > 1 ? view.lodStarts[1] : view.submeshCount;
+        std::vector<uint32_t> indices;
+        for (size_t s = 0; s < lod0; ++s) {
+            const SubMesh& sm = view.submeshes[s];
+            for (unsigned int k = 0; k < sm.indexCount; ++k) {
+                size_t at = sm.indexOffset + k;
+                uint32_t local = view.indexType == GL_UNSIGNED_SHORT
+                    ? ((const uint16_t*)view.indices)[at] : ((const uint32_t*)view.indices)[at];
+                indices.push_back(sm.baseVertex + local);
+            }
+        }
+        build(positions, indices);
+    }
+
+    void nodeBounds(const CollisionNode& n, glm::vec3& mn, glm::vec3& mx) const {
+        mn = origin + glm::vec3(n.qmin[0], n.qmin[1], n.qmin[2]) * step;
+        mx = origin + glm::vec3(n.qmax[0], n.qmax[1], n.qmax[2]) * step;
+    }
+
+    // Calls fn(triangleIndex) for every triangle whose leaf box touches
+    // [mn, mx].
+    template <typename Fn>
+    void forEachInBox(const glm::vec3& mn, const glm::vec3& mx, Fn fn) const {
+        if (nodes.empty()) return;
+        uint32_t stack[kCollisionStack];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            uint32_t ni = stack[--top];
+            const CollisionNode& n = nodes[ni];
+            glm::vec3 bmin, bmax;
+            nodeBounds(n, bmin, bmax);
+            if (bmin.x > mx.x || bmax.x < mn.x || bmin.y > mx.y || bmax.y < mn.y || bmin.z > mx.z || bmax.z < mn.z)
+                continue;
+            if (n.data & kCollisionLeafBit) {
+                uint32_t first = n.data & 0xFFFFFF, count = (n.data >> 24) & 0x7F;
+                for (uint32_t i = first; i < first + count; ++i) fn(i);
+            }
+            else {
+                stack[top++] = n.data;
+                stack[top++] = ni + 1;
+            }
+        }
+    }
+
+    // Nearest hit along o + t d, t in [0, maxT]; the normal faces the ray.
+    bool raycast(const glm::vec3& o, const glm::vec3& d, float maxT, MeshHit& hit) const {
+        hit = MeshHit{};
+        hit.t = maxT;
+        if (nodes.empty()) return false;
+        auto inv = [](float v) { return 1.0f / (fabsf(v) > 1e-12f ? v : (v < 0.0f ? -1e-12f : 1e-12f)); };
+        glm::vec3 id(inv(d.x), inv(d.y), inv(d.z));
+        auto slab = [&](const CollisionNode& n) {
+            glm::vec3 mn, mx;
+            nodeBounds(n, mn, mx);
+            glm::vec3 t0 = (mn - o) * id, t1 = (mx - o) * id;
+            glm::vec3 lo = glm::min(t0, t1), hi = glm::max(t0, t1);
+            float tn = std::max(std::max(lo.x, lo.y), std::max(lo.z, 0.0f));
+            float tf = std::min(std::min(hi.x, hi.y), std::min(hi.z, hit.t));
+            return tn <= tf ? tn : -1.0f;
+        };
+
+        uint32_t stack[kCollisionStack];
+        int top = 0;
+        if (slab(nodes[0]) >= 0.0f) stack[top++] = 0;
+        while (top > 0) {
+            uint32_t ni = stack[--top];
+            const CollisionNode& n = nodes[ni];
+            if (n.data & kCollisionLeafBit) {
+                uint32_t first = n.data & 0xFFFFFF, count = (n.data >> 24) & 0x7F;
+                for (uint32_t i = first; i < first + count; ++i) {
+                    const CollisionTri& tri = tris[i];
+                    float t = rayTriangle(o, d, tri.v0, tri.e1, tri.e2, 0.0f, hit.t);
+                    if (t >= 0.0f && (hit.triangle < 0 || t < hit.t)) {
+                        hit.t = t;
+                        hit.triangle = (int32_t)i;
+                    }
+                }
+                continue;
+            }
+            uint32_t a = ni + 1, b = n.data;
+            float ta = slab(nodes[a]), tb = slab(nodes[b]);
+            if (ta >= 0.0f && tb >= 0.0f) {
+                if (ta > tb) { std::swap(a, b); std::swap(ta, tb); }
+                stack[top++] = b;           // far child waits
+                stack[top++] = a;
+            }
+            else if (ta >= 0.0f) stack[top++] = a;
+            else if (tb >= 0.0f) stack[top++] = b;
+        }
+        if (hit.triangle < 0) return false;
+        const CollisionTri& tri = tris[hit.triangle];
+        hit.normal = glm::normalize(glm::cross(tri.e1, tri.e2));
+        if (glm::dot(hit.normal, d) > 0.0f) hit.normal = -hit.normal;
+        return true;
+    }
+
+    // Triangles within r of segment [a, b]; returns how many were added.
+    size_t overlapCapsule(const glm::vec3& a, const glm::vec3& b, float r, std::vector<MeshContact>& out) const {
+        size_t before = out.size();
+        glm::vec3 mn = glm::min(a, b) - r, mx = glm::max(a, b) + r;
+        forEachInBox(mn, mx, [&](uint32_t i) {
+            glm::vec3 onSeg, onTri;
+            float d2 = segmentTriangleDist2(a, b, tris[i], onSeg, onTri);
+            if (d2 >= r * r) return;
+            MeshContact c;
+            float d = sqrtf(d2);
+            if (d > 1e-6f) {
+                c.normal = (onSeg - onTri) / d;
+            }
+            else {
+                c.normal = glm::normalize(glm::cross(tris[i].e1, tris[i].e2));
+            }
+            c.depth = r - d;
+            c.triangle = (int32_t)i;
+            out.push_back(c);
+        });
+        return out.size() - before;
+    }
+
+    // First contact of the capsule [a, b] moved by delta, as a fraction of
+    // delta in [0, 1], or -1. Starting in contact counts (t = 0) only when
+    // delta moves further in.
+    float sweepCapsule(const glm::vec3& a, const glm::vec3& b, float r, const glm::vec3& delta, glm::vec3& normal) const {
+        glm::vec3 mn = glm::min(glm::min(a, b), glm::min(a, b) + delta) - r;
+        glm::vec3 mx = glm::max(glm::max(a, b), glm::max(a, b) + delta) + r;
+        const glm::vec3 w = a - b;      // the triangle extruded by the segment, seen from a
+        float best = -1.0f;
+        int32_t bestTri = -1;
+        forEachInBox(mn, mx, [&](uint32_t i) {
+            const CollisionTri& tri = tris[i];
+            glm::vec3 onSeg, onTri;
+            if (segmentTriangleDist2(a, b, tri, onSeg, onTri) < r * r) {
+                glm::vec3 n = onSeg - onTri;
+                float len = glm::length(n);
+                n = len > 1e-6f ? n / len : glm::normalize(glm::cross(tri.e1, tri.e2));
+                // the first starting contact that resists the move wins
+                if (glm::dot(delta, n) < 0.0f && best != 0.0f) {
+                    best = 0.0f;
+                    normal = n;
+                    bestTri = -1;
+                }
+                return;
+            }
+            float limit = best < 0.0f ? 1.0f : best;
+            auto keep = [&](float t) {
+                if (t >= 0.0f && t <= limit) { limit = t; best = t; bestTri = (int32_t)i; }
+            };
+            const glm::vec3 v[3] = { tri.v0, tri.v0 + tri.e1, tri.v0 + tri.e2 };
+            // both copies of the triangle, pushed out by r either side
+            glm::vec3 tn = glm::cross(tri.e1, tri.e2);
+            float tl = glm::length(tn);
+            if (tl > 1e-12f) {
+                tn *= r / tl;
+                for (int s = -1; s <= 1; s += 2)
+                    for (int c = 0; c < 2; ++c)
+                        keep(rayTriangle(a, delta, tri.v0 + tn * (float)s + w * (float)c, tri.e1, tri.e2, 0.0f, limit));
+            }
+            for (int k = 0; k < 3; ++k) {
+                const glm::vec3& p = v[k];
+                const glm::vec3& q = v[(k + 1) % 3];
+                // side wall swept by this edge, pushed out by r either side
+                glm::vec3 sn = glm::cross(q - p, w);
+                float sl = glm::length(sn);
+                if (sl > 1e-12f) {
+                    sn *= r / sl;
+                    for (int s = -1; s <= 1; s += 2) {
+                        glm::vec3 o = p + sn * (float)s;
+                        keep(rayTriangle(a, delta, o, q - p, w, 0.0f, limit));
+                        keep(rayTriangle(a, delta, o + (q - p) + w, -(q - p), -w, 0.0f, limit));
+                    }
+                }
+                // the prism's edges
+                keep(rayCapsule(a, delta, p, q, r));
+                keep(rayCapsule(a, delta, p + w, q + w, r));
+                keep(rayCapsule(a, delta, p, p + w, r));
+            }
+        });
+        if (best > 0.0f || (best == 0.0f && bestTri >= 0)) {
+            glm::vec3 onSeg, onTri;
+            segmentTriangleDist2(a + delta * best, b + delta * best, tris[bestTri], onSeg, onTri);
+            glm::vec3 n = onSeg - onTri;
+            float len = glm::length(n);
+            normal = len > 1e-6f ? n / len : glm::normalize(glm::cross(tris[bestTri].e1, tris[bestTri].e2));
+        }
+        return best;
+    }
+
+private:
+    // Node for order[begin, end); children are built depth-first so the
+    // left child always follows its parent. A traversal holds at most one
+    // pending sibling per level, so depth + 1 bounds its stack.
+    void buildNode(std::vector<uint32_t>& order, size_t begin, size_t end, int depth, const std::vector<glm::vec3>& centroid,
+        const std::vector<glm::vec3>& triMin, const std::vector<glm::vec3>& triMax)
+    {
+        uint32_t ni = (uint32_t)nodes.size();
+        nodes.push_back(CollisionNode{});
+        glm::vec3 mn(1e30f), mx(-1e30f), cmn(1e30f), cmx(-1e30f);
+        for (size_t i = begin; i < end; ++i) {
+            mn = glm::min(mn, triMin[order[i]]);
+            mx = glm::max(mx, triMax[order[i]]);
+            cmn = glm::min(cmn, centroid[order[i]]);
+            cmx = glm::max(cmx, centroid[order[i]]);
+        }
+        glm::vec3 qlo = glm::floor((mn - origin) / step), qhi = glm::ceil((mx - origin) / step);
+        for (int k = 0; k < 3; ++k) {
+            nodes[ni].qmin[k] = (uint16_t)glm::clamp(qlo[k], 0.0f, 65535.0f);
+            nodes[ni].qmax[k] = (uint16_t)glm::clamp(qhi[k], 0.0f, 65535.0f);
+        }
+
+        size_t count = end - begin;
+        if (count <= (size_t)kCollisionLeafTris) {
+            nodes[ni].data = kCollisionLeafBit | (uint32_t)count << 24 | (uint32_t)begin;
+            return;
+        }
+
+        // binned SAH over the widest centroid axis; median if it's flat or
+        // the tree is already deep
+        glm::vec3 ext = cmx - cmn;
+        int axis = ext.x > ext.y ? (ext.x > ext.z ? 0 : 2) : (ext.y > ext.z ? 1 : 2);
+        size_t mid = begin + count / 2;
+        if (ext[axis] > 1e-6f && depth < kCollisionSahDepth) {
+            struct Bin { glm::vec3 mn{ 1e30f }, mx{ -1e30f }; size_t n = 0; };
+            Bin bins[kCollisionSahBins];
+            float scale = kCollisionSahBins / ext[axis];
+            auto binOf = [&](uint32_t t) {
+                return std::min(kCollisionSahBins - 1, (int)((centroid[t][axis] - cmn[axis]) * scale));
+            };
+            for (size_t i = begin; i < end; ++i) {
+                Bin& bin = bins[binOf(order[i])];
+                bin.mn = glm::min(bin.mn, triMin[order[i]]);
+                bin.mx = glm::max(bin.mx, triMax[order[i]]);
+                bin.n++;
+            }
+            auto area = [](const glm::vec3& a, const glm::vec3& b) {
+                glm::vec3 e = glm::max(b - a, glm::vec3(0.0f));
+                return e.x * e.y + e.y * e.z + e.z * e.x;
+            };
+            float rightArea[kCollisionSahBins];
+            size_t rightCount[kCollisionSahBins];
+            glm::vec3 rmn(1e30f), rmx(-1e30f);
+            size_t rn = 0;
+            for (int b = kCollisionSahBins - 1; b > 0; --b) {
+                rmn = glm::min(rmn, bins[b].mn);
+                rmx = glm::max(rmx, bins[b].mx);
+                rn += bins[b].n;
+                rightArea[b] = area(rmn, rmx);
+                rightCount[b] = rn;
+            }
+            glm::vec3 lmn(1e30f), lmx(-1e30f);
+            size_t ln = 0;
+            float bestCost = 1e30f;
+            int bestSplit = -1;
+            for (int b = 1; b < kCollisionSahBins; ++b) {
+                lmn = glm::min(lmn, bins[b - 1].mn);
+                lmx = glm::max(lmx, bins[b - 1].mx);
+                ln += bins[b - 1].n;
+                if (!ln || !rightCount[b]) continue;
+                float cost = area(lmn, lmx) * ln + rightArea[b] * rightCount[b];
+                if (cost < bestCost) { bestCost = cost; bestSplit = b; }
+            }
+            if (bestSplit > 0) {
+                auto it = std::partition(order.begin() + begin, order.begin() + end,
+                    [&](uint32_t t) { return binOf(t) < bestSplit; });
+                mid = (size_t)(it - order.begin());
+            }
+        }
+        if (mid == begin || mid == end) {
+            mid = begin + count / 2;
+            std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+                [&](uint32_t a, uint32_t b) { return centroid[a][axis] < centroid[b][axis]; });
+        }
+
+        buildNode(order, begin, mid, depth + 1, centroid, triMin, triMax);
+        nodes[ni].data = (uint32_t)nodes.size();
+        buildNode(order, mid, end, depth + 1, centroid, triMin, triMax);
+    }
+};
+
+// CPU side of a model load, safe on any thread. For a cooked .esm the view
+// points into the mapping; for Assimp it points into data / idx16.
+struct MeshPayload {
+    std::string path;
+    bool baked = false;
+    std::unique_ptr<MappedFile> file;
+    MeshData data;
+    std::vector<GLushort> idx16;
+    MeshView view;
+    std::vector<TexturePayload> materialTextures; // parallel to view.materialTextures
+    CollisionMesh collision;
+};
+
+static void readMaterialTextures(MeshPayload& p) {
+    p.materialTextures.clear();
+    p.materialTextures.resize(p.view.materialTextures.size());
+    for (size_t m = 0; m < p.view.materialTextures.size(); ++m) {
+        if (!p.view.materialTextures[m].empty())
+            readTexture(p.view.materialTextures[m], p.materialTextures[m]);
+    }
+}
+
+// With a source path, a bake older than that source is refused.
+bool readBakedMesh(const std::string& path, MeshPayload& p, bool quietIfMissing = false,
+    const std::string& source = std::string())
+{
+    std::unique_ptr<MappedFile> file(new MappedFile());
+    if (!file->open(path)) {
+        if (!quietIfMissing) std::cerr << "Baked mesh: cannot open " << path << "\n";
+        return false;
+    }
+    if (!viewBakedMesh(*file, path, p.view)) return false;
+    const BakedMeshHeader& h = *(const BakedMeshHeader*)file->data;
+    if (!source.empty() && !sourceUnchanged(source, h.sourceSize, h.sourceTime)) {
+        std::cerr << "Baked mesh: " << path << " is older than " << source << ", loading the source\n";
+        return false;
+    }
+    p.path = path;
+    p.baked = true;
+    p.file = std::move(file);
+    readMaterialTextures(p);
+    return true;
+}
+
+bool readAssimpMesh(const std::string& path, MeshPayload& p) {
+    if (!importMeshData(path, p.data)) return false;
+    const MeshData& data = p.data;
+
+    bool small = meshFits16Bit(data);
+    p.idx16.clear();
+    if (small) p.idx16.assign(data.indices.begin(), data.indices.end());
+
+    MeshView& view = p.view;
+    view.vertices = data.vertices.data();
+    view.vertexCount = data.vertices.size();
+    view.indices = small ? (const void*)p.idx16.data() : (const void*)data.indices.data();
+    view.indexCount = data.indices.size();
+    view.indexType = small ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    view.submeshes = data.submeshes.data();
+    view.submeshCount = data.submeshes.size();
+    view.lodStarts = data.lodStarts;
+    view.materialTextures.clear();
+    for (const MeshMaterial& m : data.materials) view.materialTextures.push_back(m.texturePath);
+    view.boundsMin = data.boundsMin;
+    view.boundsMax = data.boundsMax;
+
+    p.path = path;
+    p.baked = false;
+    readMaterialTextures(p);
+    return true;
+}
+
+// Prefers a cooked .esm next to the source file unless the source changed
+// since it was cooked; falls back to Assimp.
+bool readMesh(const std::string& path, MeshPayload& p) {
+    std::string baked = replaceExtension(path, ".esm");
+    if (baked != path && readBakedMesh(baked, p, true, path)) return true;
+    return readAssimpMesh(path, p);
+}
+
+// Per-instance data for drawInstanced(); attributes 2-5 (model) and 6 (tint).
+struct ModelInstance {
+    glm::mat4 model{ 1.0f };
+    glm::vec4 tint{ 1.0f };
+};
+
+struct AssimpModel {
+    GLuint vao = 0;
+    GLuint vbo = 0;
+    GLuint ibo = 0;
+    GLuint instanceVbo = 0;
+    GLsizei instanceCapacity = 0;
+    GLsizei instanceBase = 0;       // first instance the attributes point at
+    GLsizei vertexCount = 0;
+    GLsizei indexCount = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+    glm::vec3 boundsMin{ 0.0f }, boundsMax{ 0.0f };
+
+    // All submeshes sharing a material, drawn with one multi-draw call.
+    struct MaterialRun {
+        GLuint texture = 0;         // 0 = keep whatever the caller bound
+        std::vector<GLsizei> counts;
+        std::vector<void*> offsets;
+        std::vector<GLint> baseVertices;
+    };
+    struct Lod {
+        std::vector<MaterialRun> runs;
+        GLsizei triangles = 0;
+    };
+    std::vector<Lod> lods;          // lods[0] is full detail
+    std::vector<GLuint> textures;   // owned material textures
+
+    bool load(const std::string& path) {
+        MeshPayload p;
+        return readMesh(path, p) && upload(p);
+    }
+
+    bool loadBaked(const std::string& path) {
+        MeshPayload p;
+        return readBakedMesh(path, p) && upload(p);
+    }
+
+    // GL side of a load; must run on the context thread.
+    bool upload(const MeshPayload& p) {
+        std::vector<GLuint> materialTex(p.materialTextures.size(), 0);
+        for (size_t m = 0; m < p.materialTextures.size(); ++m) {
+            materialTex[m] = uploadTexture(p.materialTextures[m]);
+            if (materialTex[m]) textures.push_back(materialTex[m]);
+        }
+        if (!uploadView(p.view, materialTex)) return false;
+
+        std::ostringstream lodTris;
+        for (int l = 0; l < lodCount(); ++l) lodTris << (l ? "/" : "") << triangles(l);
+
+        if (p.baked) {
+            std::cout << "Baked mesh loaded: " << p.path
+                << " submeshes: " << p.view.submeshCount
+                << " vertices: " << vertexCount
+                << " indices: " << indexCount
+                << (indexType == GL_UNSIGNED_SHORT ? " (16-bit)" : " (32-bit)")
+                << " LOD tris: " << lodTris.str() << "\n";
+            return true;
+        }
+
+        const MeshData& data = p.data;
+        size_t lod0 = data.lodStarts.size() > 1 ? data.lodStarts[1] : data.submeshes.size();
+        std::vector<unsigned int> global;
+        global.reserve(data.indices.size());
+        for (size_t s = 0; s < lod0; ++s) {
+            const SubMesh& sub = data.submeshes[s];
+            for (unsigned int k = 0; k < sub.indexCount; ++k)
+                global.push_back(data.indices[sub.indexOffset + k] + sub.baseVertex);
+        }
+
+        float atvr = 0.0f;
+        float acmr = computeACMR(global, (unsigned int)vertexCount, &atvr);
+        std::cout << "Assimp loaded: " << p.path
+            << " submeshes: " << data.submeshes.size()
+            << " materials: " << data.materials.size()
+            << " vertices: " << vertexCount
+            << " indices: " << indexCount
+            << (indexType == GL_UNSIGNED_SHORT ? " (16-bit)" : " (32-bit)")
+            << " ACMR: " << acmr
+            << " ATVR: " << atvr
+            << " LOD tris: " << lodTris.str() << "\n";
+        return true;
+    }
+
+    bool uploadView(const MeshView& view, const std::vector<GLuint>& materialTex) {
+        if (!view.vertexCount || !view.indexCount) return false;
+        size_t indexSize = view.indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(unsigned int);
+        indexType = view.indexType;
+
+        glGenVertexArrays(1, &vao);
+        glGenBuffers(1, &vbo);
+        glGenBuffers(1, &ibo);
+
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER,
+            view.vertexCount * sizeof(SimpleVertex),
+            view.vertices,
+            GL_STATIC_DRAW);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+            view.indexCount * indexSize,
+            view.indices,
+            GL_STATIC_DRAW);
+
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE,
+            sizeof(SimpleVertex), (void*)0);
+
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE,
+            sizeof(SimpleVertex),
+            (void*)offsetof(SimpleVertex, uv));
+
+        // Instance stream; seeded with one identity instance so the
+        // non-instanced path never fetches from an empty buffer.
+        ModelInstance identity;
+        glGenBuffers(1, &instanceVbo);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(ModelInstance), &identity, GL_STREAM_DRAW);
+        instanceCapacity = 1;
+        for (int a = 2; a <= 6; ++a) {
+            glEnableVertexAttribArray(a);
+            glVertexAttribDivisor(a, 1);
+        }
+        instanceBase = -1;
+        setInstanceBase(0);
+
+        glBindVertexArray(0);
+
+        std::vector<uint32_t> starts = view.lodStarts;
+        if (starts.size() < 2) starts = { 0u, (uint32_t)view.submeshCount };
+        lods.assign(starts.size() - 1, Lod{});
+        for (size_t l = 0; l + 1 < starts.size(); ++l) {
+            std::vector<MaterialRun>& runs = lods[l].runs;
+            for (size_t i = starts[l]; i < starts[l + 1]; ++i) {
+                const SubMesh& sub = view.submeshes[i];
+                if (i == starts[l] || sub.material != view.submeshes[i - 1].material) {
+                    runs.push_back(MaterialRun{});
+                    runs.back().texture = sub.material < materialTex.size() ? materialTex[sub.material] : 0;
+                }
+                MaterialRun& run = runs.back();
+                run.counts.push_back((GLsizei)sub.indexCount);
+                run.offsets.push_back((void*)(sub.indexOffset * indexSize));
+                run.baseVertices.push_back((GLint)sub.baseVertex);
+                lods[l].triangles += (GLsizei)(sub.indexCount / 3);
+            }
+        }
+
+        vertexCount = (GLsizei)view.vertexCount;
+        indexCount = (GLsizei)view.indexCount;
+        boundsMin = view.boundsMin;
+        boundsMax = view.boundsMax;
+        return true;
+    }
+
+    // Issues one material run; the VAO and texture must already be bound.
+    // GLEW's multi-draw prototypes take non-const arrays, hence non-const.
+    void drawRun(MaterialRun& run, GLsizei instances = 0) {
+        if (instances > 0) {
+            for (size_t i = 0; i < run.counts.size(); ++i)
+                glDrawElementsInstancedBaseVertex(GL_TRIANGLES, run.counts[i], indexType,
+                    run.offsets[i], instances, run.baseVertices[i]);
+        }
+        else {
+            glMultiDrawElementsBaseVertex(GL_TRIANGLES,
+                run.counts.data(), indexType,
+                run.offsets.data(),
+                (GLsizei)run.counts.size(),
+                run.baseVertices.data());
+        }
+    }
+
+    void draw(int lod = 0) {
+        if (!vao || !indexCount) return;
+        glBindVertexArray(vao);
+        for (MaterialRun& run : lods[clampLod(lod)].runs) {
+            if (run.texture) glBindTexture(GL_TEXTURE_2D, run.texture);
+            drawRun(run);
+        }
+        glBindVertexArray(0);
+    }
+
+    // Replaces the instance stream; later draws read from setInstanceBase().
+    void uploadInstances(const ModelInstance* instances, GLsizei count) {
+        if (!instanceVbo || count <= 0) return;
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+        while (instanceCapacity < count) instanceCapacity *= 2;
+        // orphan, then fill: the driver never waits on last frame's copy
+        glBufferData(GL_ARRAY_BUFFER, instanceCapacity * sizeof(ModelInstance), nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(ModelInstance), instances);
+    }
+
+    // GL 3.3 has no base-instance draws, so a sub-range of the stream is
+    // selected by re-pointing attributes 2-6. The VAO must be bound.
+    void setInstanceBase(GLsizei first) {
+        if (first == instanceBase) return;
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+        size_t base = (size_t)first * sizeof(ModelInstance);
+        for (int c = 0; c < 4; ++c)
+            glVertexAttribPointer(2 + c, 4, GL_FLOAT, GL_FALSE, sizeof(ModelInstance),
+                (void*)(base + offsetof(ModelInstance, model) + c * sizeof(glm::vec4)));
+        glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(ModelInstance),
+            (void*)(base + offsetof(ModelInstance, tint)));
+        instanceBase = first;
+    }
+
+    // Draws count copies in one instanced call per submesh. Needs a program
+    // that reads the per-instance attributes (kObjInstVS).
+    void drawInstanced(const ModelInstance* instances, GLsizei count, int lod = 0) {
+        if (!vao || !indexCount || count <= 0) return;
+        uploadInstances(instances, count);
+        glBindVertexArray(vao);
+        setInstanceBase(0);
+        for (MaterialRun& run : lods[clampLod(lod)].runs) {
+            if (run.texture) glBindTexture(GL_TEXTURE_2D, run.texture);
+            drawRun(run, count);
+        }
+        glBindVertexArray(0);
+    }
+
+    int lodCount() const { return (int)lods.size(); }
+    int clampLod(int lod) const { return std::max(0, std::min(lod, (int)lods.size() - 1)); }
+    GLsizei triangles(int lod) const { return lods.empty() ? 0 : lods[clampLod(lod)].triangles; }
+
+    // Bounding sphere of the model in object space.
+    glm::vec3 boundsCenter() const { return (boundsMin + boundsMax) * 0.5f; }
+    float boundsRadius() const { return glm::length(boundsMax - boundsMin) * 0.5f; }
+
+    void release() {
+        glDeleteVertexArrays(1, &vao);
+        glDeleteBuffers(1, &vbo);
+        glDeleteBuffers(1, &ibo);
+        glDeleteBuffers(1, &instanceVbo);
+        if (!textures.empty()) glDeleteTextures((GLsizei)textures.size(), textures.data());
+        *this = AssimpModel{};
+    }
+};
+
+// ================= ASYNC ASSET LOADING =================
+//
+// Worker threads do file I/O, PNG decode and mesh parsing into CPU-side
+// payloads. Finished payloads queue up for the render thread, which drains
+// them under a per-frame time budget. Until then handles resolve to a
+// placeholder texture / no model, so the game renders from the first frame.
+
+// Runs fn(0..count-1) on the pool plus the calling thread and returns when
+// all calls are done. For short per-frame jobs; use a pool that isn't also
+// running long asset loads, or the frame waits on them.
+void parallelFor(WorkerPool& pool, int count, const std::function<void(int)>& fn) {
+    std::atomic<int> next(0);
+    auto work = [&]() {
+        for (int i = next++; i < count; i = next++) fn(i);
+    };
+    int helpers = std::min(count - 1, (int)pool.workers.size());
+    if (helpers <= 0) { work(); return; }
+
+    std::mutex doneMutex;
+    std::condition_variable doneCv;
+    int running = helpers;
+    for (int h = 0; h < helpers; ++h) {
+        pool.submit([&]() {
+            work();
+            std::lock_guard<std::mutex> lock(doneMutex);
+            if (--running == 0) doneCv.notify_one();
+        });
+    }
+    work();
+    std::unique_lock<std::mutex> lock(doneMutex);
+    doneCv.wait(lock, [&running]() { return running == 0; });
+}
+WorkerPool gWorkers;
+
+enum class AssetState { Pending, Ready, Failed };
+
+struct TextureHandle { int id = -1; };
+struct ModelHandle { int id = -1; };
+
+struct AssetLoader {
+    struct TextureSlot {
+        std::string path;
+        AssetState state = AssetState::Pending;
+        GLuint tex = 0;
+    };
+    struct ModelSlot {
+        std::string path;
+        AssetState state = AssetState::Pending;
+        AssimpModel model;
+        CollisionMesh collision;
+    };
+
+    WorkerPool* pool = nullptr;
+    std::deque<TextureSlot> textures;   // deque: slots never move
+    std::deque<ModelSlot> models;
+    GLuint placeholderTex = 0;
+
+    std::mutex readyMutex;
+    std::deque<std::function<void()>> readyUploads; // run on the render thread
+    int inFlight = 0;                               // render thread only
+    int streaming = 0;                              // handed to gStreamer, not done
+
+    void init(WorkerPool& workers) {
+        pool = &workers;
+
+        // grey/white checker until the real texture lands
+        const unsigned char px[16] = {
+            200, 200, 200, 255,  120, 120, 120, 255,
+            120, 120, 120, 255,  200, 200, 200, 255 };
+        glGenTextures(1, &placeholderTex);
+        glBindTexture(GL_TEXTURE_2D, placeholderTex);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 2, 2, 0, GL_RGBA, GL_UNSIGNED_BYTE, px);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+
+    void finished(std::function<void()> upload) {
+        std::lock_guard<std::mutex> lock(readyMutex);
+        readyUploads.push_back(std::move(upload));
+    }
+
+    TextureHandle requestTexture(const std::string& path) {
+        TextureHandle h{ (int)textures.size() };
+        textures.push_back(TextureSlot{ path });
+        ++inFlight;
+
+        pool->submit([this, h, path]() {
+            std::shared_ptr<TexturePayload> payload(new TexturePayload());
+            bool ok = readTexture(path, *payload);
+            finished([this, h, payload, ok]() {
+                if (ok && payload->totalBytes() >= kStreamThresholdBytes) {
+                    ++streaming;
+                    gStreamer.enqueue(payload, [this, h](GLuint tex) {
+                        TextureSlot& slot = textures[h.id];
+                        slot.tex = tex;
+                        slot.state = tex ? AssetState::Ready : AssetState::Failed;
+                        --streaming;
+                    });
+                    return;
+                }
+                TextureSlot& slot = textures[h.id];
+                slot.tex = ok ? uploadTexture(*payload) : 0;
+                slot.state = slot.tex ? AssetState::Ready : AssetState::Failed;
+            });
+        });
+        return h;
+    }
+
+    ModelHandle requestModel(const std::string& path) {
+        ModelHandle h{ (int)models.size() };
+        models.emplace_back();
+        models.back().path = path;
+        ++inFlight;
+
+        pool->submit([this, h, path]() {
+            std::shared_ptr<MeshPayload> payload(new MeshPayload());
+            bool ok = readMesh(path, *payload);
+            if (ok) payload->collision.buildFromView(payload->view);
+            finished([this, h, payload, ok]() {
+                ModelSlot& slot = models[h.id];
+                bool uploaded = ok && slot.model.upload(*payload);
+                if (uploaded) slot.collision = std::move(payload->collision);
+                slot.state = uploaded ? AssetState::Ready : AssetState::Failed;
+            });
+        });
+        return h;
+    }
+
+    // Runs queued GL uploads until budgetMs is spent (always at least one).
+    void pumpUploads(double budgetMs) {
+        double start = nowMs();
+        for (;;) {
+            std::function<void()> upload;
+            {
+                std::lock_guard<std::mutex> lock(readyMutex);
+                if (readyUploads.empty()) return;
+                upload = std::move(readyUploads.front());
+                readyUploads.pop_front();
+            }
+            upload();
+            --inFlight;
+            if (nowMs() - start >= budgetMs) return;
+        }
+    }
+
+    int pending() const { return inFlight + streaming; }
+
+    GLuint texture(TextureHandle h) const {
+        if (h.id < 0 || h.id >= (int)textures.size()) return placeholderTex;
+        const TextureSlot& slot = textures[h.id];
+        return slot.state == AssetState::Ready ? slot.tex : placeholderTex;
+    }
+
+    AssimpModel* model(ModelHandle h) {
+        if (h.id < 0 || h.id >= (int)models.size()) return nullptr;
+        ModelSlot& slot = models[h.id];
+        return slot.state == AssetState::Ready ? &slot.model : nullptr;
+    }
+
+    // The model's triangle collider, once it is loaded.
+    const CollisionMesh* collisionMesh(ModelHandle h) const {
+        if (h.id < 0 || h.id >= (int)models.size()) return nullptr;
+        const ModelSlot& slot = models[h.id];
+        return slot.state == AssetState::Ready && !slot.collision.empty() ? &slot.collision : nullptr;
+    }
+
+    // Call after the worker pool has stopped.
+    void shutdown() {
+        {
+            std::lock_guard<std::mutex> lock(readyMutex);
+            readyUploads.clear();
+        }
+        for (TextureSlot& t : textures) if (t.tex) glDeleteTextures(1, &t.tex);
+        for (ModelSlot& m : models) m.model.release();
+        textures.clear();
+        models.clear();
+        glDeleteTextures(1, &placeholderTex);
+        placeholderTex = 0;
+        inFlight = 0;
+        streaming = 0;
+    }
+};
+AssetLoader gAssets;
+
+const double kUploadBudgetMs = 2.0;
+
+ModelHandle   gNPCModel;
+TextureHandle gNPCTexture;
+
+const char* kObjVS = "#version 330 core\n" FRAME_BLOCK_GLSL R"(
+layout (location=0) in vec3 aPos;
+layout (location=1) in vec2 aUV;
+uniform mat4 uModel;
+out vec2 vUV;
+void main(){
+    vUV = aUV;
+    gl_Position = uViewProj * uModel * vec4(aPos, 1.0);
+}
+)";
+
+const char* kObjFS = R"(#version 330 core
+in vec2 vUV;
+uniform sampler2D uTex;
+out vec4 FragColor;
+void main(){
+    FragColor = texture(uTex, vUV);
+}
+)";
+
+GLuint gObjProg = 0;
+GLint  gObjModel = -1;
+GLint  gObjTex = -1;
+
+// ================= LEVEL (walled city block) =================
+
+struct LevelBox {
+    AABB box;
+    bool occluder = true;           // drawn into the occlusion buffer
+};
+std::vector<LevelBox> gLevel;
+
+// Perimeter wall with a gate out to the terrain in the south side, the
+// warehouse by the north wall and a few buildings.
+void buildLevel(std::vector<LevelBox>& level) {
+    const float wall = 45.0f, height = 6.0f, thick = 0.5f, gate = 4.0f;
+    level.clear();
+    level.push_back(LevelBox{ AABB{ { -wall, 0.0f, -wall - thick }, { wall, height, -wall + thick } } });
+    level.push_back(LevelBox{ AABB{ { -wall, 0.0f, wall - thick }, { -gate, height, wall + thick } } });
+    level.push_back(LevelBox{ AABB{ { gate, 0.0f, wall - thick }, { wall, height, wall + thick } } });
+    level.push_back(LevelBox{ AABB{ { -wall - thick, 0.0f, -wall }, { -wall + thick, height, wall } } });
+    level.push_back(LevelBox{ AABB{ { wall - thick, 0.0f, -wall }, { wall + thick, height, wall } } });
+    level.push_back(LevelBox{ boxFromTS({ -24.0f, 4.0f, -33.0f }, { 9.0f, 4.0f, 6.0f }) });   // warehouse
+    level.push_back(LevelBox{ boxFromTS({ 22.0f, 6.0f, 16.0f }, { 6.0f, 6.0f, 5.0f }) });
+    level.push_back(LevelBox{ boxFromTS({ -20.0f, 4.5f, 20.0f }, { 4.0f, 4.5f, 7.0f }) });
+    level.push_back(LevelBox{ boxFromTS({ 18.0f, 3.0f, -14.0f }, { 3.0f, 3.0f, 8.0f }) });
+}
+
+// ================= OCCLUSION CULLING (CPU depth buffer) =================
+//
+// Occluder boxes are rasterized each frame into a small 1/w buffer
+// (0 = empty, larger = nearer). 1/w is linear in screen space, so it is
+// interpolated with a plane equation, 4 pixels per SSE step. The buffer is
+// split into tiles rasterized in parallel; triangles are binned per tile
+// first. An occludee box is hidden when every pixel under its screen rect
+// holds an occluder nearer than the box's nearest corner.
+
+const int   kOccWidth = 256;
+const int   kOccHeight = 128;
+const int   kOccTileW = 64;         // multiple of 4 for the SSE spans
+const int   kOccTileH = 32;
+const int   kOccTilesX = kOccWidth / kOccTileW;
+const int   kOccTilesY = kOccHeight / kOccTileH;
+const float kOccNearW = 0.1f;       // clip occluders at this view depth
+
+struct OccTriangle {
+    float x[3], y[3], r[3];         // pixels (y down) and 1/w
+};
+
+struct OcclusionBuffer {
+    std::vector<float> depth = std::vector<float>(kOccWidth * kOccHeight, 0.0f);
+    std::vector<OccTriangle> tris;
+    std::vector<uint32_t> bins[kOccTilesX * kOccTilesY];
+    glm::mat4 viewProj{ 1.0f };
+
+    void begin(const glm::mat4& vp) {
+        viewProj = vp;
+        tris.clear();
+        for (auto& b : bins) b.clear();
+    }
+
+    void addBox(const AABB& b) {
+        glm::vec4 c[8];
+        for (int i = 0; i < 8; ++i) c[i] = viewProj * glm::vec4(boxCorner(b.min, b.max, i), 1.0f);
+        for (const auto& f : kBoxFaces) {
+            addTriangle(c[f[0]], c[f[1]], c[f[2]]);
+            addTriangle(c[f[0]], c[f[2]], c[f[3]]);
+        }
+    }
+
+    // Clips against w = kOccNearW, projects and bins the result.
+    void addTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c) {
+        const glm::vec4 in[3] = { a, b, c };
+        glm::vec4 poly[4];
+        int n = 0;
+        for (int i = 0; i < 3; ++i) {
+            const glm::vec4& p = in[i];
+            const glm::vec4& q = in[(i + 1) % 3];
+            bool pIn = p.w >= kOccNearW, qIn = q.w >= kOccNearW;
+            if (pIn) poly[n++] = p;
+            if (pIn != qIn) poly[n++] = glm::mix(p, q, (kOccNearW - p.w) / (q.w - p.w));
+        }
+        for (int i = 2; i < n; ++i) emit(poly[0], poly[i - 1], poly[i]);
+    }
+
+    void emit(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c) {
+        OccTriangle t;
+        const glm::vec4* v[3] = { &a, &b, &c };
+        float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f;
+        for (int k = 0; k < 3; ++k) {
+            float iw = 1.0f / v[k]->w;
+            t.x[k] = (v[k]->x * iw * 0.5f + 0.5f) * kOccWidth;
+            t.y[k] = (0.5f - v[k]->y * iw * 0.5f) * kOccHeight;
+            t.r[k] = iw;
+            minX = std::min(minX, t.x[k]); maxX = std::max(maxX, t.x[k]);
+            minY = std::min(minY, t.y[k]); maxY = std::max(maxY, t.y[k]);
+        }
+        float area = (t.x[1] - t.x[0]) * (t.y[2] - t.y[0]) - (t.x[2] - t.x[0]) * (t.y[1] - t.y[0]);
+        if (fabsf(area) < 1e-6f) return;
+        if (maxX < 0.0f || maxY < 0.0f || minX >= kOccWidth || minY >= kOccHeight) return;
+
+        int tx0 = std::max(0, (int)minX / kOccTileW), tx1 = std::min(kOccTilesX - 1, (int)maxX / kOccTileW);
+        int ty0 = std::max(0, (int)minY / kOccTileH), ty1 = std::min(kOccTilesY - 1, (int)maxY / kOccTileH);
+        uint32_t index = (uint32_t)tris.size();
+        tris.push_back(t);
+        for (int ty = ty0; ty <= ty1; ++ty)
+            for (int tx = tx0; tx <= tx1; ++tx) bins[ty * kOccTilesX + tx].push_back(index);
+    }
+
+    void rasterizeTile(int tile) {
+        int tx0 = (tile % kOccTilesX) * kOccTileW, ty0 = (tile / kOccTilesX) * kOccTileH;
+        for (int y = ty0; y < ty0 + kOccTileH; ++y)
+            std::fill_n(&depth[y * kOccWidth + tx0], kOccTileW, 0.0f);
+
+        for (uint32_t index : bins[tile]) {
+            const OccTriangle& t = tris[index];
+            float area = (t.x[1] - t.x[0]) * (t.y[2] - t.y[0]) - (t.x[2] - t.x[0]) * (t.y[1] - t.y[0]);
+            float sign = area > 0.0f ? 1.0f : -1.0f;
+
+            // edge k is opposite vertex k: e(x, y) = A x + B y + C, >= 0 inside
+            float A[3], B[3], C[3];
+            for (int k = 0; k < 3; ++k) {
+                int i = (k + 1) % 3, j = (k + 2) % 3;
+                A[k] = (t.y[i] - t.y[j]) * sign;
+                B[k] = (t.x[j] - t.x[i]) * sign;
+                C[k] = (t.x[i] * t.y[j] - t.x[j] * t.y[i]) * sign;
+            }
+            // 1/w plane through the three vertices
+            float inv = 1.0f / (area * sign);
+            float rA = (A[0] * t.r[0] + A[1] * t.r[1] + A[2] * t.r[2]) * inv;
+            float rB = (B[0] * t.r[0] + B[1] * t.r[1] + B[2] * t.r[2]) * inv;
+            float rC = (C[0] * t.r[0] + C[1] * t.r[1] + C[2] * t.r[2]) * inv;
+
+            float minX = std::min(std::min(t.x[0], t.x[1]), t.x[2]);
+            float maxX = std::max(std::max(t.x[0], t.x[1]), t.x[2]);
+            float minY = std::min(std::min(t.y[0], t.y[1]), t.y[2]);
+            float maxY = std::max(std::max(t.y[0], t.y[1]), t.y[2]);
+            int x0 = std::max(tx0, (int)floorf(minX) & ~3), x1 = std::min(tx0 + kOccTileW, (int)ceilf(maxX));
+            int y0 = std::max(ty0, (int)floorf(minY)), y1 = std::min(ty0 + kOccTileH, (int)ceilf(maxY));
+            if (x0 >= x1 || y0 >= y1) continue;
+
+            const __m128 laneX = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+            __m128 a0 = _mm_set1_ps(A[0]), a1 = _mm_set1_ps(A[1]), a2 = _mm_set1_ps(A[2]), ar = _mm_set1_ps(rA);
+            __m128 step0 = _mm_set1_ps(A[0] * 4), step1 = _mm_set1_ps(A[1] * 4), step2 = _mm_set1_ps(A[2] * 4);
+            __m128 stepR = _mm_set1_ps(rA * 4);
+            __m128 zero = _mm_setzero_ps();
+            for (int y = y0; y < y1; ++y) {
+                float py = y + 0.5f;
+                __m128 px = _mm_add_ps(_mm_set1_ps((float)x0), laneX);
+                __m128 e0 = _mm_add_ps(_mm_mul_ps(a0, px), _mm_set1_ps(B[0] * py + C[0]));
+                __m128 e1 = _mm_add_ps(_mm_mul_ps(a1, px), _mm_set1_ps(B[1] * py + C[1]));
+                __m128 e2 = _mm_add_ps(_mm_mul_ps(a2, px), _mm_set1_ps(B[2] * py + C[2]));
+                __m128 r = _mm_add_ps(_mm_mul_ps(ar, px), _mm_set1_ps(rB * py + rC));
+                float* row = &depth[y * kOccWidth];
+                for (int x = x0; x < x1; x += 4) {
+                    __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)),
+                        _mm_cmpge_ps(e2, zero));
+                    if (_mm_movemask_ps(inside)) {
+                        __m128 old = _mm_loadu_ps(row + x);
+                        __m128 nearer = _mm_max_ps(old, r);
+                        _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+                    }
+                    e0 = _mm_add_ps(e0, step0);
+                    e1 = _mm_add_ps(e1, step1);
+                    e2 = _mm_add_ps(e2, step2);
+                    r = _mm_add_ps(r, stepR);
+                }
+            }
+        }
+    }
+
+    void rasterize(WorkerPool* pool) {
+        const int tiles = kOccTilesX * kOccTilesY;
+        if (pool) parallelFor(*pool, tiles, [this](int t) { rasterizeTile(t); });
+        else for (int t = 0; t < tiles; ++t) rasterizeTile(t);
+    }
+
+    // False only if the box is certainly hidden behind rasterized occluders.
+    bool boxVisible(const glm::vec3& mn, const glm::vec3& mx) const {
+        float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f, nearest = 0.0f;
+        for (int i = 0; i < 8; ++i) {
+            glm::vec4 c = viewProj * glm::vec4(boxCorner(mn, mx, i), 1.0f);
+            if (c.w < kOccNearW) return true;       // touches the camera
+            float iw = 1.0f / c.w;
+            float x = (c.x * iw * 0.5f + 0.5f) * kOccWidth;
+            float y = (0.5f - c.y * iw * 0.5f) * kOccHeight;
+            minX = std::min(minX, x); maxX = std::max(maxX, x);
+            minY = std::min(minY, y); maxY = std::max(maxY, y);
+            nearest = std::max(nearest, iw);
+        }
+        int x0 = std::max(0, (int)floorf(minX)), x1 = std::min(kOccWidth, (int)ceilf(maxX));
+        int y0 = std::max(0, (int)floorf(minY)), y1 = std::min(kOccHeight, (int)ceilf(maxY));
+        if (x0 >= x1 || y0 >= y1) return false;     // entirely off screen
+
+        __m128 boxR = _mm_set1_ps(nearest);
+        for (int y = y0; y < y1; ++y) {
+            const float* row = &depth[y * kOccWidth];
+            int x = x0;
+            for (; x + 4 <= x1; x += 4)
+                if (_mm_movemask_ps(_mm_cmple_ps(_mm_loadu_ps(row + x), boxR))) return true;
+            for (; x < x1; ++x)
+                if (row[x] <= nearest) return true;
+        }
+        return false;
+    }
+};
+
+OcclusionBuffer gOcclusion;
+WorkerPool gOcclusionPool;          // per-frame jobs only, never asset loads
+bool gOcclusionEnabled = true;
+bool gShowOcclusionBuffer = false;
+
+// Rasterizes every occluder of the level for this frame.
+void renderOccluders(OcclusionBuffer& occ, const std::vector<LevelBox>& level,
+    const glm::mat4& viewProj, WorkerPool* pool)
+{
+    occ.begin(viewProj);
+    for (const LevelBox& b : level)
+        if (b.occluder) occ.addBox(b.box);
+    occ.rasterize(pool);
+}
+
+// Drops sphere indices whose bounding box is hidden; returns how many.
+size_t occludeSpheres(const OcclusionBuffer& occ, const SphereSoA& s, std::vector<uint32_t>& indices) {
+    size_t kept = 0;
+    for (uint32_t i : indices) {
+        glm::vec3 c(s.x[i], s.y[i], s.z[i]);
+        glm::vec3 r(s.r[i]);
+        if (occ.boxVisible(c - r, c + r)) indices[kept++] = i;
+    }
+    size_t hidden = indices.size() - kept;
+    indices.resize(kept);
+    return hidden;
+}
+
+// Shows the occlusion buffer as a grey-scale inset: brighter = nearer.
+const char* kOccDebugVS = R"(#version 330 core
+uniform vec4 uRect;     // NDC x, y, w, h
+out vec2 vUV;
+void main(){
+    vec2 c = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+    vUV = vec2(c.x, 1.0 - c.y);
+    gl_Position = vec4(uRect.xy + c * uRect.zw, 0.0, 1.0);
+}
+)";
+
+const char* kOccDebugFS = R"(#version 330 core
+in vec2 vUV;
+uniform sampler2D uDepth;
+uniform float uFar;
+out vec4 FragColor;
+void main(){
+    float r = texture(uDepth, vUV).r;
+    float g = r > 0.0 ? 1.0 - clamp(1.0 / (r * uFar), 0.0, 1.0) : 0.0;
+    FragColor = vec4(g, g, g * 0.8 + 0.2 * float(r == 0.0), 1.0);
+}
+)";
+
+struct OcclusionDebugView {
+    GLuint tex = 0, prog = 0, vao = 0;
+    GLint rectLoc = -1, farLoc = -1;
+
+    void init() {
+        glGenTextures(1, &tex);
+        glBindTexture(GL_TEXTURE_2D, tex);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, kOccWidth, kOccHeight, 0, GL_RED, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        prog = linkProgram(kOccDebugVS, kOccDebugFS);
+        rectLoc = glGetUniformLocation(prog, "uRect");
+        farLoc = glGetUniformLocation(prog, "uFar");
+        glGenVertexArrays(1, &vao);     // attribute-less quad
+    }
+
+    // Draws the buffer in the bottom-left corner at 2x.
+    void draw(const OcclusionBuffer& occ, int fbw, int fbh, float farPlane) {
+        glBindTexture(GL_TEXTURE_2D, tex);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, kOccWidth, kOccHeight, GL_RED, GL_FLOAT, occ.depth.data());
+
+        float w = 2.0f * kOccWidth * 2.0f / fbw, h = 2.0f * kOccHeight * 2.0f / fbh;
+        glDisable(GL_DEPTH_TEST);
+        glUseProgram(prog);
+        glUniform4f(rectLoc, -1.0f + 20.0f * 2.0f / fbw, -1.0f + 20.0f * 2.0f / fbh, w, h);
+        glUniform1f(farLoc, farPlane);
+        glBindVertexArray(vao);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        glBindVertexArray(0);
+        glEnable(GL_DEPTH_TEST);
+    }
+
+    void release() {
+        glDeleteTextures(1, &tex);
+        glDeleteProgram(prog);
+        glDeleteVertexArrays(1, &vao);
+        *this = OcclusionDebugView{};
+    }
+};
+OcclusionDebugView gOcclusionView;
+
+// ---------- Instanced crowd ----------
+const char* kObjInstVS = "#version 330 core\n" FRAME_BLOCK_GLSL R"(
+layout (location=0) in vec3 aPos;
+layout (location=1) in vec2 aUV;
+layout (location=2) in mat4 aModel;
+layout (location=6) in vec4 aTint;
+out vec2 vUV;
+out vec4 vTint;
+void main(){
+    vUV = aUV;
+    vTint = aTint;
+    gl_Position = uViewProj * aModel * vec4(aPos, 1.0);
+}
+)";
+
+const char* kObjInstFS = R"(#version 330 core
+in vec2 vUV;
+in vec4 vTint;
+uniform sampler2D uTex;
+out vec4 FragColor;
+void main(){
+    FragColor = texture(uTex, vUV) * vTint;
+}
+)";
+
+GLuint gObjInstProg = 0;
+GLint  gObjInstTex = -1;
+
+const int kCrowdSize = 300;
+std::vector<ModelInstance> gCrowd;      // every civilian / patrol member
+std::vector<ModelInstance> gCrowdDraw[kMaxMeshLods];  // visible, bucketed by LOD each frame
+std::vector<uint8_t> gCrowdLod;         // current LOD per instance (hysteresis state)
+std::vector<ModelInstance> gCrowdStream;  // buckets concatenated for one upload
+
+// Projected diameter (fraction of screen height) below which LOD l + 1
+// takes over from LOD l. A switch needs the size to cross the threshold
+// by kLodHysteresis so instances near a boundary don't flicker.
+const float kLodScreenSize[kMaxMeshLods - 1] = { 0.25f, 0.10f, 0.04f };
+const float kLodHysteresis = 0.15f;
+
+inline float projectedSize(const glm::vec3& center, float radius, const glm::vec3& eye, float tanHalfFov) {
+    float d = std::max(glm::length(center - eye), 1e-3f);
+    return radius / (d * tanHalfFov);
+}
+
+int selectLod(float size, int current, int lodCount) {
+    int lod = std::min(current, lodCount - 1);
+    while (lod + 1 < lodCount && size < kLodScreenSize[lod] * (1.0f - kLodHysteresis)) ++lod;
+    while (lod > 0 && size > kLodScreenSize[lod - 1] * (1.0f + kLodHysteresis)) --lod;
+    return lod;
+}
+
+const float kCrowdClearance = 0.6f;     // kept between a spawned NPC and any level box
+
+// Scatters count NPCs over a ring between innerR and outerR around the
+// origin, with random facing and a muted clothing tint. With a level, spots
+// inside or against its boxes are drawn again.
+void spawnCrowd(std::vector<ModelInstance>& out, int count, float innerR, float outerR, uint32_t seed,
+    const std::vector<LevelBox>* level = nullptr)
+{
+    uint32_t state = seed;
+    auto rnd = [&state]() {
+        state = state * 1664525u + 1013904223u;
+        return (state >> 8) * (1.0f / 16777216.0f);
+    };
+    auto blocked = [level](const glm::vec3& p) {
+        if (!level) return false;
+        for (const LevelBox& b : *level) {
+            if (p.x > b.box.min.x - kCrowdClearance && p.x < b.box.max.x + kCrowdClearance &&
+                p.z > b.box.min.z - kCrowdClearance && p.z < b.box.max.z + kCrowdClearance) return true;
+        }
+        return false;
+    };
+    out.resize(count);
+    for (ModelInstance& inst : out) {
+        glm::vec3 pos;
+        do {
+            float a = rnd() * 6.2831853f;
+            float r = sqrtf(innerR * innerR + rnd() * (outerR * outerR - innerR * innerR));
+            pos = glm::vec3(cosf(a) * r, 0.0f, sinf(a) * r);
+        } while (blocked(pos));
+        inst.model = glm::rotate(glm::translate(glm::mat4(1.0f), pos),
+            rnd() * 6.2831853f, glm::vec3(0, 1, 0));
+        inst.tint = glm::vec4(0.6f + 0.4f * rnd(), 0.6f + 0.4f * rnd(), 0.6f + 0.4f * rnd(), 1.0f);
+    }
+}
+
+SphereSoA gCrowdBounds;              // world-space spheres, parallel to gCrowd
+std::vector<uint32_t> gVisibleIdx;
+
+// World-space bounding spheres of every instance, in cull order.
+void buildInstanceBounds(const std::vector<ModelInstance>& all, const AssimpModel& model, SphereSoA& out) {
+    glm::vec3 c = model.boundsCenter();
+    float r = model.boundsRadius();
+    out.resize(all.size());
+    for (size_t i = 0; i < all.size(); ++i)
+        out.set(i, glm::vec3(all[i].model * glm::vec4(c, 1.0f)), r);
+}
+
+// Copies the surviving instances (indices from the cull passes) into
+// buckets[lod], updating each one's LOD from its projected size.
+void bucketInstancesByLod(const std::vector<ModelInstance>& all, const SphereSoA& bounds,
+    const std::vector<uint32_t>& visible, const glm::vec3& eye, float tanHalfFov, int lodCount,
+    std::vector<uint8_t>& lodState, std::vector<ModelInstance>* buckets)
+{
+    lodState.resize(all.size(), 0);
+    for (int l = 0; l < kMaxMeshLods; ++l) buckets[l].clear();
+    for (uint32_t i : visible) {
+        float size = projectedSize(glm::vec3(bounds.x[i], bounds.y[i], bounds.z[i]), bounds.r[i], eye, tanHalfFov);
+        int lod = selectLod(size, lodState[i], lodCount);
+        lodState[i] = (uint8_t)lod;
+        buckets[lod].push_back(all[i]);
+    }
+}
+
+// ================= RENDER QUEUE (64-bit sort keys) =================
+//
+// Draws are collected during the frame, radix-sorted on a packed key and
+// submitted in order, so binds are only issued when program, texture or
+// VAO actually change. Key layout, most significant first:
+//   pass:4 | program:10 | texture:14 | vao:12 | depth:24
+// GL names are masked into their fields; a collision only costs ordering,
+// since submission compares the real names.
+
+enum RenderPass : uint32_t { kPassOpaque = 0, kPassTransparent = 1 };
+
+struct DrawItem {
+    uint64_t key = 0;
+    GLuint program = 0;
+    GLuint texture = 0;             // 0 = leave unit 0 as is
+    GLuint vao = 0;
+    GLint  matrixLoc = -1;          // per-draw uModel location, -1 = none
+    glm::mat4 matrix{ 1.0f };
+
+    // exactly one source: a plain array range, a 16-bit indexed range on
+    // the VAO's element buffer, or one model material run
+    GLsizei arrayCount = 0;
+    GLsizei indexCount = 0;
+    const void* indexOffset = nullptr;
+    AssimpModel* model = nullptr;
+    AssimpModel::MaterialRun* run = nullptr;
+    GLsizei instanceFirst = 0;
+    GLsizei instanceCount = 0;      // 0 = not instanced
+};
+
+inline uint64_t makeDrawKey(uint32_t pass, GLuint program, GLuint texture, GLuint vao, float depth01) {
+    uint32_t depth = (uint32_t)(glm::clamp(depth01, 0.0f, 1.0f) * 16777215.0f);
+    if (pass == kPassTransparent) depth = 16777215u - depth;    // back to front
+    return ((uint64_t)(pass & 0xF) << 60) |
+        ((uint64_t)(program & 0x3FF) << 50) |
+        ((uint64_t)(texture & 0x3FFF) << 36) |
+        ((uint64_t)(vao & 0xFFF) << 24) |
+        (uint64_t)depth;
+}
+
+struct RenderQueue {
+    std::vector<DrawItem> items;
+    std::vector<uint64_t> keys, keysTmp;
+    std::vector<uint32_t> order, orderTmp;
+
+    void clear() { items.clear(); }
+    void push(const DrawItem& item) { items.push_back(item); }
+
+    // LSD radix sort of (key, item index), 8 bits per pass; passes where
+    // every key shares the byte are skipped.
+    void sort() {
+        size_t n = items.size();
+        keys.resize(n); keysTmp.resize(n);
+        order.resize(n); orderTmp.resize(n);
+        for (size_t i = 0; i < n; ++i) { keys[i] = items[i].key; order[i] = (uint32_t)i; }
+
+        for (int shift = 0; shift < 64; shift += 8) {
+            size_t count[256] = {};
+            for (size_t i = 0; i < n; ++i) count[(keys[i] >> shift) & 0xFF]++;
+            if (n == 0 || count[(keys[0] >> shift) & 0xFF] == n) continue;
+            size_t sum = 0;
+            for (size_t& c : count) { size_t t = c; c = sum; sum += t; }
+            for (size_t i = 0; i < n; ++i) {
+                size_t dst = count[(keys[i] >> shift) & 0xFF]++;
+                keysTmp[dst] = keys[i];
+                orderTmp[dst] = order[i];
+            }
+            keys.swap(keysTmp);
+            order.swap(orderTmp);
+        }
+    }
+
+    // Submits in sorted order. stats gets draw calls, the binds issued, and
+    // the binds a naive bind-everything-per-draw loop would have added.
+    void submit(RenderStats& stats) {
+        GLuint curProgram = 0, curTexture = 0, curVao = 0;
+        bool first = true;
+        int binds = 0, naive = 0;
+        glActiveTexture(GL_TEXTURE0);
+        for (uint32_t idx : order) {
+            DrawItem& d = items[idx];
+            naive += d.texture ? 3 : 2;
+            if (first || d.program != curProgram) { glUseProgram(d.program); curProgram = d.program; ++binds; }
+            if (d.texture && (first || d.texture != curTexture)) {
+                glBindTexture(GL_TEXTURE_2D, d.texture); curTexture = d.texture; ++binds;
+            }
+            if (first || d.vao != curVao) { glBindVertexArray(d.vao); curVao = d.vao; ++binds; }
+            first = false;
+            if (d.matrixLoc >= 0) glUniformMatrix4fv(d.matrixLoc, 1, GL_FALSE, glm::value_ptr(d.matrix));
+
+            if (d.run) {
+                if (d.instanceCount > 0) d.model->setInstanceBase(d.instanceFirst);
+                d.model->drawRun(*d.run, d.instanceCount);
+                stats.drawCalls += d.instanceCount > 0 ? (int)d.run->counts.size() : 1;
+            }
+            else if (d.indexCount > 0) {
+                glDrawElements(GL_TRIANGLES, d.indexCount, GL_UNSIGNED_SHORT, d.indexOffset);
+                stats.drawCalls++;
+            }
+            else {
+                glDrawArrays(GL_TRIANGLES, 0, d.arrayCount);
+                stats.drawCalls++;
+            }
+        }
+        glBindVertexArray(0);
+        stats.stateChanges += binds;
+        stats.stateChangesAvoided += naive - binds;
+    }
+};
+RenderQueue gRenderQueue;
+
+// Queues every material run of one LOD. Runs without their own texture use
+// fallbackTex. For instanced draws the instances must already be uploaded.
+void queueModel(RenderQueue& queue, AssimpModel& model, int lod, GLuint program, GLuint fallbackTex,
+    GLint matrixLoc, const glm::mat4& matrix, float depth01, GLsizei instanceFirst = 0, GLsizei instanceCount = 0)
+{
+    if (!model.vao || model.lods.empty()) return;
+    for (AssimpModel::MaterialRun& run : model.lods[model.clampLod(lod)].runs) {
+        DrawItem d;
+        d.program = program;
+        d.texture = run.texture ? run.texture : fallbackTex;
+        d.vao = model.vao;
+        d.matrixLoc = matrixLoc;
+        d.matrix = matrix;
+        d.model = &model;
+        d.run = &run;
+        d.instanceFirst = instanceFirst;
+        d.instanceCount = instanceCount;
+        d.key = makeDrawKey(kPassOpaque, d.program, d.texture, d.vao, depth01);
+        queue.push(d);
+    }
+}
+
+// ================= TERRAIN (chunked heightfield, streamed) =================
+//
+// The map is a uint16 heightfield on disk (.eth), stored chunk by chunk so
+// one chunk is one contiguous read. Each chunk is 32x32 cells (33x33
+// samples, borders duplicated) at 2 m spacing. Chunks around the camera are
+// built into vertex buffers on the worker pool and uploaded a few per
+// frame; chunks past the unload radius are freed, which bounds memory no
+// matter how far the player walks. All chunks share one index buffer with
+// four geomipmap LODs; each LOD carries a skirt hanging below the chunk
+// border, so neighbours at different LODs never show cracks.
+//
+// If the map file is missing it is generated (fBm noise) and written. The
+// city block around the origin is kept flat at exactly y = 0.
+
+const char     kTerrainMagic[4] = { 'E', 'T', 'H', '1' };
+const uint32_t kTerrainVersion = 1;
+const char*    kTerrainPath = "assets/terrain.eth";
+
+const int   kTerrainChunkCells = 32;
+const int   kTerrainChunkSamples = kTerrainChunkCells + 1;
+const int   kTerrainChunksPerSide = 64;                 // 4 km at 2 m spacing
+const float kTerrainSpacing = 2.0f;
+const float kTerrainHeightScale = 1.0f / 256.0f;        // metres per step
+const float kTerrainHeightOffset = -64.0f;              // q = 16384 is y = 0
+const int   kTerrainLods = 4;
+const float kTerrainLodDistance[kTerrainLods - 1] = { 96.0f, 192.0f, 384.0f };
+const float kTerrainSkirtDepth = 4.0f;
+const float kTerrainLoadRadius = 600.0f;
+const float kTerrainUnloadRadius = 700.0f;
+const int   kTerrainMaxInFlight = 8;
+const int   kTerrainUploadsPerFrame = 4;
+const int   kTerrainGridVerts = kTerrainChunkSamples * kTerrainChunkSamples;
+const int   kTerrainVerts = kTerrainGridVerts + 4 * kTerrainChunkSamples;
+
+struct TerrainFileHeader {
+    char     magic[4];
+    uint32_t version;
+    uint32_t chunksPerSide;
+    uint32_t chunkCells;
+    float    spacing;
+    float    heightScale;
+    float    heightOffset;
+    uint32_t samplesOffset;
+};
+static_assert(sizeof(TerrainFileHeader) == 32, "TerrainFileHeader layout changed");
+
+// Read-only view of the heightfield: the mapped file, or the generated
+// samples when the file couldn't be written.
+struct TerrainMap {
+    MappedFile file;
+    std::vector<uint16_t> owned;
+    const uint16_t* samples = nullptr;
+
+    static float worldHalf() { return kTerrainChunksPerSide * kTerrainChunkCells * kTerrainSpacing * 0.5f; }
+    static int sampleCount() { return kTerrainChunksPerSide * kTerrainChunkCells + 1; }
+
+    bool open(const std::string& path) {
+        if (!file.open(path) || file.size < sizeof(TerrainFileHeader)) return false;
+        const TerrainFileHeader& h = *(const TerrainFileHeader*)file.data;
+        size_t bytes = (size_t)kTerrainChunksPerSide * kTerrainChunksPerSide * kTerrainGridVerts * sizeof(uint16_t);
+        if (memcmp(h.magic, kTerrainMagic, 4) != 0 || h.version != kTerrainVersion ||
+            h.chunksPerSide != (uint32_t)kTerrainChunksPerSide || h.chunkCells != (uint32_t)kTerrainChunkCells ||
+            h.spacing != kTerrainSpacing || h.heightScale != kTerrainHeightScale ||
+            h.heightOffset != kTerrainHeightOffset || h.samplesOffset + (uint64_t)bytes > file.size) {
+            std::cerr << "Terrain: " << path << " does not match this build, regenerating\n";
+            file.close();
+            return false;
+        }
+        samples = (const uint16_t*)(file.data + h.samplesOffset);
+        return true;
+    }
+
+    // Chunk (cx, cz) as kTerrainChunkSamples^2 row-major samples.
+    const uint16_t* chunk(int cx, int cz) const {
+        return samples + ((size_t)cz * kTerrainChunksPerSide + cx) * kTerrainGridVerts;
+    }
+
+    // Raw quantized sample; gx, gz must already be inside the map.
+    uint16_t raw(int gx, int gz) const {
+        int cx = std::min(gx / kTerrainChunkCells, kTerrainChunksPerSide - 1);
+        int cz = std::min(gz / kTerrainChunkCells, kTerrainChunksPerSide - 1);
+        return chunk(cx, cz)[(gz - cz * kTerrainChunkCells) * kTerrainChunkSamples + (gx - cx * kTerrainChunkCells)];
+    }
+
+    // Global sample (gx, gz) in metres, clamped to the map.
+    float sample(int gx, int gz) const {
+        int n = sampleCount() - 1;
+        gx = std::max(0, std::min(gx, n));
+        gz = std::max(0, std::min(gz, n));
+        return kTerrainHeightOffset + raw(gx, gz) * kTerrainHeightScale;
+    }
+
+    // Height of the LOD 0 surface at (x, z) in O(1): find the grid cell,
+    // then interpolate on the same triangle split the index buffer uses
+    // (diagonal from (i+1, j) to (i, j+1)), so feet meet the drawn ground.
+    // normal, if given, receives that triangle's up-facing normal.
+    float heightAt(float x, float z, glm::vec3* normal = nullptr) const {
+        if (!samples) {
+            if (normal) *normal = glm::vec3(0.0f, 1.0f, 0.0f);
+            return 0.0f;
+        }
+        float fx = (x + worldHalf()) / kTerrainSpacing, fz = (z + worldHalf()) / kTerrainSpacing;
+        int n = sampleCount() - 1;
+        fx = glm::clamp(fx, 0.0f, (float)n - 1e-3f);
+        fz = glm::clamp(fz, 0.0f, (float)n - 1e-3f);
+        int i = (int)fx, j = (int)fz;
+        float u = fx - i, v = fz - j;
+        float h00 = sample(i, j), h10 = sample(i + 1, j), h01 = sample(i, j + 1);
+        float h, dhdu, dhdv;
+        if (u + v <= 1.0f) {
+            dhdu = h10 - h00;
+            dhdv = h01 - h00;
+            h = h00 + dhdu * u + dhdv * v;
+        }
+        else {
+            float h11 = sample(i + 1, j + 1);
+            dhdu = h11 - h01;
+            dhdv = h11 - h10;
+            h = h11 + (h01 - h11) * (1.0f - u) + (h10 - h11) * (1.0f - v);
+        }
+        if (normal) *normal = glm::normalize(glm::vec3(-dhdu, kTerrainSpacing, -dhdv));
+        return h;
+    }
+
+    // heightAt for count points at once: four lanes per SSE step. Cell
+    // lookup and interpolation run in SIMD; only the corner fetches are
+    // per lane. Matches heightAt to float rounding.
+    void heightsAt(const float* xs, const float* zs, float* out, size_t count) const {
+        if (!samples) {
+            std::fill(out, out + count, 0.0f);
+            return;
+        }
+        const __m128 half = _mm_set1_ps(worldHalf());
+        const __m128 invSpacing = _mm_set1_ps(1.0f / kTerrainSpacing);
+        const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+        const __m128 hi = _mm_set1_ps((float)(sampleCount() - 1) - 1e-3f);
+        const __m128 scale = _mm_set1_ps(kTerrainHeightScale), offset = _mm_set1_ps(kTerrainHeightOffset);
+        size_t k = 0;
+        for (; k + 4 <= count; k += 4) {
+            __m128 fx = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(xs + k), half), invSpacing);
+            __m128 fz = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(zs + k), half), invSpacing);
+            fx = _mm_min_ps(_mm_max_ps(fx, zero), hi);
+            fz = _mm_min_ps(_mm_max_ps(fz, zero), hi);
+            __m128i ix = _mm_cvttps_epi32(fx), iz = _mm_cvttps_epi32(fz);
+            __m128 u = _mm_sub_ps(fx, _mm_cvtepi32_ps(ix));
+            __m128 v = _mm_sub_ps(fz, _mm_cvtepi32_ps(iz));
+
+            alignas(16) int32_t gx[4], gz[4];
+            alignas(16) float q00[4], q10[4], q01[4], q11[4];
+            _mm_store_si128((__m128i*)gx, ix);
+            _mm_store_si128((__m128i*)gz, iz);
+            for (int l = 0; l < 4; ++l) {
+                q00[l] = raw(gx[l], gz[l]);
+                q10[l] = raw(gx[l] + 1, gz[l]);
+                q01[l] = raw(gx[l], gz[l] + 1);
+                q11[l] = raw(gx[l] + 1, gz[l] + 1);
+            }
+            __m128 h00 = _mm_add_ps(offset, _mm_mul_ps(_mm_load_ps(q00), scale));
+            __m128 h10 = _mm_add_ps(offset, _mm_mul_ps(_mm_load_ps(q10), scale));
+            __m128 h01 = _mm_add_ps(offset, _mm_mul_ps(_mm_load_ps(q01), scale));
+            __m128 h11 = _mm_add_ps(offset, _mm_mul_ps(_mm_load_ps(q11), scale));
+
+            __m128 lower = _mm_add_ps(h00, _mm_add_ps(_mm_mul_ps(_mm_sub_ps(h10, h00), u),
+                _mm_mul_ps(_mm_sub_ps(h01, h00), v)));
+            __m128 upper = _mm_add_ps(h11, _mm_add_ps(_mm_mul_ps(_mm_sub_ps(h01, h11), _mm_sub_ps(one, u)),
+                _mm_mul_ps(_mm_sub_ps(h10, h11), _mm_sub_ps(one, v))));
+            __m128 isUpper = _mm_cmpgt_ps(_mm_add_ps(u, v), one);
+            _mm_storeu_ps(out + k, _mm_or_ps(_mm_and_ps(isUpper, upper), _mm_andnot_ps(isUpper, lower)));
+        }
+        for (; k < count; ++k) out[k] = heightAt(xs[k], zs[k]);
+    }
+
+    // Millions of fBm samples in the file's chunk-major order; slow, so the
+    // game runs it on a worker (TerrainSystem::init) and tools call generate.
+    static void generateSamples(std::vector<uint16_t>& out);
+
+    // Maps path once generated samples were written there, else keeps them.
+    void adopt(const std::string& path, std::vector<uint16_t>&& generated) {
+        if (open(path)) {
+            owned.clear();
+            owned.shrink_to_fit();
+        }
+        else {
+            owned = std::move(generated);
+            samples = owned.data();
+        }
+    }
+
+    bool generate(const std::string& path);
+};
+
+inline float terrainHash(int x, int z, uint32_t seed) {
+    uint32_t h = (uint32_t)x * 374761393u + (uint32_t)z * 668265263u + seed * 2246822519u;
+    h = (h ^ (h >> 13)) * 1274126177u;
+    return ((h ^ (h >> 16)) & 0xFFFFFF) * (1.0f / 16777216.0f);
+}
+
+float valueNoise(float x, float z, uint32_t seed) {
+    int ix = (int)floorf(x), iz = (int)floorf(z);
+    float fx = x - ix, fz = z - iz;
+    fx = fx * fx * (3.0f - 2.0f * fx);
+    fz = fz * fz * (3.0f - 2.0f * fz);
+    float a = terrainHash(ix, iz, seed), b = terrainHash(ix + 1, iz, seed);
+    float c = terrainHash(ix, iz + 1, seed), d = terrainHash(ix + 1, iz + 1, seed);
+    return glm::mix(glm::mix(a, b, fx), glm::mix(c, d, fx), fz);
+}
+
+float terrainFbm(float x, float z) {
+    float sum = 0.0f, amp = 0.5f, freq = 1.0f;
+    for (int o = 0; o < 6; ++o) {
+        sum += amp * valueNoise(x * freq, z * freq, 17u + o);
+        amp *= 0.5f;
+        freq *= 2.03f;
+    }
+    return sum;
+}
+
+void TerrainMap::generateSamples(std::vector<uint16_t>& out) {
+    int n = sampleCount();
+    float half = worldHalf();
+    std::vector<uint16_t> global((size_t)n * n);
+    for (int gz = 0; gz < n; ++gz) {
+        for (int gx = 0; gx < n; ++gx) {
+            float x = gx * kTerrainSpacing - half, z = gz * kTerrainSpacing - half;
+            float h = (terrainFbm(x / 700.0f, z / 700.0f) - 0.47f) * 160.0f
+                + (terrainFbm(x / 80.0f + 31.0f, z / 80.0f) - 0.5f) * 6.0f;
+            // the walled block and its surroundings stay at exactly 0
+            float d = sqrtf(x * x + z * z);
+            float t = glm::clamp((d - 90.0f) / 170.0f, 0.0f, 1.0f);
+            h *= t * t * (3.0f - 2.0f * t);
+            float q = (h - kTerrainHeightOffset) / kTerrainHeightScale;
+            global[(size_t)gz * n + gx] = (uint16_t)glm::clamp(q + 0.5f, 0.0f, 65535.0f);
+        }
+    }
+
+    out.resize((size_t)kTerrainChunksPerSide * kTerrainChunksPerSide * kTerrainGridVerts);
+    for (int cz = 0; cz < kTerrainChunksPerSide; ++cz)
+        for (int cx = 0; cx < kTerrainChunksPerSide; ++cx) {
+            uint16_t* dst = &out[((size_t)cz * kTerrainChunksPerSide + cx) * kTerrainGridVerts];
+            for (int j = 0; j < kTerrainChunkSamples; ++j)
+                for (int i = 0; i < kTerrainChunkSamples; ++i)
+                    dst[j * kTerrainChunkSamples + i] =
+                        global[(size_t)(cz * kTerrainChunkCells + j) * n + cx * kTerrainChunkCells + i];
+        }
+}
+
+bool writeTerrainFile(const std::string& path, const std::vector<uint16_t>& samples) {
+    TerrainFileHeader h{};
+    memcpy(h.magic, kTerrainMagic, 4);
+    h.version = kTerrainVersion;
+    h.chunksPerSide = kTerrainChunksPerSide;
+    h.chunkCells = kTerrainChunkCells;
+    h.spacing = kTerrainSpacing;
+    h.heightScale = kTerrainHeightScale;
+    h.heightOffset = kTerrainHeightOffset;
+    h.samplesOffset = sizeof(TerrainFileHeader);
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write((const char*)&h, sizeof(h));
+    out.write((const char*)samples.data(), samples.size() * sizeof(uint16_t));
+    if (!out) {
+        std::cerr << "Terrain: cannot write " << path << ", keeping it in memory\n";
+        return false;
+    }
+    return true;
+}
+
+bool TerrainMap::generate(const std::string& path) {
+    double t0 = nowMs();
+    std::vector<uint16_t> generated;
+    generateSamples(generated);
+    writeTerrainFile(path, generated);
+    std::cout << "Terrain: generated " << path << " (" << (generated.size() * 2 >> 20) << " MB) in "
+        << (nowMs() - t0) << " ms\n";
+    adopt(path, std::move(generated));
+    return true;
+}
+
+// CPU side of one chunk, built on a worker: kVS layout (pos, colour) with
+// lighting baked into the colour.
+struct TerrainChunkPayload {
+    int cx = 0, cz = 0;
+    std::vector<float> verts;
+    float minY = 0.0f, maxY = 0.0f;
+};
+
+void buildTerrainChunk(const TerrainMap& map, TerrainChunkPayload& p) {
+    const glm::vec3 sun = glm::normalize(glm::vec3(0.4f, 1.0f, 0.3f));
+    const glm::vec3 grass(0.30f, 0.42f, 0.22f), rock(0.44f, 0.41f, 0.37f), paved(0.35f, 0.38f, 0.40f);
+    float half = TerrainMap::worldHalf();
+    int gx0 = p.cx * kTerrainChunkCells, gz0 = p.cz * kTerrainChunkCells;
+
+    p.verts.resize(kTerrainVerts * 6);
+    p.minY = 1e30f; p.maxY = -1e30f;
+    auto put = [&p](int v, const glm::vec3& pos, const glm::vec3& col) {
+        float* d = &p.verts[v * 6];
+        d[0] = pos.x; d[1] = pos.y; d[2] = pos.z;
+        d[3] = col.r; d[4] = col.g; d[5] = col.b;
+    };
+    for (int j = 0; j < kTerrainChunkSamples; ++j) {
+        for (int i = 0; i < kTerrainChunkSamples; ++i) {
+            int gx = gx0 + i, gz = gz0 + j;
+            glm::vec3 pos(gx * kTerrainSpacing - half, map.sample(gx, gz), gz * kTerrainSpacing - half);
+            glm::vec3 n = glm::normalize(glm::vec3(map.sample(gx - 1, gz) - map.sample(gx + 1, gz),
+                2.0f * kTerrainSpacing, map.sample(gx, gz - 1) - map.sample(gx, gz + 1)));
+            glm::vec3 base = glm::mix(rock, grass, glm::smoothstep(0.75f, 0.9f, n.y));
+            float city = glm::smoothstep(60.0f, 90.0f, sqrtf(pos.x * pos.x + pos.z * pos.z));
+            base = glm::mix(paved, base, city);
+            put(j * kTerrainChunkSamples + i, pos, base * (0.45f + 0.55f * std::max(0.0f, glm::dot(n, sun))));
+            p.minY = std::min(p.minY, pos.y);
+            p.maxY = std::max(p.maxY, pos.y);
+        }
+    }
+    // skirts: north, south, west, east border rows dropped by the skirt depth
+    for (int k = 0; k < kTerrainChunkSamples; ++k) {
+        const int border[4] = {
+            k, (kTerrainChunkSamples - 1) * kTerrainChunkSamples + k,
+            k * kTerrainChunkSamples, k * kTerrainChunkSamples + kTerrainChunkSamples - 1 };
+        for (int e = 0; e < 4; ++e) {
+            const float* src = &p.verts[border[e] * 6];
+            put(kTerrainGridVerts + e * kTerrainChunkSamples + k,
+                glm::vec3(src[0], src[1] - kTerrainSkirtDepth, src[2]), glm::vec3(src[3], src[4], src[5]) * 0.8f);
+        }
+    }
+    p.minY -= kTerrainSkirtDepth;
+}
+
+struct TerrainChunk {
+    GLuint vao = 0, vbo = 0;
+    glm::vec3 boundsMin{ 0.0f }, boundsMax{ 0.0f };
+};
+
+struct TerrainSystem {
+    TerrainMap map;
+    GLuint ibo = 0;
+    GLsizei lodCount[kTerrainLods] = {};
+    size_t lodOffset[kTerrainLods] = {};
+
+    WorkerPool* pool = nullptr;
+    std::unordered_map<int, TerrainChunk> chunks;   // resident, keyed cz * side + cx
+    std::unordered_map<int, char> loading;
+    std::mutex readyMutex;
+    std::deque<std::shared_ptr<TerrainChunkPayload>> ready;
+    std::string path;
+    std::shared_ptr<std::vector<uint16_t>> generated;  // first launch: heights from the worker
+    glm::vec3 eye{ 0.0f };
+    int drawnChunks = 0;
+    long long drawnTriangles = 0;
+
+    static int key(int cx, int cz) { return cz * kTerrainChunksPerSide + cx; }
+
+    static glm::vec2 chunkCenter(int cx, int cz) {
+        float size = kTerrainChunkCells * kTerrainSpacing;
+        return glm::vec2((cx + 0.5f) * size - TerrainMap::worldHalf(), (cz + 0.5f) * size - TerrainMap::worldHalf());
+    }
+
+    // Maps the heightfield, or on the first launch generates it on a worker.
+    // Until that lands, heightAt answers a flat 0 and no chunk streams in.
+    bool init(WorkerPool& workers, const std::string& file) {
+        pool = &workers;
+        path = file;
+        buildIndices();
+        if (map.open(path)) return true;
+        pool->submit([this, file]() {
+            double t0 = nowMs();
+            std::shared_ptr<std::vector<uint16_t>> s(new std::vector<uint16_t>());
+            TerrainMap::generateSamples(*s);
+            writeTerrainFile(file, *s);
+            std::cout << "Terrain: generated " << file << " (" << (s->size() * 2 >> 20) << " MB) in "
+                << (nowMs() - t0) << " ms on a worker\n";
+            std::lock_guard<std::mutex> lock(readyMutex);
+            generated = s;
+        });
+        return true;
+    }
+
+    bool loaded() const { return map.samples != nullptr; }
+
+    // One IBO holding every LOD: a grid at step 2^lod plus the skirt quads.
+    void buildIndices() {
+        std::vector<uint16_t> idx;
+        auto grid = [](int i, int j) { return (uint16_t)(j * kTerrainChunkSamples + i); };
+        auto skirt = [](int edge, int k) { return (uint16_t)(kTerrainGridVerts + edge * kTerrainChunkSamples + k); };
+        for (int l = 0; l < kTerrainLods; ++l) {
+            int s = 1 << l;
+            lodOffset[l] = idx.size() * sizeof(uint16_t);
+            for (int j = 0; j < kTerrainChunkCells; j += s) {
+                for (int i = 0; i < kTerrainChunkCells; i += s) {
+                    uint16_t a = grid(i, j), b = grid(i + s, j), c = grid(i, j + s), e = grid(i + s, j + s);
+                    idx.insert(idx.end(), { a, c, b, b, c, e });
+                }
+            }
+            for (int k = 0; k < kTerrainChunkCells; k += s) {
+                const uint16_t top[4][2] = {
+                    { grid(k, 0), grid(k + s, 0) },
+                    { grid(k, kTerrainChunkCells), grid(k + s, kTerrainChunkCells) },
+                    { grid(0, k), grid(0, k + s) },
+                    { grid(kTerrainChunkCells, k), grid(kTerrainChunkCells, k + s) } };
+                for (int e = 0; e < 4; ++e) {
+                    uint16_t a = top[e][0], b = top[e][1], c = skirt(e, k), d = skirt(e, k + s);
+                    idx.insert(idx.end(), { a, c, b, b, c, d });
+                }
+            }
+            lodCount[l] = (GLsizei)(idx.size() - lodOffset[l] / sizeof(uint16_t));
+        }
+        glGenBuffers(1, &ibo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, idx.size() * sizeof(uint16_t), idx.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
+
+    // Frees far chunks, requests missing near ones (nearest first) and
+    // uploads at most kTerrainUploadsPerFrame finished ones.
+    void update(const glm::vec3& camPos) {
+        eye = camPos;
+        if (!loaded()) {
+            std::shared_ptr<std::vector<uint16_t>> s;
+            {
+                std::lock_guard<std::mutex> lock(readyMutex);
+                s.swap(generated);
+            }
+            if (!s) return;
+            map.adopt(path, std::move(*s));
+        }
+        glm::vec2 e(eye.x, eye.z);
+        for (auto it = chunks.begin(); it != chunks.end();) {
+            int cx = it->first % kTerrainChunksPerSide, cz = it->first / kTerrainChunksPerSide;
+            if (glm::length(chunkCenter(cx, cz) - e) > kTerrainUnloadRadius) {
+                glDeleteVertexArrays(1, &it->second.vao);
+                glDeleteBuffers(1, &it->second.vbo);
+                it = chunks.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+
+        float size = kTerrainChunkCells * kTerrainSpacing;
+        int range = (int)ceilf(kTerrainLoadRadius / size);
+        int ccx = (int)floorf((eye.x + TerrainMap::worldHalf()) / size);
+        int ccz = (int)floorf((eye.z + TerrainMap::worldHalf()) / size);
+        std::vector<std::pair<float, int>> wanted;
+        for (int cz = ccz - range; cz <= ccz + range; ++cz) {
+            for (int cx = ccx - range; cx <= ccx + range; ++cx) {
+                if (cx < 0 || cz < 0 || cx >= kTerrainChunksPerSide || cz >= kTerrainChunksPerSide) continue;
+                int k = key(cx, cz);
+                if (chunks.count(k) || loading.count(k)) continue;
+                float d = glm::length(chunkCenter(cx, cz) - e);
+                if (d <= kTerrainLoadRadius) wanted.push_back(std::make_pair(d, k));
+            }
+        }
+        std::sort(wanted.begin(), wanted.end());
+        for (const auto& w : wanted) {
+            if ((int)loading.size() >= kTerrainMaxInFlight) break;
+            loading[w.second] = 1;
+            std::shared_ptr<TerrainChunkPayload> p(new TerrainChunkPayload());
+            p->cx = w.second % kTerrainChunksPerSide;
+            p->cz = w.second / kTerrainChunksPerSide;
+            pool->submit([this, p]() {
+                buildTerrainChunk(map, *p);
+                std::lock_guard<std::mutex> lock(readyMutex);
+                ready.push_back(p);
+            });
+        }
+
+        for (int n = 0; n < kTerrainUploadsPerFrame; ++n) {
+            std::shared_ptr<TerrainChunkPayload> p;
+            {
+                std::lock_guard<std::mutex> lock(readyMutex);
+                if (ready.empty()) break;
+                p = ready.front();
+                ready.pop_front();
+            }
+            int k = key(p->cx, p->cz);
+            loading.erase(k);
+            if (glm::length(chunkCenter(p->cx, p->cz) - e) > kTerrainUnloadRadius) continue;  // walked away
+            upload(*p);
+        }
+    }
+
+    void upload(const TerrainChunkPayload& p) {
+        TerrainChunk c;
+        glGenVertexArrays(1, &c.vao);
+        glGenBuffers(1, &c.vbo);
+        glBindVertexArray(c.vao);
+        glBindBuffer(GL_ARRAY_BUFFER, c.vbo);
+        glBufferData(GL_ARRAY_BUFFER, p.verts.size() * sizeof(float), p.verts.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+        glBindVertexArray(0);
+
+        glm::vec2 center = chunkCenter(p.cx, p.cz);
+        float h = kTerrainChunkCells * kTerrainSpacing * 0.5f;
+        c.boundsMin = glm::vec3(center.x - h, p.minY, center.y - h);
+        c.boundsMax = glm::vec3(center.x + h, p.maxY, center.y + h);
+        chunks[key(p.cx, p.cz)] = c;
+    }
+
+    int lodFor(float distance) const {
+        int lod = 0;
+        while (lod < kTerrainLods - 1 && distance > kTerrainLodDistance[lod]) ++lod;
+        return lod;
+    }
+
+    // Queues every resident chunk inside the frustum at its distance LOD.
+    void queue(RenderQueue& q, const Frustum& frustum, GLuint program, GLint modelLoc) {
+        drawnChunks = 0;
+        drawnTriangles = 0;
+        for (auto& kv : chunks) {
+            const TerrainChunk& c = kv.second;
+            glm::vec3 center = (c.boundsMin + c.boundsMax) * 0.5f;
+            float radius = glm::length(c.boundsMax - c.boundsMin) * 0.5f;
+            if (!frustum.sphereVisible(center, radius)) continue;
+
+            float d = glm::length(glm::vec2(center.x - eye.x, center.z - eye.z));
+            int lod = lodFor(d);
+            DrawItem item;
+            item.program = program;
+            item.vao = c.vao;
+            item.matrixLoc = modelLoc;
+            item.indexCount = lodCount[lod];
+            item.indexOffset = (void*)lodOffset[lod];
+            item.key = makeDrawKey(kPassOpaque, program, 0, c.vao, d / kTerrainUnloadRadius);
+            q.push(item);
+            ++drawnChunks;
+            drawnTriangles += lodCount[lod] / 3;
+        }
+    }
+
+    size_t residentBytes() const {
+        return chunks.size() * kTerrainVerts * 6 * sizeof(float);
+    }
+
+    float heightAt(float x, float z, glm::vec3* normal = nullptr) const { return map.heightAt(x, z, normal); }
+
+    // Call after the worker pool has stopped.
+    void shutdown() {
+        for (auto& kv : chunks) {
+            glDeleteVertexArrays(1, &kv.second.vao);
+            glDeleteBuffers(1, &kv.second.vbo);
+        }
+        chunks.clear();
+        loading.clear();
+        ready.clear();
+        glDeleteBuffers(1, &ibo);
+        ibo = 0;
+    }
+};
+TerrainSystem gTerrain;
+
+// Stands every instance on the terrain with one batched height query.
+void groundInstances(std::vector<ModelInstance>& all, const TerrainMap& terrain) {
+    static std::vector<float> xs, zs, ys;
+    xs.resize(all.size());
+    zs.resize(all.size());
+    ys.resize(all.size());
+    for (size_t i = 0; i < all.size(); ++i) {
+        xs[i] = all[i].model[3][0];
+        zs[i] = all[i].model[3][2];
+    }
+    terrain.heightsAt(xs.data(), zs.data(), ys.data(), all.size());
+    for (size_t i = 0; i < all.size(); ++i) all[i].model[3][1] = ys[i];
+}
+
+// ================= RAYCASTS (4-wide BVH) =================
+//
+// Each node holds the bounds of up to four children in SoA form, so one SSE
+// slab test covers all of them. Every leaf is a single box: the slab test
+// that reaches it is already the exact box test. Built top-down by
+// splitting at the centroid median, twice per node. Refit keeps the
+// topology and recomputes bounds bottom-up, which is enough for NPCs that
+// move a little each frame. Nodes are stored parents-first, so a reverse
+// sweep visits children before parents.
+//
+// A hit is the nearest box entered at t >= 0 before ray.maxT. A box the
+// origin is inside of is not a hit; that is what rayAABB callers already
+// assume (tHit > 0), and it keeps a shooter from hitting their own box.
+
+const int32_t kBvhEmpty = INT32_MIN;
+
+struct Ray {
+    glm::vec3 origin{ 0.0f };
+    glm::vec3 dir{ 0.0f, 0.0f, -1.0f };
+    float maxT = 1e30f;
+};
+
+struct RayHit {
+    float t = 1e30f;
+    int32_t index = -1;             // box index, -1 = miss
+};
+
+struct Bvh4Node {
+    float minX[4], minY[4], minZ[4];
+    float maxX[4], maxY[4], maxZ[4];
+    int32_t child[4];               // >= 0 node, ~box for a leaf, kBvhEmpty
+};
+
+struct Bvh4 {
+    std::vector<Bvh4Node> nodes;
+    std::vector<AABB> boxes;
+
+    bool empty() const { return nodes.empty(); }
+
+    void build(const std::vector<AABB>& source) {
+        boxes = source;
+        nodes.clear();
+        if (boxes.empty()) return;
+        std::vector<uint32_t> order(boxes.size());
+        for (uint32_t i = 0; i < (uint32_t)order.size(); ++i) order[i] = i;
+        nodes.reserve(boxes.size() / 2 + 1);
+        if (boxes.size() == 1) {
+            nodes.push_back(Bvh4Node{});
+            setEmpty(0);
+            setChild(0, 0, ~0, boxes[0]);
+        }
+        else {
+            buildNode(order, 0, order.size());
+        }
+    }
+
+    // New bounds for every box, same count and order as build().
+    void refit(const std::vector<AABB>& source) {
+        if (source.size() != boxes.size()) { build(source); return; }
+        boxes = source;
+        for (size_t n = nodes.size(); n-- > 0;) {
+            Bvh4Node& node = nodes[n];
+            for (int c = 0; c < 4; ++c) {
+                int32_t ch = node.child[c];
+                if (ch == kBvhEmpty) continue;
+                setChild(n, c, ch, ch < 0 ? boxes[~ch] : nodeBounds(nodes[ch]));
+            }
+        }
+    }
+
+    // Nearest hit for each ray.
+    void raycast(const Ray* rays, size_t count, RayHit* hits) const {
+        for (size_t i = 0; i < count; ++i) hits[i] = raycast(rays[i]);
+    }
+
+    RayHit raycast(const Ray& ray) const {
+        RayHit hit;
+        hit.t = ray.maxT;
+        if (nodes.empty()) { hit.t = 1e30f; return hit; }
+
+        auto inv = [](float d) { return 1.0f / (fabsf(d) > 1e-12f ? d : (d < 0.0f ? -1e-12f : 1e-12f)); };
+        const __m128 ox = _mm_set1_ps(ray.origin.x), oy = _mm_set1_ps(ray.origin.y), oz = _mm_set1_ps(ray.origin.z);
+        const __m128 ix = _mm_set1_ps(inv(ray.dir.x)), iy = _mm_set1_ps(inv(ray.dir.y)), iz = _mm_set1_ps(inv(ray.dir.z));
+        const __m128 zero = _mm_setzero_ps();
+        const __m128i empty = _mm_set1_epi32(kBvhEmpty);
+
+        int32_t stack[128];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const Bvh4Node& node = nodes[stack[--top]];
+            __m128 x0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minX), ox), ix);
+            __m128 x1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxX), ox), ix);
+            __m128 y0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minY), oy), iy);
+            __m128 y1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxY), oy), iy);
+            __m128 z0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minZ), oz), iz);
+            __m128 z1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxZ), oz), iz);
+            __m128 tNear = _mm_max_ps(_mm_max_ps(_mm_min_ps(x0, x1), _mm_min_ps(y0, y1)), _mm_min_ps(z0, z1));
+            __m128 tFar = _mm_min_ps(_mm_min_ps(_mm_max_ps(x0, x1), _mm_max_ps(y0, y1)), _mm_max_ps(z0, z1));
+            __m128 live = _mm_and_ps(_mm_cmpge_ps(tFar, zero), _mm_cmple_ps(tNear, tFar));
+            live = _mm_and_ps(live, _mm_cmplt_ps(tNear, _mm_set1_ps(hit.t)));
+            live = _mm_andnot_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)node.child), empty)), live);
+            int mask = _mm_movemask_ps(live);
+            if (!mask) continue;
+
+            alignas(16) float nearT[4];
+            _mm_store_ps(nearT, tNear);
+            // leaves update the hit; inner children go on the stack far-first
+            int32_t inner[4];
+            float innerT[4];
+            int innerCount = 0;
+            for (int c = 0; c < 4; ++c) {
+                if (!(mask & (1 << c))) continue;
+                int32_t ch = node.child[c];
+                if (ch < 0) {
+                    if (nearT[c] >= 0.0f && nearT[c] < hit.t) { hit.t = nearT[c]; hit.index = ~ch; }
+                    continue;
+                }
+                int k = innerCount++;
+                while (k > 0 && innerT[k - 1] < nearT[c]) { inner[k] = inner[k - 1]; innerT[k] = innerT[k - 1]; --k; }
+                inner[k] = ch;
+                innerT[k] = nearT[c];
+            }
+            for (int k = 0; k < innerCount; ++k) {
+                if (innerT[k] < hit.t) stack[top++] = inner[k];
+            }
+        }
+        if (hit.index < 0) hit.t = 1e30f;
+        return hit;
+    }
+
+private:
+    void setEmpty(size_t n) {
+        Bvh4Node& node = nodes[n];
+        for (int c = 0; c < 4; ++c) {
+            node.minX[c] = node.minY[c] = node.minZ[c] = 0.0f;
+            node.maxX[c] = node.maxY[c] = node.maxZ[c] = 0.0f;
+            node.child[c] = kBvhEmpty;
+        }
+    }
+
+    void setChild(size_t n, int c, int32_t child, const AABB& b) {
+        Bvh4Node& node = nodes[n];
+        node.minX[c] = b.min.x; node.minY[c] = b.min.y; node.minZ[c] = b.min.z;
+        node.maxX[c] = b.max.x; node.maxY[c] = b.max.y; node.maxZ[c] = b.max.z;
+        node.child[c] = child;
+    }
+
+    static AABB nodeBounds(const Bvh4Node& node) {
+        AABB b{ glm::vec3(1e30f), glm::vec3(-1e30f) };
+        for (int c = 0; c < 4; ++c) {
+            if (node.child[c] == kBvhEmpty) continue;
+            b.min = glm::min(b.min, glm::vec3(node.minX[c], node.minY[c], node.minZ[c]));
+            b.max = glm::max(b.max, glm::vec3(node.maxX[c], node.maxY[c], node.maxZ[c]));
+        }
+        return b;
+    }
+
+    // Halves [begin, end) at the centroid median along the widest axis.
+    size_t splitRange(std::vector<uint32_t>& order, size_t begin, size_t end) const {
+        glm::vec3 lo(1e30f), hi(-1e30f);
+        for (size_t i = begin; i < end; ++i) {
+            glm::vec3 c = (boxes[order[i]].min + boxes[order[i]].max) * 0.5f;
+            lo = glm::min(lo, c);
+            hi = glm::max(hi, c);
+        }
+        glm::vec3 ext = hi - lo;
+        int axis = ext.x > ext.y ? (ext.x > ext.z ? 0 : 2) : (ext.y > ext.z ? 1 : 2);
+        size_t mid = begin + (end - begin) / 2;
+        std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+            [this, axis](uint32_t a, uint32_t b) {
+                return boxes[a].min[axis] + boxes[a].max[axis] < boxes[b].min[axis] + boxes[b].max[axis];
+            });
+        return mid;
+    }
+
+    // Builds the node for [begin, end) (at least 2 boxes); returns its bounds.
+    AABB buildNode(std::vector<uint32_t>& order, size_t begin, size_t end) {
+        size_t n = nodes.size();
+        nodes.push_back(Bvh4Node{});
+        setEmpty(n);
+
+        size_t parts[5] = { begin, 0, 0, 0, end };
+        int partCount = 4;
+        if (end - begin <= 4) {
+            partCount = (int)(end - begin);
+            for (int p = 1; p <= partCount; ++p) parts[p] = begin + p;
+        }
+        else {
+            parts[2] = splitRange(order, begin, end);
+            parts[1] = splitRange(order, begin, parts[2]);
+            parts[3] = splitRange(order, parts[2], end);
+        }
+
+        AABB bounds{ glm::vec3(1e30f), glm::vec3(-1e30f) };
+        for (int p = 0; p < partCount; ++p) {
+            size_t b = parts[p], e = parts[p + 1];
+            AABB childBounds;
+            int32_t child;
+            if (e - b == 1) {
+                child = ~(int32_t)order[b];
+                childBounds = boxes[order[b]];
+            }
+            else {
+                child = (int32_t)nodes.size();
+                childBounds = buildNode(order, b, e);
+            }
+            setChild(n, p, child, childBounds);
+            bounds.min = glm::min(bounds.min, childBounds.min);
+            bounds.max = glm::max(bounds.max, childBounds.max);
+        }
+        return bounds;
+    }
+};
+
+// Linear reference: nearest rayAABB hit over every box, used by
+// --bench-raycast to check and time the BVH.
+RayHit raycastLinear(const std::vector<AABB>& boxes, const Ray& ray) {
+    RayHit hit;
+    hit.t = ray.maxT;
+    for (size_t i = 0; i < boxes.size(); ++i) {
+        float t = rayAABB(ray.origin, ray.dir, boxes[i]);
+        if (t >= 0.0f && t < hit.t) { hit.t = t; hit.index = (int32_t)i; }
+    }
+    if (hit.index < 0) hit.t = 1e30f;
+    return hit;
+}
+
+Bvh4 gCrowdBvh;                     // crowd instance boxes, refit every frame
+
+// Axis-aligned boxes around the crowd's bounding spheres, for gCrowdBvh.
+void crowdBoxes(const SphereSoA& bounds, std::vector<AABB>& out) {
+    out.resize(bounds.count);
+    for (size_t i = 0; i < bounds.count; ++i) {
+        glm::vec3 c(bounds.x[i], bounds.y[i], bounds.z[i]);
+        out[i] = AABB{ c - bounds.r[i], c + bounds.r[i] };
+    }
+}
+
+// ---------- Collision resolution in XZ ----------
+void resolveXZ(const glm::vec3& oldPos, glm::vec3& newPos,
+    const std::vector<AABB>& boxes, float radius)
+{
+    glm::vec3 tmp = newPos;
+
+    float dx = newPos.x - oldPos.x;
+    for (const auto& b : boxes) {
+        float minX = b.min.x - radius, maxX = b.max.x + radius;
+        float minZ = b.min.z - radius, maxZ = b.max.z + radius;
+
+        if (tmp.z > minZ && tmp.z < maxZ) {
+            if (dx > 0 && oldPos.x <= minX && tmp.x > minX) tmp.x = minX;
+            if (dx < 0 && oldPos.x >= maxX && tmp.x < maxX) tmp.x = maxX;
+        }
+    }
+
+    float dz = newPos.z - oldPos.z;
+    glm::vec3 tmp2 = tmp;
+    for (const auto& b : boxes) {
+        float minX = b.min.x - radius, maxX = b.max.x + radius;
+        float minZ = b.min.z - radius, maxZ = b.max.z + radius;
+
+        if (tmp2.x > minX && tmp2.x < maxX) {
+            if (dz > 0 && oldPos.z <= minZ && tmp2.z > minZ) tmp2.z = minZ;
+            if (dz < 0 && oldPos.z >= maxZ && tmp2.z < maxZ) tmp2.z = maxZ;
+        }
+    }
+
+    newPos = tmp2;
+}
+
+// ---------- Collision kernel (SoA boxes, 8 / 4 per step) ----------
+//
+// Box bounds split into per-axis arrays, padded to a multiple of 8 with
+// boxes that can never hit. A pass along one axis keeps the nearest
+// blocking face per lane and reduces at the end; min/max are exact, so the
+// result is bit-identical to the scalar loops above.
+//
+// resolveXZ and sweepAxisSoA are the old XZ-only step. The game moves
+// the player with the swept capsule (moveCapsule) now, whose SIMD part is
+// slabBoxes below; these stay as the reference --bench-collision measures
+// the grid and the SoA layout against.
+
+struct BoxSoA {
+    std::vector<float> minX, maxX, minY, maxY, minZ, maxZ;
+    size_t count = 0;
+
+    void clear() {
+        count = 0;
+        minX.clear(); maxX.clear(); minY.clear(); maxY.clear(); minZ.clear(); maxZ.clear();
+    }
+
+    void push(const AABB& b) {
+        if (count == minX.size()) {
+            minX.resize(count + 8, 1e30f); maxX.resize(count + 8, -1e30f);
+            minY.resize(count + 8, 1e30f); maxY.resize(count + 8, -1e30f);
+            minZ.resize(count + 8, 1e30f); maxZ.resize(count + 8, -1e30f);
+        }
+        minX[count] = b.min.x; maxX[count] = b.max.x;
+        minY[count] = b.min.y; maxY[count] = b.max.y;
+        minZ[count] = b.min.z; maxZ[count] = b.max.z;
+        ++count;
+    }
+
+    void assign(const std::vector<AABB>& boxes) {
+        clear();
+        for (const AABB& b : boxes) push(b);
+    }
+};
+
+// AVX part of sweepAxisSoA: whole groups of 8 from i on, folded into best.
+TARGET_AVX void sweepAxisAVX(const float* aMin, const float* aMax, const float* bMin, const float* bMax,
+    size_t padded, float o, float c, float radius, bool forward, float none, size_t& i, float& best)
+{
+    const __m256 r = _mm256_set1_ps(radius), cc = _mm256_set1_ps(c), oo = _mm256_set1_ps(o);
+    const __m256 noneV = _mm256_set1_ps(none);
+    __m256 acc = noneV;
+    for (; i + 8 <= padded; i += 8) {
+        __m256 zin = _mm256_and_ps(
+            _mm256_cmp_ps(cc, _mm256_sub_ps(_mm256_loadu_ps(bMin + i), r), _CMP_GT_OQ),
+            _mm256_cmp_ps(cc, _mm256_add_ps(_mm256_loadu_ps(bMax + i), r), _CMP_LT_OQ));
+        if (forward) {
+            __m256 face = _mm256_sub_ps(_mm256_loadu_ps(aMin + i), r);
+            __m256 hit = _mm256_and_ps(zin, _mm256_cmp_ps(oo, face, _CMP_LE_OQ));
+            acc = _mm256_min_ps(_mm256_blendv_ps(noneV, face, hit), acc);
+        }
+        else {
+            __m256 face = _mm256_add_ps(_mm256_loadu_ps(aMax + i), r);
+            __m256 hit = _mm256_and_ps(zin, _mm256_cmp_ps(oo, face, _CMP_GE_OQ));
+            acc = _mm256_max_ps(_mm256_blendv_ps(noneV, face, hit), acc);
+        }
+    }
+    alignas(32) float lanes[8];
+    _mm256_store_ps(lanes, acc);
+    for (float v : lanes) if (forward ? v < best : v > best) best = v;
+}
+
+// One axis of resolveXZ: the mover goes from o to n along axis a while its
+// cross-axis coordinate is c. Returns n clamped by the first face hit.
+float sweepAxisSoA(const float* aMin, const float* aMax, const float* bMin, const float* bMax,
+    size_t padded, float o, float n, float c, float radius)
+{
+    float d = n - o;
+    if (!(d > 0.0f) && !(d < 0.0f)) return n;
+    const bool forward = d > 0.0f;
+    const float none = forward ? 1e30f : -1e30f;
+    float best = none;
+    size_t i = 0;
+    if (gCpuAvx) sweepAxisAVX(aMin, aMax, bMin, bMax, padded, o, c, radius, forward, none, i, best);
+    {
+        const __m128 r = _mm_set1_ps(radius), cc = _mm_set1_ps(c), oo = _mm_set1_ps(o);
+        const __m128 noneV = _mm_set1_ps(none);
+        __m128 acc = noneV;
+        for (; i + 4 <= padded; i += 4) {
+            __m128 zin = _mm_and_ps(_mm_cmpgt_ps(cc, _mm_sub_ps(_mm_loadu_ps(bMin + i), r)),
+                _mm_cmplt_ps(cc, _mm_add_ps(_mm_loadu_ps(bMax + i), r)));
+            if (forward) {
+                __m128 face = _mm_sub_ps(_mm_loadu_ps(aMin + i), r);
+                __m128 hit = _mm_and_ps(zin, _mm_cmple_ps(oo, face));
+                acc = _mm_min_ps(_mm_or_ps(_mm_and_ps(hit, face), _mm_andnot_ps(hit, noneV)), acc);
+            }
+            else {
+                __m128 face = _mm_add_ps(_mm_loadu_ps(aMax + i), r);
+                __m128 hit = _mm_and_ps(zin, _mm_cmpge_ps(oo, face));
+                acc = _mm_max_ps(_mm_or_ps(_mm_and_ps(hit, face), _mm_andnot_ps(hit, noneV)), acc);
+            }
+        }
+        alignas(16) float lanes[4];
+        _mm_store_ps(lanes, acc);
+        for (float v : lanes) if (forward ? v < best : v > best) best = v;
+    }
+    if (forward ? best < n : best > n) return best;
+    return n;
+}
+
+// resolveXZ over SoA boxes: X pass at the target z, then Z pass at the
+// resolved x.
+void resolveXZ(const glm::vec3& oldPos, glm::vec3& newPos, const BoxSoA& boxes, float radius) {
+    size_t padded = boxes.minX.size();
+    if (!padded) return;
+    newPos.x = sweepAxisSoA(boxes.minX.data(), boxes.maxX.data(), boxes.minZ.data(), boxes.maxZ.data(),
+        padded, oldPos.x, newPos.x, newPos.z, radius);
+    newPos.z = sweepAxisSoA(boxes.minZ.data(), boxes.maxZ.data(), boxes.minX.data(), boxes.maxX.data(),
+        padded, oldPos.z, newPos.z, newPos.x, radius);
+}
+
+// ---------- Collider broadphase (uniform grid over static boxes) ----------
+//
+// Built once at level load. Every box is listed in each XZ cell it
+// overlaps (CSR layout: cellStart[c]..cellStart[c + 1] index into items),
+// so a move only tests the boxes near its swept footprint. Boxes covering
+// several cells are deduplicated per query with a stamp per box.
+
+const float kColliderCellSize = 4.0f;
+const int   kColliderGridMaxCells = 1024;   // per axis; cells grow past that
+
+struct ColliderGrid {
+    std::vector<AABB> boxes;
+    std::vector<uint32_t> cellStart;
+    std::vector<uint32_t> items;
+    glm::vec2 origin{ 0.0f };
+    float cellSize = kColliderCellSize;
+    int width = 0, depth = 0;
+
+    std::vector<uint32_t> stamp;            // per box: last query that took it
+    uint32_t query = 0;
+    BoxSoA nearby;                          // gather() result
+    std::vector<uint32_t> nearbyIndex;      // the same boxes as indices
+    std::vector<float> nearbyEntry;         // slabBoxes() output for nearby
+
+    void cellRange(float minX, float minZ, float maxX, float maxZ, int& x0, int& z0, int& x1, int& z1) const {
+        x0 = glm::clamp((int)floorf((minX - origin.x) / cellSize), 0, width - 1);
+        z0 = glm::clamp((int)floorf((minZ - origin.y) / cellSize), 0, depth - 1);
+        x1 = glm::clamp((int)floorf((maxX - origin.x) / cellSize), 0, width - 1);
+        z1 = glm::clamp((int)floorf((maxZ - origin.y) / cellSize), 0, depth - 1);
+    }
+
+    void build(const std::vector<AABB>& source, float cell = kColliderCellSize) {
+        boxes = source;
+        stamp.assign(boxes.size(), 0);
+        query = 0;
+        glm::vec2 lo(1e30f), hi(-1e30f);
+        for (const AABB& b : boxes) {
+            lo = glm::min(lo, glm::vec2(b.min.x, b.min.z));
+            hi = glm::max(hi, glm::vec2(b.max.x, b.max.z));
+        }
+        if (boxes.empty()) lo = hi = glm::vec2(0.0f);
+        float extent = std::max(hi.x - lo.x, hi.y - lo.y);
+        cellSize = std::max(cell, extent / kColliderGridMaxCells);
+        origin = lo;
+        width = std::max(1, (int)ceilf((hi.x - lo.x) / cellSize) + 1);
+        depth = std::max(1, (int)ceilf((hi.y - lo.y) / cellSize) + 1);
+
+        // count, prefix sum, fill
+        cellStart.assign((size_t)width * depth + 1, 0);
+        for (const AABB& b : boxes) {
+            int x0, z0, x1, z1;
+            cellRange(b.min.x, b.min.z, b.max.x, b.max.z, x0, z0, x1, z1);
+            for (int z = z0; z <= z1; ++z)
+                for (int x = x0; x <= x1; ++x) cellStart[(size_t)z * width + x + 1]++;
+        }
+        for (size_t c = 1; c < cellStart.size(); ++c) cellStart[c] += cellStart[c - 1];
+        items.resize(cellStart.back());
+        std::vector<uint32_t> fill(cellStart.begin(), cellStart.end() - 1);
+        for (uint32_t i = 0; i < (uint32_t)boxes.size(); ++i) {
+            int x0, z0, x1, z1;
+            cellRange(boxes[i].min.x, boxes[i].min.z, boxes[i].max.x, boxes[i].max.z, x0, z0, x1, z1);
+            for (int z = z0; z <= z1; ++z)
+                for (int x = x0; x <= x1; ++x) items[fill[(size_t)z * width + x]++] = i;
+        }
+    }
+
+    // Every box whose XZ footprint touches [minX, maxX] x [minZ, maxZ].
+    const BoxSoA& gather(float minX, float minZ, float maxX, float maxZ) {
+        nearby.clear();
+        nearbyIndex.clear();
+        if (boxes.empty()) return nearby;
+        if (++query == 0) {
+            std::fill(stamp.begin(), stamp.end(), 0);
+            query = 1;
+        }
+        int x0, z0, x1, z1;
+        cellRange(minX, minZ, maxX, maxZ, x0, z0, x1, z1);
+        for (int z = z0; z <= z1; ++z) {
+            for (int x = x0; x <= x1; ++x) {
+                size_t c = (size_t)z * width + x;
+                for (uint32_t k = cellStart[c]; k < cellStart[c + 1]; ++k) {
+                    uint32_t i = items[k];
+                    if (stamp[i] == query) continue;
+                    stamp[i] = query;
+                    const AABB& b = boxes[i];
+                    if (b.max.x >= minX && b.min.x <= maxX && b.max.z >= minZ && b.min.z <= maxZ) {
+                        nearby.push(b);
+                        nearbyIndex.push_back(i);
+                    }
+                }
+            }
+        }
+        return nearby;
+    }
+
+    size_t memoryBytes() const {
+        return boxes.size() * (sizeof(AABB) + sizeof(uint32_t)) + (cellStart.size() + items.size()) * sizeof(uint32_t);
+    }
+};
+
+// Same result as testing every box: only boxes whose footprint reaches the
+// move's swept rectangle (grown by radius) can clamp it.
+void resolveXZ(const glm::vec3& oldPos, glm::vec3& newPos, ColliderGrid& grid, float radius) {
+    const BoxSoA& nearby = grid.gather(
+        std::min(oldPos.x, newPos.x) - radius, std::min(oldPos.z, newPos.z) - radius,
+        std::max(oldPos.x, newPos.x) + radius, std::max(oldPos.z, newPos.z) + radius);
+    resolveXZ(oldPos, newPos, nearby, radius);
+}
+
+// ---------- Character controller (swept capsule, collide and slide) ----------
+//
+// The player is a vertical capsule from the feet to just above the eye.
+// A capsule touching a box is the capsule's centre line touching the box
+// grown by the line (a taller box) and rounded by the radius, so each
+// sweep is a ray vs rounded box: a slab test against the box grown by the
+// radius, then for hits on an edge or corner region, rays against the
+// edge capsules (Ericson, RTCD 5.5.7). The move goes to the first contact,
+// loses its component into the contact normal and continues with what is
+// left, a few times at most. One sweep covers the whole tick, so a long
+// frame can't step through a thin wall.
+
+const float kPlayerRadius = 0.4f;
+const float kPlayerHeadroom = 0.1f;     // capsule top above the eye
+const float kCapsuleSkin = 0.01f;       // gap kept to contact surfaces
+const int   kSlideIterations = 4;
+
+// A triangle collider placed in the world (translation only).
+struct PlacedCollisionMesh {
+    const CollisionMesh* mesh = nullptr;
+    glm::vec3 offset{ 0.0f };
+};
+std::vector<PlacedCollisionMesh> gMeshColliders;
+
+inline glm::vec3 boxCornerBits(const AABB& b, int bits) {
+    return glm::vec3(bits & 1 ? b.max.x : b.min.x, bits & 2 ? b.max.y : b.min.y, bits & 4 ? b.max.z : b.min.z);
+}
+
+// Ray p + t d, t in [0, 1], vs box e rounded by r. On a hit returns t and
+// the outward normal at the contact. Starting inside counts as a hit at
+// t = 0 only when d points further in.
+float rayRoundedBox(const glm::vec3& p, const glm::vec3& d, const AABB& e, float r, glm::vec3& normal) {
+    glm::vec3 q = glm::clamp(p, e.min, e.max);
+    glm::vec3 away = p - q;
+    float dist2 = glm::dot(away, away);
+    if (dist2 < r * r) {
+        // overlapping: push out along the nearest face when inside the box
+        if (dist2 > 1e-12f) {
+            normal = away / sqrtf(dist2);
+        }
+        else {
+            glm::vec3 toMin = p - e.min, toMax = e.max - p;
+            float best = toMin.x; normal = glm::vec3(-1, 0, 0);
+            if (toMax.x < best) { best = toMax.x; normal = glm::vec3(1, 0, 0); }
+            if (toMin.y < best) { best = toMin.y; normal = glm::vec3(0, -1, 0); }
+            if (toMax.y < best) { best = toMax.y; normal = glm::vec3(0, 1, 0); }
+            if (toMin.z < best) { best = toMin.z; normal = glm::vec3(0, 0, -1); }
+            if (toMax.z < best) { normal = glm::vec3(0, 0, 1); }
+        }
+        return glm::dot(d, normal) < 0.0f ? 0.0f : -1.0f;
+    }
+
+    // slab test against the box grown by r
+    float tNear = 0.0f, tFar = 1.0f;
+    for (int k = 0; k < 3; ++k) {
+        float lo = e.min[k] - r, hi = e.max[k] + r;
+        if (fabsf(d[k]) < 1e-12f) {
+            if (p[k] < lo || p[k] > hi) return -1.0f;
+            continue;
+        }
+        float t0 = (lo - p[k]) / d[k], t1 = (hi - p[k]) / d[k];
+        if (t0 > t1) std::swap(t0, t1);
+        tNear = std::max(tNear, t0);
+        tFar = std::min(tFar, t1);
+        if (tNear > tFar) return -1.0f;
+    }
+
+    // which region of the grown box the entry point is in
+    glm::vec3 hit = p + d * tNear;
+    int below = 0, above = 0;
+    for (int k = 0; k < 3; ++k) {
+        if (hit[k] < e.min[k]) below |= 1 << k;
+        if (hit[k] > e.max[k]) above |= 1 << k;
+    }
+    int outside = below | above;
+    float t = tNear;
+    if (outside == 7) {
+        // corner: the three edge capsules meeting there
+        t = -1.0f;
+        for (int axis = 1; axis <= 4; axis <<= 1) {
+            float te = rayCapsule(p, d, boxCornerBits(e, above), boxCornerBits(e, above ^ axis), r);
+            if (te >= 0.0f && (t < 0.0f || te < t)) t = te;
+        }
+    }
+    else if (outside & (outside - 1)) {
+        // edge: the capsule along the one axis the point is inside of
+        t = rayCapsule(p, d, boxCornerBits(e, below ^ 7), boxCornerBits(e, above), r);
+    }
+    if (t < 0.0f) return -1.0f;
+
+    hit = p + d * t;
+    glm::vec3 n = hit - glm::clamp(hit, e.min, e.max);
+    float len = glm::length(n);
+    normal = len > 1e-6f ? n / len : glm::vec3(0.0f, 1.0f, 0.0f);
+    return t;
+}
+
+// The box the capsule's centre line (relative to the eye) must stay out
+// of, before rounding by the radius.
+inline AABB capsuleLineBox(const AABB& b) {
+    const float lo = -kEyeHeight + kPlayerRadius, hi = kPlayerHeadroom - kPlayerRadius;
+    return AABB{ glm::vec3(b.min.x, b.min.y - hi, b.min.z), glm::vec3(b.max.x, b.max.y - lo, b.max.z) };
+}
+
+// AVX part of slabBoxes: whole groups of 8 from i on.
+TARGET_AVX void slabBoxesAVX(const float* const mn[3], const float* const mx[3], const float shiftMin[3],
+    const float shiftMax[3], const glm::vec3& p, const glm::vec3& d, float r, size_t padded, float* entry, size_t& i)
+{
+    const __m256 rr = _mm256_set1_ps(r), miss = _mm256_set1_ps(-1.0f);
+    for (; i + 8 <= padded; i += 8) {
+        __m256 tNear = _mm256_setzero_ps(), tFar = _mm256_set1_ps(1.0f);
+        __m256 ok = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int k = 0; k < 3; ++k) {
+            __m256 lo = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(mn[k] + i), _mm256_set1_ps(shiftMin[k])), rr);
+            __m256 hi = _mm256_add_ps(_mm256_sub_ps(_mm256_loadu_ps(mx[k] + i), _mm256_set1_ps(shiftMax[k])), rr);
+            __m256 pk = _mm256_set1_ps(p[k]);
+            if (fabsf(d[k]) < 1e-12f) {
+                ok = _mm256_and_ps(ok, _mm256_and_ps(_mm256_cmp_ps(pk, lo, _CMP_GE_OQ), _mm256_cmp_ps(pk, hi, _CMP_LE_OQ)));
+                continue;
+            }
+            __m256 dk = _mm256_set1_ps(d[k]);
+            __m256 t0 = _mm256_div_ps(_mm256_sub_ps(lo, pk), dk), t1 = _mm256_div_ps(_mm256_sub_ps(hi, pk), dk);
+            tNear = _mm256_max_ps(tNear, _mm256_min_ps(t0, t1));
+            tFar = _mm256_min_ps(tFar, _mm256_max_ps(t0, t1));
+        }
+        ok = _mm256_and_ps(ok, _mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ));
+        _mm256_storeu_ps(entry + i, _mm256_blendv_ps(miss, tNear, ok));
+    }
+}
+
+// Slab test of the ray p + t d, t in [0, 1], against every box of soa
+// moved down by shiftMin / shiftMax and grown by r: the same arithmetic,
+// in the same order, as the slab test in rayRoundedBox. entry[i] is the
+// entry t, or -1 on a miss; padding lanes are junk, stop at soa.count.
+void slabBoxes(const BoxSoA& soa, const glm::vec3& sMin, const glm::vec3& sMax, const glm::vec3& p,
+    const glm::vec3& d, float r, float* entry)
+{
+    const float* const mn[3] = { soa.minX.data(), soa.minY.data(), soa.minZ.data() };
+    const float* const mx[3] = { soa.maxX.data(), soa.maxY.data(), soa.maxZ.data() };
+    const float shiftMin[3] = { sMin.x, sMin.y, sMin.z }, shiftMax[3] = { sMax.x, sMax.y, sMax.z };
+    size_t padded = soa.minX.size(), i = 0;
+    if (gCpuAvx) slabBoxesAVX(mn, mx, shiftMin, shiftMax, p, d, r, padded, entry, i);
+    const __m128 rr = _mm_set1_ps(r), miss = _mm_set1_ps(-1.0f);
+    for (; i + 4 <= padded; i += 4) {
+        __m128 tNear = _mm_setzero_ps(), tFar = _mm_set1_ps(1.0f);
+        __m128 ok = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int k = 0; k < 3; ++k) {
+            __m128 lo = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(mn[k] + i), _mm_set1_ps(shiftMin[k])), rr);
+            __m128 hi = _mm_add_ps(_mm_sub_ps(_mm_loadu_ps(mx[k] + i), _mm_set1_ps(shiftMax[k])), rr);
+            __m128 pk = _mm_set1_ps(p[k]);
+            if (fabsf(d[k]) < 1e-12f) {
+                ok = _mm_and_ps(ok, _mm_and_ps(_mm_cmpge_ps(pk, lo), _mm_cmple_ps(pk, hi)));
+                continue;
+            }
+            __m128 dk = _mm_set1_ps(d[k]);
+            __m128 t0 = _mm_div_ps(_mm_sub_ps(lo, pk), dk), t1 = _mm_div_ps(_mm_sub_ps(hi, pk), dk);
+            tNear = _mm_max_ps(tNear, _mm_min_ps(t0, t1));
+            tFar = _mm_min_ps(tFar, _mm_max_ps(t0, t1));
+        }
+        ok = _mm_and_ps(ok, _mm_cmple_ps(tNear, tFar));
+        _mm_storeu_ps(entry + i, _mm_or_ps(_mm_and_ps(ok, tNear), _mm_andnot_ps(ok, miss)));
+    }
+}
+
+// First contact of the capsule (eye at pos) moving by delta against the
+// boxes of soa; box(i) is the same box as an AABB. The slab entry of the
+// grown box is a lower bound on the rounded box's contact, so only boxes
+// entered before the best contact so far are looked at, and of those only
+// the ones entered on an edge or corner region (or already touching) go
+// through the scalar rayRoundedBox. Same result as calling rayRoundedBox
+// on every box in order.
+template <typename BoxAt>
+float sweepCapsuleBoxes(const glm::vec3& pos, const glm::vec3& delta, const BoxSoA& soa, BoxAt box,
+    std::vector<float>& entry, glm::vec3& normal)
+{
+    const float r = kPlayerRadius;
+    const float lo = -kEyeHeight + r, hi = kPlayerHeadroom - r;
+    float best = -1.0f;
+    if (!soa.count) return best;
+    entry.resize(soa.minX.size());
+    slabBoxes(soa, glm::vec3(0.0f, hi, 0.0f), glm::vec3(0.0f, lo, 0.0f), pos, delta, r, entry.data());
+    for (size_t i = 0; i < soa.count; ++i) {
+        float tn = entry[i];
+        if (tn < 0.0f || (best >= 0.0f && tn >= best)) continue;
+        AABB e = capsuleLineBox(box(i));
+        glm::vec3 n;
+        float t = -1.0f;
+        if (tn > 0.0f) {
+            // started outside the grown box: a face entry is the contact
+            glm::vec3 hit = pos + delta * tn;
+            int below = 0, above = 0;
+            for (int k = 0; k < 3; ++k) {
+                if (hit[k] < e.min[k]) below |= 1 << k;
+                if (hit[k] > e.max[k]) above |= 1 << k;
+            }
+            int outside = below | above;
+            if (outside && !(outside & (outside - 1))) {
+                int k = outside == 1 ? 0 : outside == 2 ? 1 : 2;
+                n = glm::vec3(0.0f);
+                n[k] = above ? 1.0f : -1.0f;
+                t = tn;
+            }
+            else {
+                t = rayRoundedBox(pos, delta, e, r, n);
+            }
+        }
+        else {
+            t = rayRoundedBox(pos, delta, e, r, n);
+        }
+        if (t >= 0.0f && (best < 0.0f || t < best)) { best = t; normal = n; }
+    }
+    return best;
+}
+
+// First contact of the player's capsule (eye at pos) moving by delta
+// against the boxes gathered from the grid and every placed triangle
+// collider. Returns t in [0, 1] or -1.
+float sweepCapsule(const glm::vec3& pos, const glm::vec3& delta, ColliderGrid& grid, glm::vec3& normal) {
+    const float r = kPlayerRadius;
+    const float lo = -kEyeHeight + r, hi = kPlayerHeadroom - r;    // centre line, relative to the eye
+    const BoxSoA& nearby = grid.gather(std::min(pos.x, pos.x + delta.x) - r, std::min(pos.z, pos.z + delta.z) - r,
+        std::max(pos.x, pos.x + delta.x) + r, std::max(pos.z, pos.z + delta.z) + r);
+    float best = sweepCapsuleBoxes(pos, delta, nearby,
+        [&grid](size_t i) -> const AABB& { return grid.boxes[grid.nearbyIndex[i]]; }, grid.nearbyEntry, normal);
+    for (const PlacedCollisionMesh& m : gMeshColliders) {
+        glm::vec3 n;
+        glm::vec3 eye = pos - m.offset;
+        float t = m.mesh->sweepCapsule(eye + glm::vec3(0.0f, lo, 0.0f), eye + glm::vec3(0.0f, hi, 0.0f), r, delta, n);
+        if (t >= 0.0f && (best < 0.0f || t < best)) { best = t; normal = n; }
+    }
+    return best;
+}
+
+// Moves the eye position by delta, sliding along every contact. grounded
+// is set when the capsule ends up resting on a walkable top face.
+glm::vec3 moveCapsule(glm::vec3 pos, glm::vec3 delta, ColliderGrid& grid, bool& grounded, float& velY) {
+    grounded = false;
+    for (int it = 0; it < kSlideIterations; ++it) {
+        if (glm::dot(delta, delta) < 1e-12f) break;
+        glm::vec3 n;
+        float t = sweepCapsule(pos, delta, grid, n);
+        if (t < 0.0f) { pos += delta; break; }
+
+        pos += delta * t + n * kCapsuleSkin;
+        delta *= 1.0f - t;
+        delta -= n * glm::dot(delta, n);
+        if (n.y >= kMaxSlopeCos) { grounded = true; velY = std::max(velY, 0.0f); }
+        if (n.y <= -kMaxSlopeCos) velY = std::min(velY, 0.0f);    // head hit a ceiling
+    }
+
+    // stay on a box top while walking: probe a little way down
+    if (!grounded && velY <= 0.0f) {
+        glm::vec3 n;
+        glm::vec3 probe(0.0f, -4.0f * kCapsuleSkin, 0.0f);
+        float t = sweepCapsule(pos, probe, grid, n);
+        if (t >= 0.0f && n.y >= kMaxSlopeCos) {
+            pos += probe * t + n * kCapsuleSkin;
+            grounded = true;
+            velY = 0.0f;
+        }
+    }
+    return pos;
+}
+
+// ---------- Movement with jump + gravity + NPC collision ----------
+void processMovement(float dt, ColliderGrid& colliders) {
+    float speed = gCam.moveSpeed;
+    if (glfwGetKey(gWindow, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS ||
+        glfwGetKey(gWindow, GLFW_KEY_RIGHT_SHIFT) == GLFW_PRESS) {
+        speed *= gCam.sprintMult;
+    }
+
+    glm::vec3 f{ cosf(glm::radians(gCam.yaw)), 0.0f, sinf(glm::radians(gCam.yaw)) };
+    f = glm::normalize(f);
+    glm::vec3 r = glm::normalize(glm::cross(f, glm::vec3(0, 1, 0)));
+
+    glm::vec3 vel(0);
+    if (glfwGetKey(gWindow, GLFW_KEY_W) == GLFW_PRESS) vel += f;
+    if (glfwGetKey(gWindow, GLFW_KEY_S) == GLFW_PRESS) vel -= f;
+    if (glfwGetKey(gWindow, GLFW_KEY_A) == GLFW_PRESS) vel -= r;
+    if (glfwGetKey(gWindow, GLFW_KEY_D) == GLFW_PRESS) vel += r;
+    if (glm::length(vel) > 0) vel = glm::normalize(vel) * speed;
+
+    // On ground steeper than kMaxSlopeCos: no walking uphill, slide down
+    glm::vec3 groundN;
+    gTerrain.heightAt(gCam.pos.x, gCam.pos.z, &groundN);
+    bool steep = groundN.y < kMaxSlopeCos;
+    if (gGrounded && steep) {
+        glm::vec3 downhill = glm::normalize(glm::vec3(groundN.x, 0.0f, groundN.z));
+        float uphill = glm::dot(vel, downhill);
+        if (uphill < 0.0f) vel -= downhill * uphill;
+        vel += downhill * kSlopeSlideSpeed;
+    }
+
+    if (gGrounded && !steep && glfwGetKey(gWindow, GLFW_KEY_SPACE) == GLFW_PRESS) {
+        gVelY = kJumpSpeed;
+        gGrounded = false;
+    }
+
+    gVelY += kGravity * dt;
+    glm::vec3 delta(vel.x * dt, gVelY * dt, vel.z * dt);
+    bool onBox = false;
+    glm::vec3 newPos = moveCapsule(gCam.pos, delta, colliders, onBox, gVelY);
+
+    // Land on the terrain; while walking, stick to it down slopes too
+    const float kSnapDown = 0.5f;
+    float ground = gTerrain.heightAt(newPos.x, newPos.z);
+    float feetY = newPos.y - kEyeHeight;
+    if (feetY < ground || (!onBox && gGrounded && gVelY <= 0.0f && feetY - ground < kSnapDown)) {
+        newPos.y = ground + kEyeHeight;
+        gVelY = 0.0f;
+        gGrounded = true;
+    }
+    else {
+        gGrounded = onBox;
+    }
+
+    gCam.pos = newPos;
+}
+
+// ================= NAVIGATION (voxel navmesh, A* on workers) =================
+//
+// The walled block and its surroundings are voxelized into 0.5 m ground
+// columns: a column is walkable when the terrain under it is not too steep
+// and no collider overlaps the agent's height above it. Walkable cells are
+// shrunk by the agent radius, then merged greedily into rectangles (the
+// polygons; a rectangle stays under kNavMaxRise of height change), and
+// rectangles sharing an edge are linked through a portal segment. The
+// result is written to assets/navmesh.enm together with a hash of its
+// inputs and read back on the next run when nothing changed.
+//
+// Path queries run A* over the polygons on the worker pool, then pull the
+// string through the portals (simple stupid funnel). Polygon corridors
+// are cached by (start, goal) polygon, so repeated trips only redo the
+// funnel. Results are handed back on the main thread by pump(), like
+// asset uploads.
+
+const char     kNavMagic[4] = { 'E', 'N', 'M', '1' };
+const uint32_t kNavVersion = 1;
+const char*    kNavPath = "assets/navmesh.enm";
+
+const float kNavCellSize = 0.5f;
+const float kNavHalfExtent = 64.0f;         // square around the origin
+const float kNavAgentRadius = 0.4f;
+const float kNavAgentHeight = 1.8f;
+const float kNavMaxRise = 0.5f;             // height change allowed inside one polygon
+const int   kNavMaxRectCells = 32;
+const size_t kPathCacheSize = 1024;
+
+struct NavPoly {
+    uint16_t x0, z0, x1, z1;                // cells [x0, x1) x [z0, z1)
+    float y[4];                             // corner heights: (x0,z0) (x1,z0) (x1,z1) (x0,z1)
+    uint32_t firstLink, linkCount;
+};
+
+struct NavLink {
+    uint32_t poly;                          // neighbour
+    float ax, az, bx, bz;                   // shared edge in XZ
+};
+
+struct NavFileHeader {
+    char     magic[4];
+    uint32_t version;
+    uint64_t sourceHash;
+    float    originX, originZ, cellSize;
+    uint32_t width, depth;
+    uint32_t polyCount, linkCount;
+    uint32_t reserved;
+};
+static_assert(sizeof(NavFileHeader) == 48, "NavFileHeader layout changed");
+
+struct NavMesh {
+    glm::vec2 origin{ 0.0f };
+    float cellSize = kNavCellSize;
+    int width = 0, depth = 0;
+    std::vector<NavPoly> polys;
+    std::vector<NavLink> links;
+    std::vector<int32_t> cellPoly;          // cell -> polygon, -1 = not walkable
+    uint64_t sourceHash = 0;
+
+    // Build parameters, colliders and the terrain samples under the mesh
+    // (one sample of border for the slope normals): editing any of them,
+    // terrain.eth included, invalidates the saved navmesh.
+    static uint64_t hashInputs(const std::vector<AABB>& boxes, const TerrainMap& terrain) {
+        const float params[] = { kNavCellSize, kNavHalfExtent, kNavAgentRadius, kNavAgentHeight, kNavMaxRise,
+            (float)kNavMaxRectCells, kTerrainSpacing, kTerrainHeightScale, kTerrainHeightOffset, kMaxSlopeCos };
+        uint64_t h = fnv1a64(params, sizeof(params));
+        h = fnv1a64(&kTerrainVersion, sizeof(kTerrainVersion), h);
+        if (terrain.samples) {
+            int n = TerrainMap::sampleCount() - 1;
+            int g0 = std::max(0, (int)floorf((TerrainMap::worldHalf() - kNavHalfExtent) / kTerrainSpacing) - 1);
+            int g1 = std::min(n, (int)ceilf((TerrainMap::worldHalf() + kNavHalfExtent) / kTerrainSpacing) + 1);
+            std::vector<uint16_t> heights;
+            heights.reserve((size_t)(g1 - g0 + 1) * (g1 - g0 + 1));
+            for (int gz = g0; gz <= g1; ++gz)
+                for (int gx = g0; gx <= g1; ++gx) heights.push_back(terrain.raw(gx, gz));
+            h = fnv1a64(heights.data(), heights.size() * sizeof(uint16_t), h);
+        }
+        return boxes.empty() ? h : fnv1a64(boxes.data(), boxes.size() * sizeof(AABB), h);
+    }
+
+    glm::vec3 cellCenter(int x, int z, const TerrainMap& terrain) const {
+        float wx = origin.x + (x + 0.5f) * cellSize, wz = origin.y + (z + 0.5f) * cellSize;
+        return glm::vec3(wx, terrain.heightAt(wx, wz), wz);
+    }
+
+    void build(const std::vector<AABB>& boxes, const TerrainMap& terrain) {
+        double t0 = nowMs();
+        sourceHash = hashInputs(boxes, terrain);
+        cellSize = kNavCellSize;
+        width = depth = (int)(2.0f * kNavHalfExtent / cellSize);
+        origin = glm::vec2(-kNavHalfExtent);
+
+        // voxelize: ground columns blocked by colliders or steep ground
+        std::vector<float> ground((size_t)width * depth);
+        std::vector<uint8_t> blocked((size_t)width * depth, 0);
+        for (int z = 0; z < depth; ++z) {
+            for (int x = 0; x < width; ++x) {
+                glm::vec3 n;
+                float wx = origin.x + (x + 0.5f) * cellSize, wz = origin.y + (z + 0.5f) * cellSize;
+                ground[(size_t)z * width + x] = terrain.heightAt(wx, wz, &n);
+                if (n.y < kMaxSlopeCos) blocked[(size_t)z * width + x] = 1;
+            }
+        }
+        for (const AABB& b : boxes) {
+            int bx0 = std::max(0, (int)floorf((b.min.x - origin.x) / cellSize));
+            int bz0 = std::max(0, (int)floorf((b.min.z - origin.y) / cellSize));
+            int bx1 = std::min(width - 1, (int)floorf((b.max.x - origin.x) / cellSize));
+            int bz1 = std::min(depth - 1, (int)floorf((b.max.z - origin.y) / cellSize));
+            for (int z = bz0; z <= bz1; ++z) {
+                for (int x = bx0; x <= bx1; ++x) {
+                    float g = ground[(size_t)z * width + x];
+                    if (b.max.y > g && b.min.y < g + kNavAgentHeight) blocked[(size_t)z * width + x] = 1;
+                }
+            }
+        }
+
+        // keep the agent's radius away from anything blocked and the border
+        int reach = (int)ceilf(kNavAgentRadius / cellSize);
+        std::vector<uint8_t> walkable((size_t)width * depth, 0);
+        for (int z = reach; z < depth - reach; ++z) {
+            for (int x = reach; x < width - reach; ++x) {
+                bool ok = true;
+                for (int dz = -reach; dz <= reach && ok; ++dz)
+                    for (int dx = -reach; dx <= reach && ok; ++dx) {
+                        float ex = std::max(0.0f, fabsf((float)dx) - 0.5f) * cellSize;
+                        float ez = std::max(0.0f, fabsf((float)dz) - 0.5f) * cellSize;
+                        if (ex * ex + ez * ez < kNavAgentRadius * kNavAgentRadius &&
+                            blocked[(size_t)(z + dz) * width + x + dx]) ok = false;
+                    }
+                walkable[(size_t)z * width + x] = ok;
+            }
+        }
+
+        // greedy rectangles
+        polys.clear();
+        cellPoly.assign((size_t)width * depth, -1);
+        auto free = [&](int x, int z) {
+            size_t c = (size_t)z * width + x;
+            return walkable[c] && cellPoly[c] < 0;
+        };
+        for (int z = 0; z < depth; ++z) {
+            for (int x = 0; x < width; ++x) {
+                if (!free(x, z)) continue;
+                float lo = ground[(size_t)z * width + x], hi = lo;
+                auto fits = [&](int cx, int cz) {
+                    float g = ground[(size_t)cz * width + cx];
+                    return free(cx, cz) && std::max(hi, g) - std::min(lo, g) <= kNavMaxRise;
+                };
+                int x1 = x + 1;
+                while (x1 < width && x1 - x < kNavMaxRectCells && fits(x1, z)) {
+                    float g = ground[(size_t)z * width + x1];
+                    lo = std::min(lo, g); hi = std::max(hi, g);
+                    ++x1;
+                }
+                int z1 = z + 1;
+                while (z1 < depth && z1 - z < kNavMaxRectCells) {
+                    bool row = true;
+                    for (int cx = x; cx < x1 && row; ++cx) row = fits(cx, z1);
+                    if (!row) break;
+                    for (int cx = x; cx < x1; ++cx) {
+                        float g = ground[(size_t)z1 * width + cx];
+                        lo = std::min(lo, g); hi = std::max(hi, g);
+                    }
+                    ++z1;
+                }
+                NavPoly p{};
+                p.x0 = (uint16_t)x; p.z0 = (uint16_t)z; p.x1 = (uint16_t)x1; p.z1 = (uint16_t)z1;
+                p.y[0] = terrain.heightAt(origin.x + x * cellSize, origin.y + z * cellSize);
+                p.y[1] = terrain.heightAt(origin.x + x1 * cellSize, origin.y + z * cellSize);
+                p.y[2] = terrain.heightAt(origin.x + x1 * cellSize, origin.y + z1 * cellSize);
+                p.y[3] = terrain.heightAt(origin.x + x * cellSize, origin.y + z1 * cellSize);
+                for (int cz = z; cz < z1; ++cz)
+                    for (int cx = x; cx < x1; ++cx) cellPoly[(size_t)cz * width + cx] = (int32_t)polys.size();
+                polys.push_back(p);
+            }
+        }
+        buildLinks();
+        std::cout << "Navmesh: " << polys.size() << " polygons, " << links.size() << " links from "
+            << width << "x" << depth << " cells in " << (nowMs() - t0) << " ms\n";
+    }
+
+    // Portals: runs of border cells facing the same neighbour, per side.
+    void buildLinks() {
+        links.clear();
+        for (uint32_t pi = 0; pi < (uint32_t)polys.size(); ++pi) {
+            NavPoly& p = polys[pi];
+            p.firstLink = (uint32_t)links.size();
+            auto side = [&](int count, const std::function<int32_t(int)>& neighbour,
+                const std::function<glm::vec2(int)>& at) {
+                int k = 0;
+                while (k < count) {
+                    int32_t n = neighbour(k);
+                    int start = k;
+                    while (k < count && neighbour(k) == n) ++k;
+                    if (n < 0) continue;
+                    glm::vec2 a = at(start), b = at(k);
+                    links.push_back(NavLink{ (uint32_t)n, a.x, a.y, b.x, b.y });
+                }
+            };
+            auto cellAt = [&](int x, int z) {
+                return x < 0 || z < 0 || x >= width || z >= depth ? -1 : cellPoly[(size_t)z * width + x];
+            };
+            auto world = [&](float x, float z) { return glm::vec2(origin.x + x * cellSize, origin.y + z * cellSize); };
+            int w = p.x1 - p.x0, d = p.z1 - p.z0;
+            side(w, [&](int k) { return cellAt(p.x0 + k, p.z0 - 1); }, [&](int k) { return world((float)(p.x0 + k), p.z0); });
+            side(w, [&](int k) { return cellAt(p.x0 + k, p.z1); }, [&](int k) { return world((float)(p.x0 + k), p.z1); });
+            side(d, [&](int k) { return cellAt(p.x0 - 1, p.z0 + k); }, [&](int k) { return world(p.x0, (float)(p.z0 + k)); });
+            side(d, [&](int k) { return cellAt(p.x1, p.z0 + k); }, [&](int k) { return world(p.x1, (float)(p.z0 + k)); });
+            p.linkCount = (uint32_t)links.size() - p.firstLink;
+        }
+    }
+
+    bool save(const std::string& path) const {
+        NavFileHeader h{};
+        memcpy(h.magic, kNavMagic, 4);
+        h.version = kNavVersion;
+        h.sourceHash = sourceHash;
+        h.originX = origin.x; h.originZ = origin.y; h.cellSize = cellSize;
+        h.width = width; h.depth = depth;
+        h.polyCount = (uint32_t)polys.size();
+        h.linkCount = (uint32_t)links.size();
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write((const char*)&h, sizeof(h));
+        out.write((const char*)polys.data(), polys.size() * sizeof(NavPoly));
+        out.write((const char*)links.data(), links.size() * sizeof(NavLink));
+        if (!out) { std::cerr << "Navmesh: cannot write " << path << "\n"; return false; }
+        return true;
+    }
+
+    // Fails when the file is missing, damaged or built from other inputs.
+    // Everything the queries index with is checked, so a bad file means a
+    // rebuild rather than a crash later.
+    bool load(const std::string& path, uint64_t expectHash) {
+        MappedFile file;
+        if (!file.open(path) || file.size < sizeof(NavFileHeader)) return false;
+        const NavFileHeader& h = *(const NavFileHeader*)file.data;
+        size_t need = sizeof(NavFileHeader) + (size_t)h.polyCount * sizeof(NavPoly) + (size_t)h.linkCount * sizeof(NavLink);
+        if (memcmp(h.magic, kNavMagic, 4) != 0 || h.version != kNavVersion || h.sourceHash != expectHash ||
+            file.size < need || h.width > 0xFFFF || h.depth > 0xFFFF || !(h.cellSize > 0.0f) ||
+            !std::isfinite(h.cellSize) || !std::isfinite(h.originX) || !std::isfinite(h.originZ)) return false;
+        origin = glm::vec2(h.originX, h.originZ);
+        cellSize = h.cellSize;
+        width = (int)h.width; depth = (int)h.depth;
+        sourceHash = h.sourceHash;
+        const NavPoly* p = (const NavPoly*)(file.data + sizeof(NavFileHeader));
+        polys.assign(p, p + h.polyCount);
+        const NavLink* l = (const NavLink*)(p + h.polyCount);
+        links.assign(l, l + h.linkCount);
+        auto damaged = [&]() {
+            std::cerr << "Navmesh: " << path << " is damaged\n";
+            polys.clear();
+            links.clear();
+            cellPoly.clear();
+            return false;
+        };
+        for (const NavLink& link : links)
+            if (link.poly >= polys.size()) return damaged();
+        cellPoly.assign((size_t)width * depth, -1);
+        for (uint32_t i = 0; i < h.polyCount; ++i) {
+            const NavPoly& q = polys[i];
+            if (q.x0 >= q.x1 || q.z0 >= q.z1 || q.x1 > width || q.z1 > depth ||
+                q.firstLink + (size_t)q.linkCount > links.size()) return damaged();
+            for (int z = q.z0; z < q.z1; ++z)
+                for (int x = q.x0; x < q.x1; ++x) cellPoly[(size_t)z * width + x] = (int32_t)i;
+        }
+        return true;
+    }
+
+    // Walkable cell under pos, or the nearest one within maxCells rings.
+    int32_t findCell(const glm::vec3& pos, int maxCells = 8) const {
+        if (polys.empty()) return -1;
+        int cx = (int)floorf((pos.x - origin.x) / cellSize), cz = (int)floorf((pos.z - origin.y) / cellSize);
+        for (int ring = 0; ring <= maxCells; ++ring) {
+            for (int dz = -ring; dz <= ring; ++dz) {
+                for (int dx = -ring; dx <= ring; ++dx) {
+                    if (std::max(abs(dx), abs(dz)) != ring) continue;
+                    int x = cx + dx, z = cz + dz;
+                    if (x < 0 || z < 0 || x >= width || z >= depth) continue;
+                    if (cellPoly[(size_t)z * width + x] >= 0) return z * width + x;
+                }
+            }
+        }
+        return -1;
+    }
+
+    int32_t findPoly(const glm::vec3& pos, int maxCells = 8) const {
+        int32_t cell = findCell(pos, maxCells);
+        return cell < 0 ? -1 : cellPoly[cell];
+    }
+
+    glm::vec2 polyMin(const NavPoly& p) const { return origin + glm::vec2(p.x0, p.z0) * cellSize; }
+    glm::vec2 polyMax(const NavPoly& p) const { return origin + glm::vec2(p.x1, p.z1) * cellSize; }
+    glm::vec2 polyCenter(uint32_t i) const { return (polyMin(polys[i]) + polyMax(polys[i])) * 0.5f; }
+
+    // Height on polygon i at (x, z), bilinear over its corners.
+    float heightOn(uint32_t i, float x, float z) const {
+        const NavPoly& p = polys[i];
+        glm::vec2 mn = polyMin(p), mx = polyMax(p);
+        float u = glm::clamp((x - mn.x) / (mx.x - mn.x), 0.0f, 1.0f);
+        float v = glm::clamp((z - mn.y) / (mx.y - mn.y), 0.0f, 1.0f);
+        return glm::mix(glm::mix(p.y[0], p.y[1], u), glm::mix(p.y[3], p.y[2], u), v);
+    }
+
+    // Point clamped inside polygon i (a small margin in from its edges).
+    glm::vec2 clampInto(uint32_t i, const glm::vec2& p) const {
+        glm::vec2 mn = polyMin(polys[i]), mx = polyMax(polys[i]);
+        glm::vec2 margin = glm::min(glm::vec2(0.05f), (mx - mn) * 0.5f);
+        return glm::clamp(p, mn + margin, mx - margin);
+    }
+
+    // A* from polygon start to goal; corridor gets the polygons in order.
+    bool findCorridor(uint32_t start, uint32_t goal, const glm::vec2& goalPos, std::vector<uint32_t>& corridor) const {
+        corridor.clear();
+        struct Node { float g = 1e30f; uint32_t parent = UINT32_MAX; bool closed = false; };
+        std::unordered_map<uint32_t, Node> nodes;
+        std::vector<std::pair<float, uint32_t>> open;   // (f, poly), min-heap
+        auto cmp = [](const std::pair<float, uint32_t>& a, const std::pair<float, uint32_t>& b) { return a.first > b.first; };
+        nodes[start].g = 0.0f;
+        open.push_back(std::make_pair(glm::length(polyCenter(start) - goalPos), start));
+        while (!open.empty()) {
+            std::pop_heap(open.begin(), open.end(), cmp);
+            uint32_t cur = open.back().second;
+            open.pop_back();
+            Node& node = nodes[cur];
+            if (node.closed) continue;
+            node.closed = true;
+            if (cur == goal) break;
+            glm::vec2 c = polyCenter(cur);
+            const NavPoly& p = polys[cur];
+            for (uint32_t l = p.firstLink; l < p.firstLink + p.linkCount; ++l) {
+                const NavLink& link = links[l];
+                glm::vec2 mid((link.ax + link.bx) * 0.5f, (link.az + link.bz) * 0.5f);
+                glm::vec2 nc = polyCenter(link.poly);
+                float g = node.g + glm::length(mid - c) + glm::length(nc - mid);
+                Node& next = nodes[link.poly];
+                if (next.closed || g >= next.g) continue;
+                next.g = g;
+                next.parent = cur;
+                open.push_back(std::make_pair(g + glm::length(nc - goalPos), link.poly));
+                std::push_heap(open.begin(), open.end(), cmp);
+            }
+        }
+        auto it = nodes.find(goal);
+        if (it == nodes.end() || !it->second.closed) return false;
+        for (uint32_t p = goal; p != UINT32_MAX; p = nodes[p].parent) corridor.push_back(p);
+        std::reverse(corridor.begin(), corridor.end());
+        return true;
+    }
+
+    // String pulling through the corridor's portals (simple stupid funnel).
+    void funnel(const std::vector<uint32_t>& corridor, const glm::vec2& from, const glm::vec2& to,
+        std::vector<glm::vec3>& out) const
+    {
+        out.clear();
+        std::vector<glm::vec2> left, right;
+        left.push_back(from); right.push_back(from);
+        for (size_t i = 0; i + 1 < corridor.size(); ++i) {
+            const NavPoly& p = polys[corridor[i]];
+            for (uint32_t l = p.firstLink; l < p.firstLink + p.linkCount; ++l) {
+                const NavLink& link = links[l];
+                if (link.poly != corridor[i + 1]) continue;
+                glm::vec2 a(link.ax, link.az), b(link.bx, link.bz);
+                glm::vec2 dir = polyCenter(corridor[i + 1]) - polyCenter(corridor[i]);
+                // a on the left when walking along dir
+                if (dir.x * (b.y - a.y) - dir.y * (b.x - a.x) > 0.0f) std::swap(a, b);
+                left.push_back(a); right.push_back(b);
+                break;
+            }
+        }
+        left.push_back(to); right.push_back(to);
+
+        auto area2 = [](const glm::vec2& a, const glm::vec2& b, const glm::vec2& c) {
+            return (c.x - a.x) * (b.y - a.y) - (b.x - a.x) * (c.y - a.y);
+        };
+        auto emit = [&](const glm::vec2& p, size_t portal) {
+            uint32_t poly = corridor[std::min(portal, corridor.size() - 1)];
+            glm::vec3 v(p.x, heightOn(poly, p.x, p.y), p.y);
+            if (out.empty() || glm::length(glm::vec2(out.back().x, out.back().z) - p) > 1e-4f) out.push_back(v);
+        };
+        glm::vec2 apex = from, fl = left[0], fr = right[0];
+        size_t apexIndex = 0, li = 0, ri = 0;
+        emit(apex, 0);
+        for (size_t i = 1; i < left.size(); ++i) {
+            const glm::vec2& l = left[i];
+            const glm::vec2& r = right[i];
+            if (area2(apex, fr, r) <= 0.0f) {
+                if (apex == fr || area2(apex, fl, r) > 0.0f) {
+                    fr = r; ri = i;
+                }
+                else {
+                    apex = fl; apexIndex = li;
+                    emit(apex, apexIndex);
+                    fl = fr = apex; li = ri = apexIndex;
+                    i = apexIndex;
+                    continue;
+                }
+            }
+            if (area2(apex, fl, l) >= 0.0f) {
+                if (apex == fl || area2(apex, fr, l) < 0.0f) {
+                    fl = l; li = i;
+                }
+                else {
+                    apex = fr; apexIndex = ri;
+                    emit(apex, apexIndex);
+                    fl = fr = apex; li = ri = apexIndex;
+                    i = apexIndex;
+                    continue;
+                }
+            }
+        }
+        emit(to, corridor.size() - 1);
+    }
+
+    // A walkable point picked from polygon centres (area weighted enough for patrols).
+    glm::vec3 randomPoint(uint32_t seed, const glm::vec2& within) const {
+        if (polys.empty()) return glm::vec3(0.0f);
+        for (int attempt = 0; attempt < 64; ++attempt) {
+            seed = seed * 1664525u + 1013904223u;
+            uint32_t i = (seed >> 8) % (uint32_t)polys.size();
+            glm::vec2 c = polyCenter(i);
+            if (fabsf(c.x) <= within.x && fabsf(c.y) <= within.y) return glm::vec3(c.x, heightOn(i, c.x, c.y), c.y);
+        }
+        glm::vec2 c = polyCenter(0);
+        return glm::vec3(c.x, heightOn(0, c.x, c.y), c.y);
+    }
+};
+
+struct PathResult {
+    bool found = false;
+    bool cached = false;                    // corridor came from the cache
+    std::vector<glm::vec3> points;          // start, corners, goal
+    double ms = 0.0;                        // worker time
+};
+
+// Path requests go to the worker pool; results come back through pump()
+// on the main thread, so the simulation never waits on a search.
+struct PathService {
+    const NavMesh* nav = nullptr;
+    WorkerPool* pool = nullptr;
+
+    std::mutex doneMutex;
+    std::deque<std::function<void()>> done;
+
+    // corridor cache, most recent first
+    std::mutex cacheMutex;
+    std::list<std::pair<uint64_t, std::vector<uint32_t>>> lru;
+    std::unordered_map<uint64_t, std::list<std::pair<uint64_t, std::vector<uint32_t>>>::iterator> cache;
+
+    std::atomic<int> inFlight{ 0 };
+    std::atomic<long long> requests{ 0 }, cacheHits{ 0 }, failures{ 0 };
+
+    void init(const NavMesh& mesh, WorkerPool& workers) {
+        nav = &mesh;
+        pool = &workers;
+    }
+
+    void request(const glm::vec3& from, const glm::vec3& to, std::function<void(PathResult&)> onDone) {
+        ++inFlight;
+        ++requests;
+        pool->submit([this, from, to, onDone]() {
+            std::shared_ptr<PathResult> result(new PathResult());
+            solve(from, to, *result);
+            std::lock_guard<std::mutex> lock(doneMutex);
+            done.push_back([result, onDone]() { onDone(*result); });
+        });
+    }
+
+    // Main thread: hands finished paths to their requesters.
+    void pump() {
+        std::deque<std::function<void()>> ready;
+        {
+            std::lock_guard<std::mutex> lock(doneMutex);
+            ready.swap(done);
+        }
+        for (auto& fn : ready) {
+            fn();
+            --inFlight;
+        }
+    }
+
+    void solve(const glm::vec3& from, const glm::vec3& to, PathResult& result) {
+        double t0 = nowMs();
+        int32_t start = nav->findPoly(from), goal = nav->findPoly(to);
+        if (start < 0 || goal < 0) { ++failures; return; }
+        glm::vec2 a = nav->clampInto(start, glm::vec2(from.x, from.z));
+        glm::vec2 b = nav->clampInto(goal, glm::vec2(to.x, to.z));
+
+        uint64_t key = (uint64_t)(uint32_t)start << 32 | (uint32_t)goal;
+        std::vector<uint32_t> corridor;
+        {
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            auto it = cache.find(key);
+            if (it != cache.end()) {
+                lru.splice(lru.begin(), lru, it->second);
+                corridor = it->second->second;
+                result.cached = true;
+            }
+        }
+        if (!result.cached) {
+            if (!nav->findCorridor(start, goal, b, corridor)) { ++failures; return; }
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            if (!cache.count(key)) {
+                lru.push_front(std::make_pair(key, corridor));
+                cache[key] = lru.begin();
+                if (lru.size() > kPathCacheSize) {
+                    cache.erase(lru.back().first);
+                    lru.pop_back();
+                }
+            }
+        }
+        else {
+            ++cacheHits;
+        }
+        nav->funnel(corridor, a, b, result.points);
+        result.found = true;
+        result.ms = nowMs() - t0;
+    }
+};
+
+NavMesh gNavMesh;
+PathService gPaths;
+
+// Loads the navmesh if it matches the level, else builds and saves it.
+void initNavMesh(NavMesh& nav, const std::vector<AABB>& boxes, const TerrainMap& terrain) {
+    double t0 = nowMs();
+    if (nav.load(kNavPath, NavMesh::hashInputs(boxes, terrain))) {
+        std::cout << "Navmesh: loaded " << nav.polys.size() << " polygons in " << (nowMs() - t0) << " ms\n";
+        return;
+    }
+    nav.build(boxes, terrain);
+    nav.save(kNavPath);
+}
+
+// ---------- Flow fields (many agents, one goal) ----------
+//
+// One Dijkstra pass from the goal cell over the navmesh grid (8-way, no
+// cutting corners) gives every reachable cell its distance to the goal and
+// the neighbour to step to, so an agent steers by one table lookup.
+// Cells are settled nearest first and the pass runs kFlowCellsPerStep
+// cells per frame: when the goal moves, agents near the new goal follow
+// the new field straight away while the rest keep reading the previous one
+// until the frontier reaches them. "Previous" is always the last field
+// that finished, never one still being built, and is never evicted. Fields
+// are cached by goal cell, so a goal that comes back to a cell costs
+// nothing.
+
+const int   kFlowCacheSize = 4;
+const int   kFlowCellsPerStep = 8192;
+const float kFlowArriveRadius = 1.5f;
+const uint8_t kFlowNone = 0xFF;
+
+const int   kFlowDx[8] = { 1, -1, 0, 0, 1, -1, 1, -1 };
+const int   kFlowDz[8] = { 0, 0, 1, -1, 1, 1, -1, -1 };
+const float kFlowStep[8] = { 1.0f, 1.0f, 1.0f, 1.0f, 1.41421356f, 1.41421356f, 1.41421356f, 1.41421356f };
+const uint8_t kFlowOpposite[8] = { 1, 0, 3, 2, 7, 6, 5, 4 };
+
+struct FlowField {
+    int32_t goalCell = -1;
+    std::vector<float> cost;                // cells to the goal, 1e30 = not reached yet
+    std::vector<uint8_t> dir;               // kFlowDx/Dz index towards the goal
+    std::vector<std::pair<float, int32_t>> open;
+    float frontier = 0.0f;                  // every cell up to this cost is final
+    bool complete = false;
+    uint64_t lastUsed = 0;
+
+    void begin(const NavMesh& nav, int32_t goal) {
+        size_t cells = (size_t)nav.width * nav.depth;
+        goalCell = goal;
+        cost.assign(cells, 1e30f);
+        dir.assign(cells, kFlowNone);
+        open.clear();
+        cost[goal] = 0.0f;
+        open.push_back(std::make_pair(0.0f, goal));
+        frontier = 0.0f;
+        complete = false;
+    }
+
+    // Settles up to budget cells; returns how many it did.
+    int step(const NavMesh& nav, int budget) {
+        auto cmp = [](const std::pair<float, int32_t>& a, const std::pair<float, int32_t>& b) { return a.first > b.first; };
+        int done = 0;
+        while (done < budget && !open.empty()) {
+            std::pop_heap(open.begin(), open.end(), cmp);
+            float c = open.back().first;
+            int32_t cell = open.back().second;
+            open.pop_back();
+            if (c > cost[cell]) continue;
+            frontier = c;
+            ++done;
+            int x = cell % nav.width, z = cell / nav.width;
+            for (int k = 0; k < 8; ++k) {
+                int nx = x + kFlowDx[k], nz = z + kFlowDz[k];
+                if (nx < 0 || nz < 0 || nx >= nav.width || nz >= nav.depth) continue;
+                int32_t n = nz * nav.width + nx;
+                if (nav.cellPoly[n] < 0) continue;
+                if (k >= 4 && (nav.cellPoly[z * nav.width + nx] < 0 || nav.cellPoly[nz * nav.width + x] < 0)) continue;
+                float nc = c + kFlowStep[k];
+                if (nc >= cost[n]) continue;
+                cost[n] = nc;
+                dir[n] = kFlowOpposite[k];      // leads back to cell
+                open.push_back(std::make_pair(nc, n));
+                std::push_heap(open.begin(), open.end(), cmp);
+            }
+        }
+        if (open.empty()) {
+            complete = true;
+            frontier = 1e30f;
+        }
+        return done;
+    }
+
+    bool settled(int32_t cell) const { return cost[cell] <= frontier; }
+};
+
+// Goal-keyed fields plus the one agents currently follow and the last
+// complete one they fall back on.
+struct FlowFieldCache {
+    const NavMesh* nav = nullptr;
+    FlowField fields[kFlowCacheSize];
+    int current = -1, previous = -1;
+    uint64_t clock = 0;
+    long long hits = 0, misses = 0;
+
+    void init(const NavMesh& mesh) {
+        nav = &mesh;
+        for (FlowField& f : fields) f = FlowField();
+        current = previous = -1;
+    }
+
+    // Points the agents at pos; a new goal cell starts a new pass.
+    void setGoal(const glm::vec3& pos) {
+        int32_t cell = nav->findCell(pos);
+        if (cell < 0 || (current >= 0 && fields[current].goalCell == cell)) return;
+        int slot = -1;
+        for (int i = 0; i < kFlowCacheSize; ++i)
+            if (fields[i].goalCell == cell) slot = i;
+        if (slot >= 0) {
+            ++hits;
+        }
+        else {
+            ++misses;
+            for (int i = 0; i < kFlowCacheSize; ++i) {
+                if (i == current || i == previous) continue;
+                if (slot < 0 || fields[i].goalCell < 0 || fields[i].lastUsed < fields[slot].lastUsed) slot = i;
+                if (fields[slot].goalCell < 0) break;
+            }
+            fields[slot].begin(*nav, cell);
+        }
+        current = slot;
+        if (fields[slot].complete) previous = slot;
+        fields[slot].lastUsed = ++clock;
+    }
+
+    // Once per frame: advance the current field's pass.
+    void update(int budget = kFlowCellsPerStep) {
+        if (current < 0 || fields[current].complete) return;
+        fields[current].step(*nav, budget);
+        if (fields[current].complete) previous = current;
+    }
+
+    // Unit XZ direction to walk from pos; zero when there is no field yet.
+    glm::vec2 steer(const glm::vec3& pos) const {
+        if (current < 0) return glm::vec2(0.0f);
+        int cx = (int)floorf((pos.x - nav->origin.x) / nav->cellSize), cz = (int)floorf((pos.z - nav->origin.y) / nav->cellSize);
+        const FlowField& cur = fields[current];
+        glm::vec2 goal = nav->origin + (glm::vec2(cur.goalCell % nav->width, cur.goalCell / nav->width) + 0.5f) * nav->cellSize;
+        if (cx < 0 || cz < 0 || cx >= nav->width || cz >= nav->depth) {
+            glm::vec2 d = goal - glm::vec2(pos.x, pos.z);
+            return glm::length(d) > 1e-4f ? glm::normalize(d) : glm::vec2(0.0f);
+        }
+        int32_t cell = cz * nav->width + cx;
+        if (cell == cur.goalCell) {
+            glm::vec2 d = goal - glm::vec2(pos.x, pos.z);
+            return glm::length(d) > 1e-4f ? glm::normalize(d) : glm::vec2(0.0f);
+        }
+        const FlowField* f = &cur;
+        if (!cur.settled(cell) && previous >= 0 && fields[previous].dir[cell] != kFlowNone) f = &fields[previous];
+        uint8_t k = f->dir[cell];
+        if (k == kFlowNone) {
+            // not reached yet (or cut off from the goal): wait rather than
+            // walk at it through walls; off the mesh, get back onto it
+            if (nav->cellPoly[cell] >= 0) return glm::vec2(0.0f);
+            int32_t back = nav->findCell(pos);
+            if (back < 0) return glm::vec2(0.0f);
+            glm::vec2 d = nav->origin + (glm::vec2(back % nav->width, back / nav->width) + 0.5f) * nav->cellSize
+                - glm::vec2(pos.x, pos.z);
+            return glm::length(d) > 1e-4f ? glm::normalize(d) : glm::vec2(0.0f);
+        }
+        return glm::normalize(glm::vec2((float)kFlowDx[k], (float)kFlowDz[k]));
+    }
+
+    glm::vec2 goal() const {
+        if (current < 0) return glm::vec2(0.0f);
+        int32_t c = fields[current].goalCell;
+        return nav->origin + (glm::vec2(c % nav->width, c / nav->width) + 0.5f) * nav->cellSize;
+    }
+
+    size_t memoryBytes() const {
+        size_t bytes = 0;
+        for (const FlowField& f : fields)
+            bytes += f.cost.capacity() * sizeof(float) + f.dir.capacity() + f.open.capacity() * sizeof(f.open[0]);
+        return bytes;
+    }
+};
+
+FlowFieldCache gFlowFields;
+bool gAlarm = false;                        // F6: every patrol converges on the player
+
+// ---------- Patrols (crowd members walking navmesh paths) ----------
+const int   kPatrolCount = 24;
+const float kPatrolSpeed = 1.6f;
+const float kAlarmSpeed = 3.5f;
+const float kPatrolRetryDelay = 2.0f;       // after a failed query, before trying a new target
+
+struct Patrol {
+    uint32_t instance = 0;                  // index into gCrowd
+    std::vector<glm::vec3> path;
+    size_t next = 0;
+    bool waiting = false;                   // a request is in flight
+    float retryIn = 0.0f;                   // seconds until the next request after a failure
+    uint32_t seed = 0;
+};
+std::vector<Patrol> gPatrols;
+
+void updatePatrols(std::vector<Patrol>& patrols, std::vector<ModelInstance>& crowd, float dt) {
+    for (size_t k = 0; k < patrols.size(); ++k) {
+        Patrol& p = patrols[k];
+        if (p.instance >= crowd.size()) continue;
+        glm::mat4& m = crowd[p.instance].model;
+        glm::vec3 pos(m[3]);
+        if (gAlarm) {
+            // run the shared flow field; the route resumes with a new path afterwards
+            p.path.clear();
+            p.next = 0;
+            glm::vec2 goal = gFlowFields.goal();
+            if (glm::length(goal - glm::vec2(pos.x, pos.z)) < kFlowArriveRadius) continue;
+            glm::vec2 d = gFlowFields.steer(pos);
+            if (d == glm::vec2(0.0f)) continue;
+            pos.x += d.x * kAlarmSpeed * dt;
+            pos.z += d.y * kAlarmSpeed * dt;
+            m = glm::rotate(glm::translate(glm::mat4(1.0f), pos), atan2f(d.x, d.y), glm::vec3(0, 1, 0));
+            continue;
+        }
+        if (p.next >= p.path.size()) {
+            if (p.waiting || gNavMesh.polys.empty()) continue;
+            if (p.retryIn > 0.0f) { p.retryIn -= dt; continue; }
+            p.waiting = true;
+            p.seed = p.seed * 1664525u + 1013904223u;
+            glm::vec3 goal = gNavMesh.randomPoint(p.seed, glm::vec2(44.0f));
+            gPaths.request(pos, goal, [&patrols, k](PathResult& r) {
+                if (k >= patrols.size()) return;
+                patrols[k].waiting = false;
+                patrols[k].path = r.found ? r.points : std::vector<glm::vec3>();
+                patrols[k].next = r.found ? 1 : 0;
+                // staggered so patrols that failed together don't retry together
+                if (!r.found) patrols[k].retryIn = kPatrolRetryDelay * (1.0f + 0.125f * (k % 8));
+            });
+            continue;
+        }
+        // walk towards the next corner, facing it
+        glm::vec3 target = p.path[p.next];
+        glm::vec2 to(target.x - pos.x, target.z - pos.z);
+        float dist = glm::length(to);
+        float step = kPatrolSpeed * dt;
+        if (dist <= step) {
+            pos.x = target.x; pos.z = target.z;
+            ++p.next;
+        }
+        else {
+            to /= dist;
+            pos.x += to.x * step; pos.z += to.y * step;
+            float yaw = atan2f(to.x, to.y);
+            m = glm::rotate(glm::translate(glm::mat4(1.0f), pos), yaw, glm::vec3(0, 1, 0));
+            continue;
+        }
+        m[3] = glm::vec4(pos, 1.0f);
+    }
+}
+
+// ================= TOOLS (cookers, benchmarks) =================
+//
+//   "Exit Strategy.exe" --cook-mesh <model.obj|fbx|...> <out.esm>
+//   "Exit Strategy.exe" --bench-mesh-load <model.obj> [runs]
+//   "Exit Strategy.exe" --cook-texture <image.png> <out.etx> [auto|rgba|bc1|bc3]
+//   "Exit Strategy.exe" --bench-streaming [totalMB] [budgetMB]
+//   "Exit Strategy.exe" --bench-crowd [model] [texture] [frames]
+//   "Exit Strategy.exe" --bench-cull [objects]
+//   "Exit Strategy.exe" --bench-occlusion [objects]
+//   "Exit Strategy.exe" --bench-terrain [frames]
+//   "Exit Strategy.exe" --bench-collision [moves]
+//   "Exit Strategy.exe" --bench-raycast [rays] [boxes]
+//   "Exit Strategy.exe" --bench-trimesh [triangles]
+//   "Exit Strategy.exe" --check-capsule
+//   "Exit Strategy.exe" --bench-navmesh [requests]
+//   "Exit Strategy.exe" --bench-flowfield [agents]
+
+// Hidden window + context for tools that need GL but no game.
+bool createToolContext() {
+    if (!glfwInit()) { std::cerr << "GLFW init failed\n"; return false; }
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef __APPLE__
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    gWindow = glfwCreateWindow(WIDTH, HEIGHT, "Exit Strategy (tool)", nullptr, nullptr);
+    if (!gWindow) { glfwTerminate(); return false; }
+    glfwMakeContextCurrent(gWindow);
+    glewExperimental = GL_TRUE;
+    if (glewInit() != GLEW_OK) { glfwDestroyWindow(gWindow); glfwTerminate(); return false; }
+    return true;
+}
+
+void destroyToolContext() {
+    glfwDestroyWindow(gWindow);
+    gWindow = nullptr;
+    glfwTerminate();
+}
+
+int cookMeshTool(const std::string& in, const std::string& out) {
+    double t0 = nowMs();
+    MeshData data;
+    if (!importMeshData(in, data)) return 1;
+    if (!writeBakedMesh(data, in, out)) return 1;
+    std::cout << "Cooked " << in << " -> " << out
+        << " (" << data.vertices.size() << " vertices, "
+        << data.indices.size() << " indices, "
+        << data.submeshes.size() << " submeshes) in "
+        << (nowMs() - t0) << " ms\n";
+    return 0;
+}
+
+// Load + upload time of the Assimp path against the baked path. The first
+// run of each is the cold start; later runs show the warm file cache.
+int benchMeshLoadTool(const std::string& model, int runs) {
+    std::string baked = replaceExtension(model, ".esm");
+    {
+        MeshPayload probe;
+        if (!readBakedMesh(baked, probe, true, model) && cookMeshTool(model, baked) != 0) return 1;
+    }
+    if (!createToolContext()) return 1;
+
+    std::vector<double> objMs, bakedMs;
+    for (int r = 0; r < runs; ++r) {
+        AssimpModel m;
+        double t0 = nowMs();
+        MeshPayload payload;
+        bool ok = readAssimpMesh(model, payload) && m.upload(payload);
+        glFinish();
+        objMs.push_back(nowMs() - t0);
+        m.release();
+        if (!ok) { destroyToolContext(); return 1; }
+
+        t0 = nowMs();
+        ok = m.loadBaked(baked);
+        glFinish();
+        bakedMs.push_back(nowMs() - t0);
+        m.release();
+        if (!ok) { destroyToolContext(); return 1; }
+    }
+
+    std::cout << "\nMesh load benchmark (" << runs << " runs)\n"
+        << "  assimp " << model << ": first " << objMs[0]
+        << " ms, median " << medianOf(objMs) << " ms\n"
+        << "  baked  " << baked << ": first " << bakedMs[0]
+        << " ms, median " << medianOf(bakedMs) << " ms\n"
+        << "  speedup (median): " << medianOf(objMs) / std::max(medianOf(bakedMs), 1e-6) << "x\n";
+
+    destroyToolContext();
+    return 0;
+}
+
+// Synthetic RGBA8 texture with a full mip chain, for streaming tests.
+std::shared_ptr<TexturePayload> makeSyntheticTexture(uint32_t size, uint32_t seed) {
+    std::shared_ptr<TexturePayload> p(new TexturePayload());
+    p->path = "synthetic#" + std::to_string(seed);
+    p->format = kTexRGBA8;
+    p->width = p->height = (int)size;
+    p->pixels.resize(rgba8ChainBytes(size, size));
+
+    uint32_t state = seed * 2654435761u + 1;
+    for (size_t i = 0; i < p->pixels.size(); i += 4) {
+        state = state * 1664525u + 1013904223u;
+        memcpy(&p->pixels[i], &state, 4);
+    }
+    size_t offset = 0;
+    for (uint32_t w = size;; w = std::max(1u, w / 2)) {
+        uint32_t bytes = w * w * 4;
+        p->levels.push_back(TexLevelRef{ p->pixels.data() + offset, bytes, w, w });
+        offset += bytes;
+        if (w == 1) break;
+    }
+    return p;
+}
+
+// Streams totalMB of 2048^2 RGBA8 textures twice: once with the old
+// one-shot upload per frame, once through the PBO ring at budgetMB/frame,
+// and prints a frame-time histogram for each.
+int benchStreamingTool(int totalMB, int budgetMB) {
+    if (!createToolContext()) return 1;
+    glfwSwapInterval(0);
+
+    const uint32_t size = 2048;
+    size_t perTex = rgba8ChainBytes(size, size);
+    int count = std::max(1, (int)(((size_t)totalMB << 20) / perTex));
+    std::cout << "Generating " << count << " textures (" << (count * perTex >> 20) << " MB)...\n";
+    std::vector<std::shared_ptr<TexturePayload>> payloads;
+    for (int i = 0; i < count; ++i) payloads.push_back(makeSyntheticTexture(size, (uint32_t)i + 1));
+
+    const int idleFrames = 30;
+    auto frame = [](FrameHistogram& hist, const std::function<void()>& work) {
+        double t0 = nowMs();
+        glClearColor(0.1f, 0.12f, 0.15f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        work();
+        glfwSwapBuffers(gWindow);
+        glFinish();
+        hist.record((float)(nowMs() - t0));
+    };
+
+    FrameHistogram direct;
+    std::vector<GLuint> made;
+    for (int i = 0; i < count + idleFrames; ++i) {
+        frame(direct, [&]() {
+            if (i < count) made.push_back(uploadTexture(*payloads[i]));
+        });
+    }
+    glDeleteTextures((GLsizei)made.size(), made.data());
+    made.clear();
+
+    FrameHistogram streamed;
+    WorkerPool copies;
+    copies.start(2);
+    TextureStreamer streamer;
+    streamer.init(kStreamSlotCount, kStreamSlotBytes, (size_t)budgetMB << 20, &copies);
+    for (auto& p : payloads) streamer.enqueue(p, [&made](GLuint tex) { made.push_back(tex); });
+    std::vector<double> pumpMs;
+    int tail = 0;
+    while (tail < idleFrames) {
+        frame(streamed, [&]() {
+            double t0 = nowMs();
+            streamer.pump();
+            if (!streamer.idle()) pumpMs.push_back(nowMs() - t0);
+        });
+        if (streamer.idle()) ++tail;
+    }
+    glDeleteTextures((GLsizei)made.size(), made.data());
+
+    std::cout << "\n";
+    direct.report("Direct glTexImage2D (one texture per frame)");
+    std::cout << "\n";
+    streamed.report("PBO ring, " + std::to_string(budgetMB) + " MB/frame budget");
+    std::cout << "  streamed " << (streamer.totalBytes >> 20) << " MB, slot-busy stops: "
+        << streamer.busyFrames << ", render thread in pump(): " << medianOf(pumpMs) << " ms median (copies on workers)\n";
+
+    streamer.shutdown();
+    copies.stop();
+    destroyToolContext();
+    return 0;
+}
 
-                verts.push_back(v);
-            }
-        }
+// Frame time of N copies of a model, drawn once per copy with its own model
+// uniform (the old gNPC path) and then as one instanced stream.
+int benchCrowdTool(const std::string& modelPath, const std::string& texPath, int frames) {
+    if (!createToolContext()) return 1;
+    glfwSwapInterval(0);
+    glEnable(GL_DEPTH_TEST);
+    glViewport(0, 0, WIDTH, HEIGHT);
 
-        if (verts.empty()) {
-            std::cerr << "Assimp: no vertices generated from mesh\n";
-            return false;
+    AssimpModel model;
+    if (!model.load(modelPath)) { destroyToolContext(); return 1; }
+    GLuint tex = loadTexture2D(texPath);
+
+    GLuint objProg = linkProgram(kObjVS, kObjFS);
+    GLint objModel = glGetUniformLocation(objProg, "uModel");
+    GLuint instProg = linkProgram(kObjInstVS, kObjInstFS);
+
+    // High camera looking down over the whole crowd so nothing is culled
+    glm::vec3 eye(0.0f, 120.0f, 90.0f);
+    glm::mat4 P = glm::perspective(glm::radians(60.0f), float(WIDTH) / float(HEIGHT), 0.1f, 500.0f);
+    glm::mat4 V = glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0, 1, 0));
+    FrameUniformBuffer frame;
+    frame.init();
+    frame.update(V, P, eye);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, tex);
+
+    auto measure = [&](const std::function<void()>& draw) {
+        std::vector<double> ms;
+        for (int f = 0; f < frames; ++f) {
+            double t0 = nowMs();
+            glClearColor(0.1f, 0.12f, 0.15f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            draw();
+            glfwSwapBuffers(gWindow);
+            glFinish();
+            ms.push_back(nowMs() - t0);
         }
+        return medianOf(ms);
+    };
 
-        glGenVertexArrays(1, &vao);
-        glGenBuffers(1, &vbo);
+    std::cout << "\nCrowd benchmark: " << modelPath << " (" << model.indexCount / 3
+        << " tris), median of " << frames << " frames\n"
+        << "      NPCs   per-draw ms   instanced ms   speedup\n";
+    const int counts[] = { 100, 1000, 10000 };
+    for (int n : counts) {
+        std::vector<ModelInstance> crowd;
+        spawnCrowd(crowd, n, 0.0f, 80.0f, 1234u);
+
+        double single = measure([&]() {
+            glUseProgram(objProg);
+            glUniform1i(glGetUniformLocation(objProg, "uTex"), 0);
+            for (const ModelInstance& inst : crowd) {
+                glUniformMatrix4fv(objModel, 1, GL_FALSE, glm::value_ptr(inst.model));
+                model.draw();
+            }
+        });
+        double instanced = measure([&]() {
+            glUseProgram(instProg);
+            glUniform1i(glGetUniformLocation(instProg, "uTex"), 0);
+            model.drawInstanced(crowd.data(), (GLsizei)crowd.size());
+        });
+
+        std::cout.width(10); std::cout << n;
+        std::cout.width(14); std::cout << single;
+        std::cout.width(15); std::cout << instanced;
+        std::cout.width(9); std::cout << single / std::max(instanced, 1e-6) << "x\n";
+    }
 
-        glBindVertexArray(vao);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferData(GL_ARRAY_BUFFER,
-            verts.size() * sizeof(SimpleVertex),
-            verts.data(),
-            GL_STATIC_DRAW);
+    glDeleteProgram(objProg);
+    glDeleteProgram(instProg);
+    frame.release();
+    glDeleteTextures(1, &tex);
+    model.release();
+    destroyToolContext();
+    return 0;
+}
 
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE,
-            sizeof(SimpleVertex), (void*)0);
+// CPU-only: scalar vs SoA frustum culling over a random scene of spheres.
+int benchCullTool(int objects) {
+    SphereSoA spheres;
+    spheres.resize(objects);
+    uint32_t state = 99u;
+    auto rnd = [&state]() {
+        state = state * 1664525u + 1013904223u;
+        return (state >> 8) * (1.0f / 16777216.0f);
+    };
+    for (int i = 0; i < objects; ++i)
+        spheres.set(i, glm::vec3(rnd() * 400.0f - 200.0f, rnd() * 10.0f, rnd() * 400.0f - 200.0f),
+            0.5f + rnd() * 2.0f);
+
+    glm::mat4 P = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 200.0f);
+    std::vector<uint32_t> a, b;
+    std::vector<double> scalarMs, simdMs;
+    bool same = true;
+    const int runs = 50;
+    for (int r = 0; r < runs; ++r) {
+        float yaw = r * (6.2831853f / runs);
+        glm::mat4 V = glm::lookAt(glm::vec3(0.0f, 2.0f, 0.0f),
+            glm::vec3(cosf(yaw), 2.0f, sinf(yaw)), glm::vec3(0, 1, 0));
+        Frustum f = Frustum::fromMatrix(P * V);
+
+        a.clear(); b.clear();
+        double t0 = nowMs();
+        cullSpheresScalar(f, spheres, a);
+        scalarMs.push_back(nowMs() - t0);
+        t0 = nowMs();
+        cullSpheres(f, spheres, b);
+        simdMs.push_back(nowMs() - t0);
+        same = same && a == b;
+    }
 
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE,
-            sizeof(SimpleVertex),
-            (void*)offsetof(SimpleVertex, uv));
+    std::cout << "\nFrustum cull benchmark: " << objects << " spheres, " << runs << " views\n"
+        << "  path: " << (gCpuAvx ? "AVX (8-wide)" : "SSE (4-wide)") << "\n"
+        << "  visible (last view): " << b.size() << "\n"
+        << "  scalar median: " << medianOf(scalarMs) << " ms\n"
+        << "  SIMD   median: " << medianOf(simdMs) << " ms\n"
+        << "  speedup: " << medianOf(scalarMs) / std::max(medianOf(simdMs), 1e-6) << "x\n"
+        << "  results " << (same ? "match" : "DIFFER") << "\n";
+    return same ? 0 : 1;
+}
 
-        glBindVertexArray(0);
+// CPU-only: occluder rasterization (one thread vs the tile pool) and
+// occludee tests over random objects in the level, from eye height at
+// several points around the block.
+int benchOcclusionTool(int objects) {
+    std::vector<LevelBox> level;
+    buildLevel(level);
+
+    SphereSoA spheres;
+    spheres.resize(objects);
+    uint32_t state = 4242u;
+    auto rnd = [&state]() {
+        state = state * 1664525u + 1013904223u;
+        return (state >> 8) * (1.0f / 16777216.0f);
+    };
+    for (int i = 0; i < objects; ++i)
+        spheres.set(i, glm::vec3(rnd() * 88.0f - 44.0f, 1.0f, rnd() * 88.0f - 44.0f), 1.0f);
+
+    unsigned int hw = std::thread::hardware_concurrency();
+    WorkerPool pool;
+    pool.start(std::max(1u, std::min(3u, hw / 2)));
+
+    glm::mat4 P = glm::perspective(glm::radians(70.0f), 16.0f / 9.0f, 0.1f, 200.0f);
+    OcclusionBuffer occ;
+    std::vector<double> serialMs, pooledMs, testMs;
+    std::vector<uint32_t> idx;
+    size_t inFrustum = 0, hidden = 0;
+    const int views = 16;
+    for (int v = 0; v < views; ++v) {
+        float a = v * (6.2831853f / views);
+        glm::vec3 eye(cosf(a) * 12.0f, 1.8f, sinf(a) * 12.0f);
+        glm::mat4 V = glm::lookAt(eye, eye + glm::vec3(cosf(a + 2.0f), 0.0f, sinf(a + 2.0f)), glm::vec3(0, 1, 0));
+        glm::mat4 VP = P * V;
+
+        double t0 = nowMs();
+        renderOccluders(occ, level, VP, nullptr);
+        serialMs.push_back(nowMs() - t0);
+        t0 = nowMs();
+        renderOccluders(occ, level, VP, &pool);
+        pooledMs.push_back(nowMs() - t0);
+
+        idx.clear();
+        cullSpheres(Frustum::fromMatrix(VP), spheres, idx);
+        inFrustum += idx.size();
+        t0 = nowMs();
+        hidden += occludeSpheres(occ, spheres, idx);
+        testMs.push_back(nowMs() - t0);
+    }
+    pool.stop();
+
+    std::cout << "\nOcclusion benchmark: " << objects << " objects, " << views << " views, "
+        << kOccWidth << "x" << kOccHeight << " buffer, " << occ.tris.size() << " occluder tris (last view)\n"
+        << "  raster 1 thread median: " << medianOf(serialMs) << " ms\n"
+        << "  raster pooled   median: " << medianOf(pooledMs) << " ms\n"
+        << "  test median: " << medianOf(testMs) << " ms\n"
+        << "  occluded: " << hidden << " of " << inFrustum << " in-frustum ("
+        << (inFrustum ? 100.0 * hidden / inFrustum : 0.0) << "%)\n";
+    return 0;
+}
 
-        vertexCount = (GLsizei)verts.size();
-        std::cout << "Assimp loaded: " << path
-            << " vertices: " << vertexCount << "\n";
-        return true;
+// Flies the camera across the map with streaming on and reports the frame
+// time distribution and the peak resident terrain.
+int benchTerrainTool(int frames) {
+    if (!createToolContext()) return 1;
+    glfwSwapInterval(0);
+    glEnable(GL_DEPTH_TEST);
+    glViewport(0, 0, WIDTH, HEIGHT);
+
+    GLuint prog = linkProgram(kVS, kFS);
+    GLint uModel = glGetUniformLocation(prog, "uModel");
+    FrameUniformBuffer frame;
+    frame.init();
+
+    WorkerPool pool;
+    unsigned int hw = std::thread::hardware_concurrency();
+    pool.start(hw > 2 ? hw - 1 : 2);
+    {
+        TerrainMap probe;           // generate up front so the queries below see real ground
+        if (!probe.open(kTerrainPath)) probe.generate(kTerrainPath);
+    }
+    TerrainSystem terrain;
+    if (!terrain.init(pool, kTerrainPath)) { pool.stop(); destroyToolContext(); return 1; }
+
+    // Ground queries: per point vs the batched SSE path
+    {
+        const size_t n = 100000;
+        std::vector<float> xs(n), zs(n), scalar(n), batch(n);
+        uint32_t state = 99u;
+        auto rnd = [&state]() {
+            state = state * 1664525u + 1013904223u;
+            return (state >> 8) * (1.0f / 16777216.0f);
+        };
+        for (size_t i = 0; i < n; ++i) {
+            xs[i] = (rnd() - 0.5f) * 2.0f * TerrainMap::worldHalf();
+            zs[i] = (rnd() - 0.5f) * 2.0f * TerrainMap::worldHalf();
+        }
+        std::vector<double> scalarMs, batchMs;
+        for (int r = 0; r < 9; ++r) {
+            double t0 = nowMs();
+            for (size_t i = 0; i < n; ++i) scalar[i] = terrain.heightAt(xs[i], zs[i]);
+            scalarMs.push_back(nowMs() - t0);
+            t0 = nowMs();
+            terrain.map.heightsAt(xs.data(), zs.data(), batch.data(), n);
+            batchMs.push_back(nowMs() - t0);
+        }
+        float maxDiff = 0.0f;
+        for (size_t i = 0; i < n; ++i) maxDiff = std::max(maxDiff, fabsf(scalar[i] - batch[i]));
+        std::cout << "\nGround queries (" << n << " points): scalar " << medianOf(scalarMs)
+            << " ms, batched " << medianOf(batchMs) << " ms, max difference " << maxDiff << " m\n";
     }
 
-    void draw() const {
-        if (!vao || !vertexCount) return;
-        glBindVertexArray(vao);
-        glDrawArrays(GL_TRIANGLES, 0, vertexCount);
-        glBindVertexArray(0);
+    const float kFar = 700.0f;
+    glm::mat4 P = glm::perspective(glm::radians(60.0f), float(WIDTH) / float(HEIGHT), 0.1f, kFar);
+    glm::vec3 from(-1500.0f, 0.0f, -1200.0f), to(1500.0f, 0.0f, 1300.0f);
+    RenderQueue queue;
+    RenderStats stats;
+    FrameHistogram hist;
+    size_t peakChunks = 0, peakBytes = 0;
+    long long triangles = 0;
+
+    for (int f = 0; f < frames; ++f) {
+        double t0 = nowMs();
+        glm::vec3 eye = glm::mix(from, to, f / float(std::max(1, frames - 1)));
+        eye.y = terrain.heightAt(eye.x, eye.z) + 25.0f;
+        glm::vec3 target = eye + glm::normalize(to - from) * 50.0f;
+        target.y = eye.y - 10.0f;
+        glm::mat4 V = glm::lookAt(eye, target, glm::vec3(0, 1, 0));
+        frame.update(V, P, eye);
+
+        terrain.update(eye);
+        glClearColor(0.1f, 0.12f, 0.15f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        queue.clear();
+        terrain.queue(queue, Frustum::fromMatrix(P * V), prog, uModel);
+        queue.sort();
+        queue.submit(stats);
+        glfwSwapBuffers(gWindow);
+        glFinish();
+        hist.record((float)(nowMs() - t0));
+
+        peakChunks = std::max(peakChunks, terrain.chunks.size());
+        peakBytes = std::max(peakBytes, terrain.residentBytes());
+        triangles += terrain.drawnTriangles;
     }
-};
+    pool.stop();
 
-AssimpModel gNPCModel;
+    std::cout << "\nTerrain benchmark: " << frames << " frames over "
+        << glm::length(to - from) << " m, " << kTerrainChunksPerSide * kTerrainChunksPerSide << " chunks on disk\n";
+    hist.report("Frame times");
+    std::cout << "  resident peak: " << peakChunks << " chunks, " << (peakBytes >> 10) << " KB vertex data\n"
+        << "  mean triangles drawn: " << triangles / std::max(1, frames) << "\n";
 
-const char* kObjVS = R"(#version 330 core
-layout (location=0) in vec3 aPos;
-layout (location=1) in vec2 aUV;
-uniform mat4 uMVP;
-out vec2 vUV;
-void main(){
-    vUV = aUV;
-    gl_Position = uMVP * vec4(aPos, 1.0);
+    terrain.shutdown();
+    frame.release();
+    glDeleteProgram(prog);
+    destroyToolContext();
+    return 0;
 }
-)";
 
-const char* kObjFS = R"(#version 330 core
-in vec2 vUV;
-uniform sampler2D uTex;
-out vec4 FragColor;
-void main(){
-    FragColor = texture(uTex, vUV);
+// Times the old XZ collision step (player radius, one 60 Hz walking step)
+// against every box vs through the grid, for a growing number of static
+// colliders, and checks both give the same positions; then the SoA
+// kernels: resolveXZ's, and the capsule sweep the game moves with.
+int benchCollisionTool(int moves) {
+    std::cout << "\nCollision benchmark: " << moves << " moves per run, cell " << kColliderCellSize << " m\n"
+        << "  colliders   build ms   brute us/move   grid us/move   speedup   tested/move   same\n";
+    const int counts[] = { 10, 1000, 100000 };
+    const float radius = 0.4f, step = 6.0f / 60.0f;
+    for (int count : counts) {
+        uint32_t state = 555u + count;
+        auto rnd = [&state]() {
+            state = state * 1664525u + 1013904223u;
+            return (state >> 8) * (1.0f / 16777216.0f);
+        };
+        // the level plus crates and props at a constant density
+        std::vector<LevelBox> level;
+        buildLevel(level);
+        std::vector<AABB> boxes;
+        for (const LevelBox& b : level) if ((int)boxes.size() < count) boxes.push_back(b.box);
+        float half = std::max(45.0f, sqrtf((float)count) * 4.0f);
+        while ((int)boxes.size() < count) {
+            glm::vec3 c(rnd() * 2.0f * half - half, 1.0f, rnd() * 2.0f * half - half);
+            glm::vec3 e(0.3f + rnd() * 1.2f, 1.0f, 0.3f + rnd() * 1.2f);
+            boxes.push_back(AABB{ c - e, c + e });
+        }
+
+        double t0 = nowMs();
+        ColliderGrid grid;
+        grid.build(boxes);
+        double buildMs = nowMs() - t0;
+
+        // the same random walks, once per method
+        std::vector<glm::vec3> starts(moves), dirs(moves);
+        for (int i = 0; i < moves; ++i) {
+            starts[i] = glm::vec3(rnd() * 2.0f * half - half, kEyeHeight, rnd() * 2.0f * half - half);
+            float a = rnd() * 6.2831853f;
+            dirs[i] = glm::vec3(cosf(a), 0.0f, sinf(a)) * step;
+        }
+        std::vector<glm::vec3> bruteOut(moves), gridOut(moves);
+        t0 = nowMs();
+        for (int i = 0; i < moves; ++i) {
+            bruteOut[i] = starts[i] + dirs[i];
+            resolveXZ(starts[i], bruteOut[i], boxes, radius);
+        }
+        double bruteMs = nowMs() - t0;
+        size_t tested = 0;
+        t0 = nowMs();
+        for (int i = 0; i < moves; ++i) {
+            gridOut[i] = starts[i] + dirs[i];
+            resolveXZ(starts[i], gridOut[i], grid, radius);
+            tested += grid.nearby.count;
+        }
+        double gridMs = nowMs() - t0;
+        bool same = memcmp(bruteOut.data(), gridOut.data(), moves * sizeof(glm::vec3)) == 0;
+
+        std::cout.width(11); std::cout << count;
+        std::cout.width(11); std::cout << buildMs;
+        std::cout.width(16); std::cout << bruteMs * 1000.0 / moves;
+        std::cout.width(15); std::cout << gridMs * 1000.0 / moves;
+        std::cout.width(9); std::cout << bruteMs / std::max(gridMs, 1e-6) << "x";
+        std::cout.width(14); std::cout << (double)tested / moves;
+        std::cout.width(7); std::cout << (same ? "yes" : "NO") << "\n";
+        if (!same) return 1;
+    }
+
+    // Narrowphase kernel alone: every box per move, AoS scalar vs SoA SIMD,
+    // on sets that fit L1 and sets that spill to L2
+    std::cout << "\nCollision kernel: scalar AoS vs " << (gCpuAvx ? "AVX" : "SSE") << " SoA, every box tested per move\n"
+        << "      boxes   SoA KB   scalar ns/box   SIMD ns/box   speedup   clamped   identical\n";
+    const int sizes[] = { 256, 1536, 16384, 65536 };
+    for (int n : sizes) {
+        uint32_t state = 77u + n;
+        auto rnd = [&state]() {
+            state = state * 1664525u + 1013904223u;
+            return (state >> 8) * (1.0f / 16777216.0f);
+        };
+        // dense enough that most moves hit something
+        float half = sqrtf((float)n) * 1.5f;
+        std::vector<AABB> boxes(n);
+        for (AABB& b : boxes) {
+            glm::vec3 c(rnd() * 2.0f * half - half, 1.0f, rnd() * 2.0f * half - half);
+            glm::vec3 e(0.2f + rnd(), 1.0f, 0.2f + rnd());
+            b = AABB{ c - e, c + e };
+        }
+        BoxSoA soa;
+        soa.assign(boxes);
+
+        int runs = std::max(200, 20000000 / n);
+        std::vector<glm::vec3> starts(runs), targets(runs), scalarOut(runs), simdOut(runs);
+        for (int i = 0; i < runs; ++i) {
+            starts[i] = glm::vec3(rnd() * 2.0f * half - half, kEyeHeight, rnd() * 2.0f * half - half);
+            float a = rnd() * 6.2831853f;
+            targets[i] = starts[i] + glm::vec3(cosf(a), 0.0f, sinf(a)) * 3.0f;
+        }
+        std::vector<double> scalarMs, simdMs;
+        for (int rep = 0; rep < 5; ++rep) {
+            double t0 = nowMs();
+            for (int i = 0; i < runs; ++i) {
+                scalarOut[i] = targets[i];
+                resolveXZ(starts[i], scalarOut[i], boxes, radius);
+            }
+            scalarMs.push_back(nowMs() - t0);
+            t0 = nowMs();
+            for (int i = 0; i < runs; ++i) {
+                simdOut[i] = targets[i];
+                resolveXZ(starts[i], simdOut[i], soa, radius);
+            }
+            simdMs.push_back(nowMs() - t0);
+        }
+        int clamped = 0;
+        for (int i = 0; i < runs; ++i) clamped += scalarOut[i] != targets[i];
+        bool identical = memcmp(scalarOut.data(), simdOut.data(), runs * sizeof(glm::vec3)) == 0;
+        double tests = (double)runs * n;
+
+        std::cout.width(11); std::cout << n;
+        std::cout.width(9); std::cout << soa.minX.size() * 6 * sizeof(float) / 1024;
+        std::cout.width(16); std::cout << medianOf(scalarMs) * 1e6 / tests;
+        std::cout.width(14); std::cout << medianOf(simdMs) * 1e6 / tests;
+        std::cout.width(9); std::cout << medianOf(scalarMs) / std::max(medianOf(simdMs), 1e-6) << "x";
+        std::cout.width(9); std::cout << 100 * clamped / runs << "%";
+        std::cout.width(12); std::cout << (identical ? "yes" : "NO") << "\n";
+        if (!identical) return 1;
+    }
+
+    // Capsule sweep: rayRoundedBox on every box vs the SIMD slab pass with
+    // scalar edge / corner tests (sweepCapsuleBoxes), per box tested
+    std::cout << "\nCapsule sweep: scalar rounded boxes vs " << (gCpuAvx ? "AVX" : "SSE")
+        << " slabs, every box tested per move\n"
+        << "      boxes   scalar ns/box   SIMD ns/box   speedup   contact   identical\n";
+    const int sweepSizes[] = { 16, 64, 256, 4096 };
+    for (int n : sweepSizes) {
+        uint32_t state = 99u + n;
+        auto rnd = [&state]() {
+            state = state * 1664525u + 1013904223u;
+            return (state >> 8) * (1.0f / 16777216.0f);
+        };
+        // crates, steps and low ceilings around the walker
+        float half = sqrtf((float)n) * 1.5f;
+        std::vector<AABB> boxes(n);
+        for (AABB& b : boxes) {
+            glm::vec3 c(rnd() * 2.0f * half - half, rnd() * 3.0f, rnd() * 2.0f * half - half);
+            glm::vec3 e(0.2f + rnd(), 0.1f + rnd() * 0.5f, 0.2f + rnd());
+            b = AABB{ c - e, c + e };
+        }
+        BoxSoA soa;
+        soa.assign(boxes);
+        std::vector<float> entry;
+
+        int runs = std::max(200, 4000000 / n);
+        std::vector<glm::vec3> starts(runs), deltas(runs);
+        for (int i = 0; i < runs; ++i) {
+            starts[i] = glm::vec3(rnd() * 2.0f * half - half, kEyeHeight + rnd() * 1.5f, rnd() * 2.0f * half - half);
+            float a = rnd() * 6.2831853f;
+            deltas[i] = glm::vec3(cosf(a) * 2.0f, (rnd() - 0.7f) * 2.0f, sinf(a) * 2.0f);
+        }
+        std::vector<float> scalarT(runs), simdT(runs);
+        std::vector<glm::vec3> scalarN(runs), simdN(runs);
+        std::vector<double> scalarMs, simdMs;
+        for (int rep = 0; rep < 5; ++rep) {
+            double t0 = nowMs();
+            for (int i = 0; i < runs; ++i) {
+                float best = -1.0f;
+                glm::vec3 normal(0.0f);
+                for (const AABB& b : boxes) {
+                    glm::vec3 nb;
+                    float t = rayRoundedBox(starts[i], deltas[i], capsuleLineBox(b), kPlayerRadius, nb);
+                    if (t >= 0.0f && (best < 0.0f || t < best)) { best = t; normal = nb; }
+                }
+                scalarT[i] = best;
+                scalarN[i] = normal;
+            }
+            scalarMs.push_back(nowMs() - t0);
+            t0 = nowMs();
+            for (int i = 0; i < runs; ++i) {
+                glm::vec3 normal(0.0f);
+                simdT[i] = sweepCapsuleBoxes(starts[i], deltas[i], soa,
+                    [&boxes](size_t k) -> const AABB& { return boxes[k]; }, entry, normal);
+                simdN[i] = normal;
+            }
+            simdMs.push_back(nowMs() - t0);
+        }
+        int contact = 0;
+        for (int i = 0; i < runs; ++i) contact += scalarT[i] >= 0.0f;
+        bool identical = memcmp(scalarT.data(), simdT.data(), runs * sizeof(float)) == 0 &&
+            memcmp(scalarN.data(), simdN.data(), runs * sizeof(glm::vec3)) == 0;
+        double tests = (double)runs * n;
+
+        std::cout.width(11); std::cout << n;
+        std::cout.width(16); std::cout << medianOf(scalarMs) * 1e6 / tests;
+        std::cout.width(14); std::cout << medianOf(simdMs) * 1e6 / tests;
+        std::cout.width(9); std::cout << medianOf(scalarMs) / std::max(medianOf(simdMs), 1e-6) << "x";
+        std::cout.width(9); std::cout << 100 * contact / runs << "%";
+        std::cout.width(12); std::cout << (identical ? "yes" : "NO") << "\n";
+        if (!identical) return 1;
+    }
+    return 0;
 }
-)";
 
-GLuint gObjProg = 0;
-GLint  gObjMVP = -1;
-GLint  gObjTex = -1;
+// Rays/second through the BVH (one thread and pooled) against the linear
+// rayAABB loop, over static level boxes plus a refit crowd.
+int benchRaycastTool(int rayCount, int boxCount) {
+    uint32_t state = 2024u;
+    auto rnd = [&state]() {
+        state = state * 1664525u + 1013904223u;
+        return (state >> 8) * (1.0f / 16777216.0f);
+    };
+    const float half = 150.0f;
+    std::vector<LevelBox> level;
+    buildLevel(level);
+    std::vector<AABB> statics;
+    for (const LevelBox& b : level) statics.push_back(b.box);
+    while ((int)statics.size() < boxCount) {
+        glm::vec3 c(rnd() * 2.0f * half - half, rnd() * 3.0f, rnd() * 2.0f * half - half);
+        glm::vec3 e(0.3f + rnd() * 1.5f, 0.3f + rnd() * 1.5f, 0.3f + rnd() * 1.5f);
+        statics.push_back(AABB{ c - e, c + e });
+    }
+    std::vector<ModelInstance> crowd;
+    spawnCrowd(crowd, 1000, 0.0f, half, 99u);
+    std::vector<AABB> dynamics(crowd.size());
+    auto placeCrowd = [&](float time) {
+        for (size_t i = 0; i < crowd.size(); ++i) {
+            glm::vec3 p = glm::vec3(crowd[i].model[3]) + glm::vec3(sinf(time + i), 0.0f, cosf(time + i)) * 0.5f;
+            dynamics[i] = AABB{ p - glm::vec3(0.4f, 0.0f, 0.4f), p + glm::vec3(0.4f, 1.9f, 0.4f) };
+        }
+    };
+    placeCrowd(0.0f);
+
+    double t0 = nowMs();
+    Bvh4 staticBvh;
+    staticBvh.build(statics);
+    double buildMs = nowMs() - t0;
+    Bvh4 dynamicBvh;
+    dynamicBvh.build(dynamics);
+    std::vector<double> refitMs;
+    for (int f = 1; f <= 30; ++f) {
+        placeCrowd(f / 60.0f);
+        t0 = nowMs();
+        dynamicBvh.refit(dynamics);
+        refitMs.push_back(nowMs() - t0);
+    }
 
-// ---------- Collision resolution in XZ ----------
-void resolveXZ(const glm::vec3& oldPos, glm::vec3& newPos,
-    const std::vector<AABB>& boxes, float radius)
-{
-    glm::vec3 tmp = newPos;
+    std::vector<Ray> rays(rayCount);
+    for (Ray& r : rays) {
+        r.origin = glm::vec3(rnd() * 2.0f * half - half, 0.5f + rnd() * 2.0f, rnd() * 2.0f * half - half);
+        float a = rnd() * 6.2831853f;
+        r.dir = glm::normalize(glm::vec3(cosf(a), rnd() * 0.2f - 0.1f, sinf(a)));
+        r.maxT = 100.0f;
+    }
 
-    float dx = newPos.x - oldPos.x;
-    for (const auto& b : boxes) {
-        float minX = b.min.x - radius, maxX = b.max.x + radius;
-        float minZ = b.min.z - radius, maxZ = b.max.z + radius;
+    // linear loop over a subset: it is far slower
+    std::vector<AABB> all = statics;
+    all.insert(all.end(), dynamics.begin(), dynamics.end());
+    size_t linearCount = std::min<size_t>(rays.size(), 20000);
+    std::vector<RayHit> linear(linearCount);
+    t0 = nowMs();
+    for (size_t i = 0; i < linearCount; ++i) linear[i] = raycastLinear(all, rays[i]);
+    double linearMs = nowMs() - t0;
+
+    std::vector<RayHit> hitsS(rays.size()), hitsD(rays.size());
+    auto nearest = [&](size_t i) {
+        const RayHit& s = hitsS[i];
+        const RayHit& d = hitsD[i];
+        RayHit h = s;
+        if (d.index >= 0 && d.t < s.t) { h = d; h.index += (int32_t)statics.size(); }
+        return h;
+    };
+    t0 = nowMs();
+    staticBvh.raycast(rays.data(), rays.size(), hitsS.data());
+    dynamicBvh.raycast(rays.data(), rays.size(), hitsD.data());
+    double bvhMs = nowMs() - t0;
+
+    WorkerPool pool;
+    unsigned int hw = std::thread::hardware_concurrency();
+    pool.start(hw > 2 ? hw - 1 : 2);
+    const size_t batch = 1024;
+    t0 = nowMs();
+    parallelFor(pool, (int)((rays.size() + batch - 1) / batch), [&](int b) {
+        size_t first = b * batch, n = std::min(batch, rays.size() - first);
+        staticBvh.raycast(&rays[first], n, &hitsS[first]);
+        dynamicBvh.raycast(&rays[first], n, &hitsD[first]);
+    });
+    double pooledMs = nowMs() - t0;
+    pool.stop();
+
+    size_t mismatches = 0, hits = 0;
+    for (size_t i = 0; i < linearCount; ++i) {
+        RayHit h = nearest(i);
+        hits += h.index >= 0;
+        bool agree = (h.index < 0) == (linear[i].index < 0) &&
+            (h.index < 0 || fabsf(h.t - linear[i].t) <= 1e-4f * std::max(1.0f, h.t));
+        if (!agree) ++mismatches;
+    }
 
-        if (tmp.z > minZ && tmp.z < maxZ) {
-            if (dx > 0 && oldPos.x <= minX && tmp.x > minX) tmp.x = minX;
-            if (dx < 0 && oldPos.x >= maxX && tmp.x < maxX) tmp.x = maxX;
+    auto perSec = [](size_t n, double ms) { return n / std::max(ms, 1e-6) * 1000.0; };
+    std::cout << "\nRaycast benchmark: " << statics.size() << " static + " << dynamics.size()
+        << " dynamic boxes, " << rays.size() << " rays of 100 m\n"
+        << "  BVH4 build " << buildMs << " ms (" << staticBvh.nodes.size() << " nodes), crowd refit median "
+        << medianOf(refitMs) << " ms\n"
+        << "  linear rayAABB:  " << perSec(linearCount, linearMs) << " rays/s\n"
+        << "  BVH4, 1 thread:  " << perSec(rays.size(), bvhMs) << " rays/s ("
+        << linearMs / linearCount / std::max(bvhMs / rays.size(), 1e-9) << "x)\n"
+        << "  BVH4, pooled:    " << perSec(rays.size(), pooledMs) << " rays/s\n"
+        << "  checked " << linearCount << " rays against linear: " << hits << " hits, "
+        << mismatches << " mismatches\n";
+    return mismatches ? 1 : 0;
+}
+
+// Builds a triangle collider for a generated level (rolling ground plus
+// box buildings) of about the given size, then times ray, capsule overlap
+// and capsule sweep queries. Rays are checked against a brute-force loop.
+int benchTriMeshTool(int triangles) {
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+    const int buildings = 400;
+    int side = std::max(2, (int)sqrtf(std::max(0, triangles - buildings * 10) / 2.0f));
+    const float spacing = 1.0f, half = side * spacing * 0.5f;
+    for (int z = 0; z <= side; ++z) {
+        for (int x = 0; x <= side; ++x) {
+            float wx = x * spacing - half, wz = z * spacing - half;
+            positions.push_back(glm::vec3(wx, (terrainFbm(wx / 120.0f, wz / 120.0f) - 0.5f) * 20.0f, wz));
+        }
+    }
+    for (int z = 0; z < side; ++z) {
+        for (int x = 0; x < side; ++x) {
+            uint32_t a = z * (side + 1) + x, b = a + 1, c = a + side + 1, d = c + 1;
+            indices.insert(indices.end(), { a, c, b, b, c, d });
+        }
+    }
+    uint32_t state = 31337u;
+    auto rnd = [&state]() {
+        state = state * 1664525u + 1013904223u;
+        return (state >> 8) * (1.0f / 16777216.0f);
+    };
+    for (int i = 0; i < buildings; ++i) {
+        glm::vec3 c(rnd() * 2.0f * half - half, 0.0f, rnd() * 2.0f * half - half);
+        c.y = (terrainFbm(c.x / 120.0f, c.z / 120.0f) - 0.5f) * 20.0f;
+        glm::vec3 mn = c - glm::vec3(2.0f + rnd() * 6.0f, 2.0f, 2.0f + rnd() * 6.0f);
+        glm::vec3 mx = c + glm::vec3(2.0f + rnd() * 6.0f, 4.0f + rnd() * 12.0f, 2.0f + rnd() * 6.0f);
+        uint32_t base = (uint32_t)positions.size();
+        for (int k = 0; k < 8; ++k) positions.push_back(boxCorner(mn, mx, k));
+        for (int f = 0; f < 6; ++f) {
+            const int* q = kBoxFaces[f];
+            if (!((q[0] | q[1] | q[2] | q[3]) & 2)) continue;     // no floor
+            indices.insert(indices.end(), { base + q[0], base + q[1], base + q[2], base + q[0], base + q[2], base + q[3] });
         }
     }
 
-    float dz = newPos.z - oldPos.z;
-    glm::vec3 tmp2 = tmp;
-    for (const auto& b : boxes) {
-        float minX = b.min.x - radius, maxX = b.max.x + radius;
-        float minZ = b.min.z - radius, maxZ = b.max.z + radius;
+    double t0 = nowMs();
+    CollisionMesh mesh;
+    mesh.build(positions, indices);
+    double buildMs = nowMs() - t0;
+    std::cout << "\nTriangle mesh collider: " << mesh.tris.size() << " triangles, built in " << buildMs << " ms, "
+        << mesh.nodes.size() << " nodes, " << (mesh.memoryBytes() >> 20) << " MB\n";
+
+    const int queries = 100000;
+    auto groundPoint = [&]() {
+        glm::vec3 p(rnd() * 1.8f * half - 0.9f * half, 0.0f, rnd() * 1.8f * half - 0.9f * half);
+        p.y = (terrainFbm(p.x / 120.0f, p.z / 120.0f) - 0.5f) * 20.0f;
+        return p;
+    };
 
-        if (tmp2.x > minX && tmp2.x < maxX) {
-            if (dz > 0 && oldPos.z <= minZ && tmp2.z > minZ) tmp2.z = minZ;
-            if (dz < 0 && oldPos.z >= maxZ && tmp2.z < maxZ) tmp2.z = maxZ;
+    // rays: half straight down from above, half level at chest height
+    std::vector<glm::vec3> origins(queries), dirs(queries);
+    for (int i = 0; i < queries; ++i) {
+        origins[i] = groundPoint() + glm::vec3(0.0f, i & 1 ? 50.0f : 1.5f, 0.0f);
+        float a = rnd() * 6.2831853f;
+        dirs[i] = i & 1 ? glm::vec3(0.0f, -1.0f, 0.0f) : glm::vec3(cosf(a), 0.0f, sinf(a));
+    }
+    std::vector<MeshHit> hits(queries);
+    t0 = nowMs();
+    for (int i = 0; i < queries; ++i) mesh.raycast(origins[i], dirs[i], 100.0f, hits[i]);
+    double rayMs = nowMs() - t0;
+    int mismatches = 0;
+    const int checked = 200;
+    for (int i = 0; i < checked; ++i) {
+        float best = 100.0f;
+        bool any = false;
+        for (const CollisionTri& tri : mesh.tris) {
+            float t = rayTriangle(origins[i], dirs[i], tri.v0, tri.e1, tri.e2, 0.0f, best);
+            if (t >= 0.0f) { best = t; any = true; }
         }
+        bool hit = hits[i].triangle >= 0;
+        if (hit != any || (hit && fabsf(best - hits[i].t) > 1e-4f)) ++mismatches;
     }
 
-    newPos = tmp2;
+    // capsules standing on the ground, player sized
+    std::vector<MeshContact> contacts;
+    std::vector<glm::vec3> feet(queries);
+    for (glm::vec3& f : feet) f = groundPoint();
+    t0 = nowMs();
+    size_t touching = 0;
+    for (int i = 0; i < queries; ++i) {
+        contacts.clear();
+        touching += mesh.overlapCapsule(feet[i] + glm::vec3(0.0f, 0.35f, 0.0f), feet[i] + glm::vec3(0.0f, 1.5f, 0.0f),
+            kPlayerRadius, contacts);
+    }
+    double overlapMs = nowMs() - t0;
+
+    // one walking tick with gravity, from just above the ground
+    t0 = nowMs();
+    int blocked = 0;
+    for (int i = 0; i < queries; ++i) {
+        glm::vec3 a = feet[i] + glm::vec3(0.0f, kPlayerRadius + 0.3f, 0.0f), b = a + glm::vec3(0.0f, 1.1f, 0.0f);
+        float ang = rnd() * 6.2831853f;
+        glm::vec3 n;
+        blocked += mesh.sweepCapsule(a, b, kPlayerRadius, glm::vec3(cosf(ang) * 0.5f, -0.5f, sinf(ang) * 0.5f), n) >= 0.0f;
+    }
+    double sweepMs = nowMs() - t0;
+
+    auto perSec = [](int n, double ms) { return n / std::max(ms, 1e-6) * 1000.0; };
+    std::cout << "  rays:     " << perSec(queries, rayMs) << " /s (" << rayMs * 1000.0 / queries << " us), "
+        << checked << " checked against brute force, " << mismatches << " mismatches\n"
+        << "  overlaps: " << perSec(queries, overlapMs) << " /s (" << overlapMs * 1000.0 / queries << " us), "
+        << (double)touching / queries << " contacts per capsule\n"
+        << "  sweeps:   " << perSec(queries, sweepMs) << " /s (" << sweepMs * 1000.0 / queries << " us), "
+        << 100 * blocked / queries << "% hit something\n";
+    return mismatches ? 1 : 0;
 }
 
-// ---------- Movement with jump + gravity + NPC collision ----------
-void processMovement(float dt, const std::vector<AABB>& boxes) {
-    float speed = gCam.moveSpeed;
-    if (glfwGetKey(gWindow, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS ||
-        glfwGetKey(gWindow, GLFW_KEY_RIGHT_SHIFT) == GLFW_PRESS) {
-        speed *= gCam.sprintMult;
+int benchNavMeshTool(int requests) {
+    TerrainMap map;
+    if (!map.open(kTerrainPath) && !map.generate(kTerrainPath)) return 1;
+    std::vector<LevelBox> level;
+    buildLevel(level);
+    std::vector<AABB> boxes;
+    boxes.push_back(AABB{ gNPC.pos - gNPC.half, gNPC.pos + gNPC.half });
+    for (const LevelBox& b : level) boxes.push_back(b.box);
+
+    std::cout << "\n";
+    double t0 = nowMs();
+    NavMesh nav;
+    nav.build(boxes, map);
+    double buildMs = nowMs() - t0;
+    const std::string cooked = std::string(kNavPath) + ".bench";
+    if (!nav.save(cooked)) return 1;
+    t0 = nowMs();
+    NavMesh loaded;
+    bool ok = loaded.load(cooked, NavMesh::hashInputs(boxes, map));
+    double loadMs = nowMs() - t0;
+    std::remove(cooked.c_str());
+    if (!ok || loaded.polys.size() != nav.polys.size() || loaded.cellPoly != nav.cellPoly) {
+        std::cerr << "Navmesh round trip failed\n";
+        return 1;
     }
+    std::cout << "  build " << buildMs << " ms, load " << loadMs << " ms\n";
+
+    // patrol-like traffic: trips between a fixed set of posts, so pairs repeat
+    std::vector<glm::vec3> posts(48);
+    for (size_t i = 0; i < posts.size(); ++i) posts[i] = nav.randomPoint((uint32_t)i * 2654435761u + 1u, glm::vec2(60.0f));
+    uint32_t state = 4242u;
+    auto pick = [&]() {
+        state = state * 1664525u + 1013904223u;
+        return posts[(state >> 8) % posts.size()];
+    };
 
-    glm::vec3 f{ cosf(glm::radians(gCam.yaw)), 0.0f, sinf(glm::radians(gCam.yaw)) };
-    f = glm::normalize(f);
-    glm::vec3 r = glm::normalize(glm::cross(f, glm::vec3(0, 1, 0)));
+    WorkerPool pool;
+    unsigned int hw = std::thread::hardware_concurrency();
+    pool.start(hw > 2 ? hw - 1 : 2);
+    PathService paths;
+    paths.init(loaded, pool);
+
+    // burst: everything queued at once, for throughput
+    std::vector<double> workerMs;
+    workerMs.reserve(requests);
+    int found = 0;
+    t0 = nowMs();
+    for (int i = 0; i < requests; ++i) {
+        paths.request(pick(), pick(), [&](PathResult& r) {
+            found += r.found;
+            workerMs.push_back(r.ms);
+        });
+    }
+    while (paths.inFlight > 0) {
+        paths.pump();
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    double wallMs = nowMs() - t0;
+    std::cout << "  burst of " << requests << " on " << (hw > 2 ? hw - 1 : 2) << " workers: "
+        << requests / std::max(wallMs, 1e-6) * 1000.0 << " paths/s, " << found << " found, "
+        << 100.0 * paths.cacheHits / std::max(1LL, (long long)paths.requests) << "% corridor cache hits, "
+        << medianOf(workerMs) << " ms worker time per path (median)\n";
+
+    // paced: 10 requests per 60 Hz frame, as the game would issue them
+    const int perFrame = 10, paced = 120;
+    std::vector<double> latencyMs, frameMs;
+    int pacedFound = 0;
+    for (int f = 0; f < paced || paths.inFlight > 0; ++f) {
+        double frameStart = nowMs();
+        if (f < paced) {
+            for (int i = 0; i < perFrame; ++i) {
+                paths.request(pick(), pick(), [&, frameStart](PathResult& r) {
+                    pacedFound += r.found;
+                    latencyMs.push_back(nowMs() - frameStart);
+                });
+            }
+        }
+        paths.pump();
+        frameMs.push_back(nowMs() - frameStart);
+        std::this_thread::sleep_until(std::chrono::steady_clock::now() +
+            std::chrono::microseconds((long long)((16.667 - (nowMs() - frameStart)) * 1000.0)));
+    }
+    pool.stop();
+    std::cout << "  paced " << perFrame * 60 << " paths/s: latency " << medianOf(latencyMs) << " ms median, "
+        << "main thread " << medianOf(frameMs) * 1000.0 << " us per frame (request + pump), "
+        << pacedFound << "/" << paced * perFrame << " found\n";
+    return found == requests && pacedFound == paced * perFrame ? 0 : 1;
+}
 
-    glm::vec3 vel(0);
-    if (glfwGetKey(gWindow, GLFW_KEY_W) == GLFW_PRESS) vel += f;
-    if (glfwGetKey(gWindow, GLFW_KEY_S) == GLFW_PRESS) vel -= f;
-    if (glfwGetKey(gWindow, GLFW_KEY_A) == GLFW_PRESS) vel -= r;
-    if (glfwGetKey(gWindow, GLFW_KEY_D) == GLFW_PRESS) vel += r;
-    if (glm::length(vel) > 0) vel = glm::normalize(vel) * speed;
+int benchFlowFieldTool(int agents) {
+    TerrainMap map;
+    if (!map.open(kTerrainPath) && !map.generate(kTerrainPath)) return 1;
+    std::vector<LevelBox> level;
+    buildLevel(level);
+    std::vector<AABB> boxes;
+    boxes.push_back(AABB{ gNPC.pos - gNPC.half, gNPC.pos + gNPC.half });
+    for (const LevelBox& b : level) boxes.push_back(b.box);
+    std::cout << "\n";
+    NavMesh nav;
+    nav.build(boxes, map);
+
+    uint32_t state = 777u;
+    auto rnd = [&state]() {
+        state = state * 1664525u + 1013904223u;
+        return (state >> 8) * (1.0f / 16777216.0f);
+    };
+    auto walkablePoint = [&]() {                 // inside the walls
+        for (;;) {
+            glm::vec3 p(rnd() * 88.0f - 44.0f, 0.0f, rnd() * 88.0f - 44.0f);
+            if (nav.findCell(p, 0) >= 0) return p;
+        }
+    };
+    std::vector<glm::vec3> pos(agents);
+    for (glm::vec3& p : pos) p = walkablePoint();
+
+    // one full pass, then the cost of the same goal again
+    FlowFieldCache flow;
+    flow.init(nav);
+    glm::vec3 goal(0.0f, 0.0f, 10.0f);
+    double t0 = nowMs();
+    flow.setGoal(goal);
+    flow.update(INT32_MAX);
+    double fullMs = nowMs() - t0;
+    std::cout << "  full field " << nav.width << "x" << nav.depth << ": " << fullMs << " ms, "
+        << (flow.memoryBytes() >> 10) << " KB cached\n";
+
+    // every reached cell must point at a walkable neighbour (no cut
+    // corners) with a lower cost, or agents walk into walls or in circles
+    auto badDirections = [&nav](const FlowField& f) {
+        int bad = 0;
+        for (int32_t cell = 0; cell < nav.width * nav.depth; ++cell) {
+            if (cell == f.goalCell || f.cost[cell] >= 1e30f) continue;
+            uint8_t k = f.dir[cell];
+            int x = cell % nav.width, z = cell / nav.width;
+            int nx = x + (k < 8 ? kFlowDx[k] : 0), nz = z + (k < 8 ? kFlowDz[k] : 0);
+            bool ok = k < 8 && nx >= 0 && nz >= 0 && nx < nav.width && nz < nav.depth &&
+                nav.cellPoly[nz * nav.width + nx] >= 0 && f.cost[nz * nav.width + nx] < f.cost[cell] &&
+                (k < 4 || (nav.cellPoly[z * nav.width + nx] >= 0 && nav.cellPoly[nz * nav.width + x] >= 0));
+            bad += !ok;
+        }
+        return bad;
+    };
+    int badDirs = badDirections(flow.fields[flow.current]);
+    std::cout << "  directions: " << badDirs << " cells not leading downhill\n";
+
+    // the old way: one A* + funnel per agent towards the same goal
+    PathService paths;
+    paths.nav = &nav;
+    t0 = nowMs();
+    int found = 0;
+    for (int i = 0; i < agents; ++i) {
+        PathResult r;
+        paths.solve(pos[i], goal, r);
+        found += r.found;
+    }
+    double astarMs = nowMs() - t0;
+    std::cout << "  A* per agent: " << astarMs << " ms for " << agents << " (" << found << " found, "
+        << 100.0 * paths.cacheHits / agents << "% corridor cache hits)\n";
+
+    // simulate: the goal walks around the block for 20 s, then waits for everyone
+    const float dt = 1.0f / 60.0f;
+    const int ticks = 3600;
+    std::vector<double> steerMs, stepMs;
+    int arrived = 0;
+    long long blockedSteps = 0;
+    t0 = nowMs();
+    for (int t = 0; t < ticks; ++t) {
+        if (t % 120 == 0 && t > 0 && t <= 1200) {
+            float a = t * 0.01f;
+            goal = glm::vec3(cosf(a) * 20.0f, 0.0f, sinf(a) * 20.0f + 10.0f);
+            if (t % 480 == 0) goal = glm::vec3(0.0f, 0.0f, 10.0f);     // back to a cached cell
+        }
+        double s0 = nowMs();
+        flow.setGoal(goal);
+        flow.update();
+        stepMs.push_back(nowMs() - s0);
+
+        s0 = nowMs();
+        glm::vec2 g = flow.goal();
+        arrived = 0;
+        for (int i = 0; i < agents; ++i) {
+            glm::vec3& p = pos[i];
+            if (glm::length(g - glm::vec2(p.x, p.z)) < kFlowArriveRadius) { ++arrived; continue; }
+            // raw steps, as the patrols take them: no collision to hide a bad field
+            glm::vec2 d = flow.steer(p) * (kAlarmSpeed * dt);
+            p.x += d.x;
+            p.z += d.y;
+            blockedSteps += nav.findCell(p, 0) < 0;
+        }
+        if (t < 1200) steerMs.push_back(nowMs() - s0);        // while everyone is still running
+    }
+    double simMs = nowMs() - t0;
+    for (const FlowField& f : flow.fields)
+        if (f.complete) badDirs += badDirections(f);
+    std::sort(stepMs.begin(), stepMs.end());
+    std::cout << "  " << ticks << " ticks, " << agents << " agents: steering " << medianOf(steerMs) << " ms median ("
+        << medianOf(steerMs) * 1e6 / agents << " ns per agent), field step " << medianOf(stepMs) << " ms median, "
+        << stepMs.back() << " ms worst\n"
+        << "  goal changes " << flow.hits + flow.misses << " (" << flow.hits << " from cache), "
+        << arrived << "/" << agents << " at the goal after " << ticks * dt << " s, total " << simMs << " ms\n"
+        << "  " << blockedSteps << " steps into blocked cells, " << badDirs << " bad directions across the cache\n";
+    return arrived > agents * 9 / 10 && !blockedSteps && !badDirs ? 0 : 1;
+}
 
-    glm::vec3 oldPos = gCam.pos;
-    glm::vec3 newPos = oldPos + vel * dt;
+// CPU-only: scripted walks through moveCapsule against known geometry,
+// one line per case. The ground is a floor box here, not the terrain.
+int checkCapsuleTool() {
+    struct Walker {
+        glm::vec3 pos;                      // eye
+        float velY = 0.0f;
+        bool grounded = false;
+    };
+    auto tick = [](ColliderGrid& grid, Walker& w, const glm::vec3& vel, float dt) {
+        w.velY += kGravity * dt;
+        w.pos = moveCapsule(w.pos, glm::vec3(vel.x * dt, w.velY * dt, vel.z * dt), grid, w.grounded, w.velY);
+    };
+    auto feet = [](const Walker& w) { return w.pos.y - kEyeHeight; };
+    auto standing = [](float x, float z, float ground) { Walker w; w.pos = glm::vec3(x, ground + kEyeHeight, z); return w; };
+    // deepest overlap of the capsule (radius r around its centre line) with any box
+    auto penetration = [](const std::vector<AABB>& boxes, const glm::vec3& eye) {
+        const float r = kPlayerRadius;
+        glm::vec3 a = eye + glm::vec3(0.0f, -kEyeHeight + r, 0.0f), b = eye + glm::vec3(0.0f, kPlayerHeadroom - r, 0.0f);
+        float worst = 0.0f;
+        for (const AABB& box : boxes) {
+            // the centre line is vertical: the closest point pair is found per height
+            float y = glm::clamp((box.min.y + box.max.y) * 0.5f, a.y, b.y);
+            y = glm::clamp(y, std::max(a.y, std::min(b.y, box.min.y)), std::min(b.y, std::max(a.y, box.max.y)));
+            glm::vec3 p(eye.x, y, eye.z);
+            float d = glm::length(p - glm::clamp(p, box.min, box.max));
+            worst = std::max(worst, r - d);
+        }
+        return worst;
+    };
+    const AABB floor{ glm::vec3(-50.0f, -1.0f, -50.0f), glm::vec3(50.0f, 0.0f, 50.0f) };
+    const float tolerance = 2e-3f;
+
+    int failed = 0;
+    auto result = [&failed](const std::string& name, bool ok, const std::string& detail) {
+        std::cout << "  " << (ok ? "pass  " : "FAIL  ") << name;
+        for (size_t k = name.size(); k < 34; ++k) std::cout << ' ';
+        std::cout << detail << "\n";
+        failed += !ok;
+    };
+    auto fmt = [](const char* label, float v) {
+        std::ostringstream s;
+        s.precision(3);
+        s << std::fixed << label << " " << v << "  ";
+        return s.str();
+    };
 
-    if (gGrounded && glfwGetKey(gWindow, GLFW_KEY_SPACE) == GLFW_PRESS) {
-        gVelY = kJumpSpeed;
-        gGrounded = false;
+    std::cout << "\nCapsule controller checks (radius " << kPlayerRadius << ", eye " << kEyeHeight << ")\n";
+
+    // Tunnelling: 10 m/s into a 5 cm wall, from 60 Hz up to a 2 s frame
+    {
+        std::vector<AABB> boxes = { floor, AABB{ glm::vec3(5.0f, 0.0f, -10.0f), glm::vec3(5.05f, 3.0f, 10.0f) } };
+        ColliderGrid grid;
+        grid.build(boxes);
+        const float dts[] = { 1.0f / 60.0f, 0.1f, 0.5f, 2.0f };
+        for (float dt : dts) {
+            Walker w = standing(0.0f, 0.0f, 0.0f);
+            float maxX = w.pos.x;
+            for (float t = 0.0f; t < 4.0f; t += dt) {
+                tick(grid, w, glm::vec3(10.0f, 0.0f, 0.0f), dt);
+                maxX = std::max(maxX, w.pos.x);
+            }
+            std::ostringstream name;
+            name << "thin wall, dt " << dt << " s";
+            result(name.str(), maxX + kPlayerRadius <= 5.0f + tolerance && feet(w) > -tolerance,
+                fmt("max x", maxX) + fmt("feet", feet(w)));
+        }
     }
 
-    gVelY += kGravity * dt;
-    newPos.y += gVelY * dt;
+    // Sliding: 45 degrees into a wall keeps the tangential part of the move
+    {
+        std::vector<AABB> boxes = { floor, AABB{ glm::vec3(5.0f, 0.0f, -20.0f), glm::vec3(6.0f, 3.0f, 20.0f) } };
+        ColliderGrid grid;
+        grid.build(boxes);
+        Walker w = standing(4.0f, 0.0f, 0.0f);
+        glm::vec3 vel = glm::normalize(glm::vec3(1.0f, 0.0f, 1.0f)) * 4.0f;
+        float worst = 0.0f;
+        for (int i = 0; i < 120; ++i) {
+            tick(grid, w, vel, 1.0f / 60.0f);
+            worst = std::max(worst, penetration(boxes, w.pos));
+        }
+        result("wall slide at 45 degrees", worst <= tolerance && w.pos.z > 0.95f * vel.z * 2.0f,
+            fmt("z", w.pos.z) + fmt("of", vel.z * 2.0f) + fmt("overlap", worst));
+    }
 
-    float feetY = newPos.y - kEyeHeight;
-    if (feetY < 0.0f) {
-        newPos.y = kEyeHeight;
-        gVelY = 0.0f;
-        gGrounded = true;
+    // Corners: wedged into an inside corner; deflected round an outside one
+    {
+        std::vector<AABB> boxes = { floor, AABB{ glm::vec3(5.0f, 0.0f, -5.0f), glm::vec3(6.0f, 3.0f, 6.0f) },
+            AABB{ glm::vec3(-5.0f, 0.0f, 5.0f), glm::vec3(6.0f, 3.0f, 6.0f) } };
+        ColliderGrid grid;
+        grid.build(boxes);
+        Walker w = standing(0.0f, 0.0f, 0.0f);
+        float worst = 0.0f;
+        for (int i = 0; i < 240; ++i) {
+            tick(grid, w, glm::vec3(3.0f, 0.0f, 2.0f), 1.0f / 60.0f);
+            worst = std::max(worst, penetration(boxes, w.pos));
+        }
+        float corner = 5.0f - kPlayerRadius;
+        result("inside corner", worst <= tolerance && w.pos.x > corner - 0.05f && w.pos.z > corner - 0.05f,
+            fmt("x", w.pos.x) + fmt("z", w.pos.z) + fmt("overlap", worst));
     }
-    else {
-        gGrounded = false;
+    {
+        std::vector<AABB> boxes = { floor, AABB{ glm::vec3(2.0f, 0.0f, -3.0f), glm::vec3(4.0f, 3.0f, 0.2f) } };
+        ColliderGrid grid;
+        grid.build(boxes);
+        Walker w = standing(0.0f, 0.5f, 0.0f);
+        float worst = 0.0f;
+        for (int i = 0; i < 180; ++i) {
+            tick(grid, w, glm::vec3(4.0f, 0.0f, 0.0f), 1.0f / 60.0f);
+            worst = std::max(worst, penetration(boxes, w.pos));
+        }
+        result("outside corner, 10 cm overlap", worst <= tolerance && w.pos.x > 5.0f,
+            fmt("x", w.pos.x) + fmt("z", w.pos.z) + fmt("overlap", worst));
     }
 
-    const float playerRadius = 0.4f;
-    resolveXZ(oldPos, newPos, boxes, playerRadius);
+    // Steps: the rounded bottom rides over a kerb, a knee-high ledge stops it
+    {
+        const float heights[] = { 0.1f, 0.6f };
+        for (float h : heights) {
+            std::vector<AABB> boxes = { floor, AABB{ glm::vec3(3.0f, 0.0f, -5.0f), glm::vec3(8.0f, h, 5.0f) } };
+            ColliderGrid grid;
+            grid.build(boxes);
+            Walker w = standing(0.0f, 0.0f, 0.0f);
+            float worst = 0.0f;
+            for (int i = 0; i < 120; ++i) {
+                tick(grid, w, glm::vec3(4.0f, 0.0f, 0.0f), 1.0f / 60.0f);
+                worst = std::max(worst, penetration(boxes, w.pos));
+            }
+            bool climbs = h < 0.2f;
+            bool ok = worst <= tolerance && (climbs ? w.pos.x > 5.0f && fabsf(feet(w) - h) < 0.05f && w.grounded
+                : w.pos.x + kPlayerRadius <= 3.0f + tolerance && feet(w) < 0.05f);
+            std::ostringstream name;
+            name << (climbs ? "kerb " : "ledge ") << h << " m " << (climbs ? "climbed" : "blocks");
+            result(name.str(), ok, fmt("x", w.pos.x) + fmt("feet", feet(w)) + fmt("overlap", worst));
+        }
+    }
 
-    gCam.pos = newPos;
+    // Slopes: triangle ramps up +x; walkable below kMaxSlopeCos, a wall above
+    {
+        const float degrees[] = { 20.0f, 60.0f };
+        for (float deg : degrees) {
+            float rise = 10.0f * tanf(glm::radians(deg));
+            std::vector<glm::vec3> positions = { glm::vec3(2.0f, 0.0f, -5.0f), glm::vec3(12.0f, rise, -5.0f),
+                glm::vec3(12.0f, rise, 5.0f), glm::vec3(2.0f, 0.0f, 5.0f) };
+            std::vector<uint32_t> indices = { 0, 2, 1, 0, 3, 2 };
+            CollisionMesh ramp;
+            ramp.build(positions, indices);
+            gMeshColliders.push_back(PlacedCollisionMesh{ &ramp, glm::vec3(0.0f) });
+            std::vector<AABB> boxes = { floor };
+            ColliderGrid grid;
+            grid.build(boxes);
+            Walker w = standing(0.0f, 0.0f, 0.0f);
+            int groundedTicks = 0;
+            for (int i = 0; i < 120; ++i) {
+                tick(grid, w, glm::vec3(4.0f, 0.0f, 0.0f), 1.0f / 60.0f);
+                groundedTicks += w.grounded;
+            }
+            gMeshColliders.pop_back();
+            float surface = glm::clamp((w.pos.x - 2.0f) / 10.0f, 0.0f, 1.0f) * rise;
+            bool walkable = cosf(glm::radians(deg)) >= kMaxSlopeCos;
+            bool ok = walkable ? feet(w) > 1.5f && feet(w) > surface - 0.05f && groundedTicks > 100
+                : feet(w) < 0.6f && feet(w) > -tolerance;
+            std::ostringstream name;
+            name << deg << " degree ramp " << (walkable ? "walked" : "blocks");
+            result(name.str(), ok, fmt("x", w.pos.x) + fmt("feet", feet(w)) + fmt("grounded", groundedTicks / 120.0f));
+        }
+    }
+
+    // Standing on a box top for 10 s: no sinking, no creeping, stays grounded
+    {
+        std::vector<AABB> boxes = { floor, AABB{ glm::vec3(-1.0f, 0.0f, -1.0f), glm::vec3(1.0f, 1.0f, 1.0f) } };
+        ColliderGrid grid;
+        grid.build(boxes);
+        Walker w = standing(0.0f, 0.0f, 1.0f);
+        glm::vec3 start = w.pos;
+        int groundedTicks = 0;
+        for (int i = 0; i < 600; ++i) {
+            tick(grid, w, glm::vec3(0.0f), 1.0f / 60.0f);
+            groundedTicks += w.grounded;
+        }
+        float drift = glm::length(w.pos - start);
+        result("standing on a box top", drift < 0.02f && groundedTicks == 600,
+            fmt("drift", drift) + fmt("grounded", groundedTicks / 600.0f));
+    }
+
+    // Ceiling: a jump under a low slab stops at it and falls back
+    {
+        std::vector<AABB> boxes = { floor, AABB{ glm::vec3(-2.0f, 2.2f, -2.0f), glm::vec3(2.0f, 2.5f, 2.0f) } };
+        ColliderGrid grid;
+        grid.build(boxes);
+        Walker w = standing(0.0f, 0.0f, 0.0f);
+        w.velY = kJumpSpeed;
+        float top = w.pos.y;
+        for (int i = 0; i < 120; ++i) {
+            tick(grid, w, glm::vec3(0.0f), 1.0f / 60.0f);
+            top = std::max(top, w.pos.y);
+        }
+        float head = top + kPlayerHeadroom;
+        result("jump into a ceiling", head <= 2.2f + tolerance && w.grounded && fabsf(feet(w)) < 0.05f,
+            fmt("head top", head) + fmt("feet", feet(w)));
+    }
+
+    std::cout << (failed ? "  " + std::to_string(failed) + " failed\n" : "  all passed\n");
+    return failed ? 1 : 0;
+}
+
+// Returns true if argv named a tool; exitCode is then the process result.
+bool runTool(int argc, char** argv, int& exitCode) {
+    std::string cmd = argv[1];
+    if (cmd == "--cook-mesh" && argc >= 4) {
+        exitCode = cookMeshTool(argv[2], argv[3]);
+        return true;
+    }
+    if (cmd == "--bench-mesh-load" && argc >= 3) {
+        exitCode = benchMeshLoadTool(argv[2], argc >= 4 ? std::max(1, atoi(argv[3])) : 10);
+        return true;
+    }
+    if (cmd == "--cook-texture" && argc >= 4) {
+        exitCode = cookTexture(argv[2], argv[3], argc >= 5 ? argv[4] : "auto") ? 0 : 1;
+        return true;
+    }
+    if (cmd == "--bench-streaming") {
+        exitCode = benchStreamingTool(argc >= 3 ? std::max(1, atoi(argv[2])) : 128,
+            argc >= 4 ? std::max(1, atoi(argv[3])) : 8);
+        return true;
+    }
+    if (cmd == "--bench-cull") {
+        exitCode = benchCullTool(argc >= 3 ? std::max(1, atoi(argv[2])) : 50000);
+        return true;
+    }
+    if (cmd == "--bench-occlusion") {
+        exitCode = benchOcclusionTool(argc >= 3 ? std::max(1, atoi(argv[2])) : 10000);
+        return true;
+    }
+    if (cmd == "--bench-terrain") {
+        exitCode = benchTerrainTool(argc >= 3 ? std::max(1, atoi(argv[2])) : 1500);
+        return true;
+    }
+    if (cmd == "--bench-collision") {
+        exitCode = benchCollisionTool(argc >= 3 ? std::max(1, atoi(argv[2])) : 4000);
+        return true;
+    }
+    if (cmd == "--bench-raycast") {
+        exitCode = benchRaycastTool(argc >= 3 ? std::max(1, atoi(argv[2])) : 200000,
+            argc >= 4 ? std::max(1, atoi(argv[3])) : 5000);
+        return true;
+    }
+    if (cmd == "--bench-trimesh") {
+        exitCode = benchTriMeshTool(argc >= 3 ? std::max(1, atoi(argv[2])) : 1000000);
+        return true;
+    }
+    if (cmd == "--check-capsule") {
+        exitCode = checkCapsuleTool();
+        return true;
+    }
+    if (cmd == "--bench-navmesh") {
+        exitCode = benchNavMeshTool(argc >= 3 ? std::max(1, atoi(argv[2])) : 20000);
+        return true;
+    }
+    if (cmd == "--bench-flowfield") {
+        exitCode = benchFlowFieldTool(argc >= 3 ? std::max(1, atoi(argv[2])) : 5000);
+        return true;
+    }
+    if (cmd == "--bench-crowd") {
+        exitCode = benchCrowdTool(argc >= 3 ? argv[2] : "assets/npc.obj",
+            argc >= 4 ? argv[3] : "assets/man_t256.png",
+            argc >= 5 ? std::max(1, atoi(argv[4])) : 120);
+        return true;
+    }
+    std::cerr << "Unknown or incomplete option: " << cmd << "\n"
+        << "  --cook-mesh <model> <out.esm>\n"
+        << "  --bench-mesh-load <model> [runs]\n"
+        << "  --cook-texture <image> <out.etx> [auto|rgba|bc1|bc3]\n"
+        << "  --bench-streaming [totalMB] [budgetMB]\n"
+        << "  --bench-crowd [model] [texture] [frames]\n"
+        << "  --bench-cull [objects]\n"
+        << "  --bench-occlusion [objects]\n"
+        << "  --bench-terrain [frames]\n"
+        << "  --bench-collision [moves]\n"
+        << "  --bench-raycast [rays] [boxes]\n"
+        << "  --bench-trimesh [triangles]\n"
+        << "  --check-capsule\n"
+        << "  --bench-navmesh [requests]\n"
+        << "  --bench-flowfield [agents]\n";
+    exitCode = 2;
+    return true;
 }
 
 // ---------- Main ----------
-int main() {
+int main(int argc, char** argv) {
+    int toolExit = 0;
+    if (argc > 1 && runTool(argc, argv, toolExit)) return toolExit;
+
     if (!glfwInit()) { std::cerr << "GLFW init failed\n"; return 1; }
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
@@ -747,36 +7867,97 @@ int main() {
     glViewport(0, 0, fbw, fbh);
     glEnable(GL_DEPTH_TEST);
 
-    Mesh ground = makeGroundPlane(60.0f);
+    Mesh boxMesh = makeBoxMesh(glm::vec3(0.62f, 0.58f, 0.52f));
+    buildLevel(gLevel);
     GLuint prog = linkProgram(kVS, kFS);
-    GLint uMVP = glGetUniformLocation(prog, "uMVP");
+    GLint uModel = glGetUniformLocation(prog, "uModel");
 
-    initCrosshair();
     initHudText();
-    initDialogBox();
 
     gObjProg = linkProgram(kObjVS, kObjFS);
-    gObjMVP = glGetUniformLocation(gObjProg, "uMVP");
+    gObjModel = glGetUniformLocation(gObjProg, "uModel");
     gObjTex = glGetUniformLocation(gObjProg, "uTex");
 
-    gNPCModel.load("assets/npc.obj");
-    gNPCTexture = loadTexture2D("assets/man_t256.png");
-
-    // Colliders: only NPC for now
-    std::vector<AABB> colliders;
-    colliders.push_back(AABB{ gNPC.pos - gNPC.half, gNPC.pos + gNPC.half });
+    gObjInstProg = linkProgram(kObjInstVS, kObjInstFS);
+    gObjInstTex = glGetUniformLocation(gObjInstProg, "uTex");
+
+    gFrameUniforms.init();
+
+    // every textured program samples unit 0; set once, the queue never changes it
+    glUseProgram(gObjProg);
+    glUniform1i(gObjTex, 0);
+    glUseProgram(gObjInstProg);
+    glUniform1i(gObjInstTex, 0);
+    spawnCrowd(gCrowd, kCrowdSize, 8.0f, 40.0f, 7u, &gLevel);
+
+    // Assets stream in on worker threads; the loop starts rendering now
+    unsigned int hw = std::thread::hardware_concurrency();
+    gWorkers.start(hw > 2 ? hw - 1 : 2);
+    gOcclusionPool.start(std::max(1u, std::min(3u, hw / 2)));
+    gOcclusionView.init();
+    reportShaderCache();
+    if (!gTerrain.init(gWorkers, kTerrainPath)) std::cerr << "Terrain unavailable\n";
+
+    gAssets.init(gWorkers);
+    gStreamer.init(kStreamSlotCount, kStreamSlotBytes, gStreamBudgetBytes, &gWorkers);
+    gNPCModel = gAssets.requestModel("assets/npc.obj");
+    gNPCTexture = gAssets.requestTexture("assets/man_t256.png");
+
+    // Colliders: the NPC and every level box, gridded once
+    std::vector<AABB> staticBoxes;
+    staticBoxes.push_back(AABB{ gNPC.pos - gNPC.half, gNPC.pos + gNPC.half });
+    for (const LevelBox& b : gLevel) staticBoxes.push_back(b.box);
+    ColliderGrid colliders;
+    colliders.build(staticBoxes);
+    Bvh4 worldBvh;                  // the same boxes for rays; index 0 is the NPC
+    worldBvh.build(staticBoxes);
+    std::vector<AABB> crowdBoxList;
+
+    // Navmesh from the same boxes once the terrain is in; the first crowd
+    // members patrol on it
+    bool navmeshReady = false;
+    gPaths.init(gNavMesh, gWorkers);
+    gFlowFields.init(gNavMesh);
+    gPatrols.resize(std::min<size_t>(kPatrolCount, gCrowd.size()));
+    for (size_t i = 0; i < gPatrols.size(); ++i) {
+        gPatrols[i].instance = (uint32_t)i;
+        gPatrols[i].seed = (uint32_t)i * 2654435761u + 17u;
+    }
 
     double last = glfwGetTime();
     double fpsTimer = last;
     int frames = 0;
     float fps = 0.0f;
+    FrameHistogram frameHist;
 
     while (!glfwWindowShouldClose(gWindow)) {
         double now = glfwGetTime();
         float dt = float(now - last); last = now;
+        frameHist.record(dt * 1000.0f);
 
         glfwPollEvents();
+        gAssets.pumpUploads(kUploadBudgetMs);
+        gStreamer.pump();
+        gPaths.pump();
+
+        // The NPC's own triangles replace its stand-in box once loaded
+        if (gMeshColliders.empty()) {
+            if (const CollisionMesh* npcMesh = gAssets.collisionMesh(gNPCModel)) {
+                gMeshColliders.push_back(PlacedCollisionMesh{ npcMesh, glm::vec3(gNPC.pos.x, 0.0f, gNPC.pos.z) });
+                colliders.build(std::vector<AABB>(staticBoxes.begin() + 1, staticBoxes.end()));
+            }
+        }
         processMovement(dt, colliders);
+        gTerrain.update(gCam.pos);
+        if (!navmeshReady && gTerrain.loaded()) {
+            initNavMesh(gNavMesh, staticBoxes, gTerrain.map);
+            navmeshReady = true;
+        }
+        if (gAlarm) {
+            gFlowFields.setGoal(gCam.pos);
+            gFlowFields.update();
+        }
+        updatePatrols(gPatrols, gCrowd, dt);
 
         glClearColor(0.10f, 0.12f, 0.15f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -784,7 +7965,9 @@ int main() {
         glm::mat4 V = gCam.getView();
         glfwGetFramebufferSize(gWindow, &fbw, &fbh);
         float aspect = fbh > 0 ? float(fbw) / float(fbh) : 16.f / 9.f;
-        glm::mat4 P = glm::perspective(glm::radians(gCam.fov), aspect, 0.1f, 200.0f);
+        const float kFarPlane = 700.0f;
+        glm::mat4 P = glm::perspective(glm::radians(gCam.fov), aspect, 0.1f, kFarPlane);
+        gFrameUniforms.update(V, P, gCam.pos);
 
         gNpcUIActive = false;
         gHudPrompt.clear();
@@ -797,9 +7980,15 @@ int main() {
         };
         camForward = glm::normalize(camForward);
 
-        AABB npcBox{ gNPC.pos - gNPC.half, gNPC.pos + gNPC.half };
-        float tHit = rayAABB(gCam.pos, camForward, npcBox);
-        bool lookingAt = tHit > 0.0f && tHit < 3.0f;
+        // Talk prompt: the NPC must be the nearest thing within reach, not
+        // behind a wall or another pedestrian
+        Ray look;
+        look.origin = gCam.pos;
+        look.dir = camForward;
+        look.maxT = 3.0f;
+        RayHit lookHit = worldBvh.raycast(look);
+        RayHit crowdHit = gCrowdBvh.raycast(look);
+        bool lookingAt = lookHit.index == 0 && lookHit.t > 0.0f && crowdHit.t > lookHit.t;
 
         if (!gNPC.talking) {
             if (lookingAt) {
@@ -834,45 +8023,138 @@ int main() {
             }
         }
 
-        // Render ground
-        glUseProgram(prog);
-        {
-            glm::mat4 MVP = P * V * glm::mat4(1.0f);
-            glUniformMatrix4fv(uMVP, 1, GL_FALSE, glm::value_ptr(MVP));
-            glBindVertexArray(ground.vao);
-            glDrawArrays(GL_TRIANGLES, 0, ground.count);
+        // Cull: frustum planes once per frame, then every object's sphere
+        const glm::mat4 VP = P * V;
+        Frustum frustum = Frustum::fromMatrix(VP);
+        AssimpModel* npcModel = gAssets.model(gNPCModel);
+        bool npcVisible = false;
+        gRenderStats = RenderStats{};
+        if (gOcclusionEnabled) {
+            double t0 = nowMs();
+            renderOccluders(gOcclusion, gLevel, VP, &gOcclusionPool);
+            gRenderStats.rasterMs = nowMs() - t0;
+        }
+        if (npcModel) {
+            groundInstances(gCrowd, gTerrain.map);
+            buildInstanceBounds(gCrowd, *npcModel, gCrowdBounds);
+            crowdBoxes(gCrowdBounds, crowdBoxList);
+            gCrowdBvh.refit(crowdBoxList);
+            glm::vec3 npcCenter = glm::vec3(gNPC.pos.x, 0.0f, gNPC.pos.z) + npcModel->boundsCenter();
+            float npcRadius = npcModel->boundsRadius();
+
+            double t0 = nowMs();
+            npcVisible = frustum.sphereVisible(npcCenter, npcRadius);
+            gVisibleIdx.clear();
+            cullSpheres(frustum, gCrowdBounds, gVisibleIdx);
+            gRenderStats.cullMs = nowMs() - t0;
+
+            if (gOcclusionEnabled) {
+                t0 = nowMs();
+                npcVisible = npcVisible && gOcclusion.boxVisible(npcCenter - npcRadius, npcCenter + npcRadius);
+                gRenderStats.occluded = (int)occludeSpheres(gOcclusion, gCrowdBounds, gVisibleIdx) + (npcVisible ? 0 : 1);
+                gRenderStats.occlusionTestMs = nowMs() - t0;
+            }
+            bucketInstancesByLod(gCrowd, gCrowdBounds, gVisibleIdx, gCam.pos, tanf(glm::radians(gCam.fov) * 0.5f),
+                npcModel->lodCount(), gCrowdLod, gCrowdDraw);
+
+            gRenderStats.visible = npcVisible ? 1 : 0;
+            gRenderStats.triangles = npcVisible ? npcModel->triangles(0) : 0;
+            for (int l = 0; l < kMaxMeshLods; ++l) {
+                gRenderStats.visible += (int)gCrowdDraw[l].size();
+                gRenderStats.triangles += (long long)gCrowdDraw[l].size() * npcModel->triangles(l);
+            }
+            gRenderStats.culled = (int)gCrowd.size() + 1 - gRenderStats.visible;
+            gRenderStats.trianglesFull = (long long)gRenderStats.visible * npcModel->triangles(0);
         }
 
-        // Render NPC model
-        {
+        // Collect this frame's draws, sort by state, submit
+        auto depthOf = [&](const glm::vec3& p) { return glm::length(p - gCam.pos) / kFarPlane; };
+        gRenderQueue.clear();
+        gTerrain.queue(gRenderQueue, frustum, prog, uModel);
+        for (LevelBox& b : gLevel) {
+            glm::vec3 center = (b.box.min + b.box.max) * 0.5f;
+            DrawItem d;
+            d.program = prog;
+            d.vao = boxMesh.vao;
+            d.matrixLoc = uModel;
+            d.matrix = glm::scale(glm::translate(glm::mat4(1.0f), center), b.box.max - b.box.min);
+            d.arrayCount = boxMesh.count;
+            d.key = makeDrawKey(kPassOpaque, d.program, 0, d.vao, depthOf(center));
+            gRenderQueue.push(d);
+        }
+
+        GLuint npcTex = gAssets.texture(gNPCTexture);
+        if (npcVisible) {
             glm::vec3 npcWorldPos(gNPC.pos.x, 0.0f, gNPC.pos.z);
-            glm::mat4 model = glm::translate(glm::mat4(1.0f), npcWorldPos) *
-                glm::scale(glm::mat4(1.0f), glm::vec3(1.0f));
-            glm::mat4 MVP = P * V * model;
+            glm::mat4 model = glm::translate(glm::mat4(1.0f), npcWorldPos);
+            queueModel(gRenderQueue, *npcModel, 0, gObjProg, npcTex, gObjModel, model, depthOf(npcWorldPos));
+        }
 
-            glUseProgram(gObjProg);
-            glUniformMatrix4fv(gObjMVP, 1, GL_FALSE, glm::value_ptr(MVP));
+        // Crowd: all LOD buckets share one upload; each LOD draws its slice
+        if (npcModel) {
+            gCrowdStream.clear();
+            GLsizei firsts[kMaxMeshLods];
+            for (int l = 0; l < kMaxMeshLods; ++l) {
+                firsts[l] = (GLsizei)gCrowdStream.size();
+                gCrowdStream.insert(gCrowdStream.end(), gCrowdDraw[l].begin(), gCrowdDraw[l].end());
+            }
+            npcModel->uploadInstances(gCrowdStream.data(), (GLsizei)gCrowdStream.size());
+            for (int l = 0; l < kMaxMeshLods; ++l) {
+                if (gCrowdDraw[l].empty()) continue;
+                queueModel(gRenderQueue, *npcModel, l, gObjInstProg, npcTex, -1, glm::mat4(1.0f),
+                    0.0f, firsts[l], (GLsizei)gCrowdDraw[l].size());
+            }
+        }
 
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, gNPCTexture);
-            glUniform1i(gObjTex, 0);
+        gRenderQueue.sort();
+        gRenderQueue.submit(gRenderStats);
 
-            gNPCModel.draw();
-        }
+        if (pressed(gWindow, GLFW_KEY_F4)) gShowOcclusionBuffer = !gShowOcclusionBuffer;
+        if (pressed(gWindow, GLFW_KEY_F5)) gOcclusionEnabled = !gOcclusionEnabled;
+        if (pressed(gWindow, GLFW_KEY_F6)) gAlarm = !gAlarm;
+        if (gShowOcclusionBuffer && gOcclusionEnabled) gOcclusionView.draw(gOcclusion, fbw, fbh, kFarPlane);
 
-        // Crosshair
-        drawCrosshairNDC(fbw, fbh);
+        // HUD: crosshair, prompt and dialog go out as one batched draw
+        uiBegin(fbw, fbh);
+        drawCrosshair();
 
-        // HUD text
         if (!gHudPrompt.empty()) {
             float promptY = fbh * 0.28f;
             float promptX = fbw * 0.5f - (gHudPrompt.size() * 4.0f);
-            drawTextScreen(gHudPrompt, promptX, promptY, fbw, fbh, glm::vec3(1.0f, 1.0f, 0.7f),2.5f);
+            drawTextScreen(gHudPrompt, promptX, promptY, glm::vec3(1.0f, 1.0f, 0.7f), 2.5f);
         }
 
         if (!gHudNpcLine.empty()) {
-            drawDialogBoxWithText(gHudNpcLine, fbw, fbh);
+            drawDialogBoxWithText(gHudNpcLine);
+        }
+
+        if (gAlarm) drawTextScreen("ALARM", fbw * 0.5f - 20.0f, 20.0f, glm::vec3(1.0f, 0.3f, 0.2f), 2.0f);
+
+        if (gAssets.pending() > 0) {
+            std::string loading = "Loading assets... (" + std::to_string(gAssets.pending()) + ")";
+            drawTextScreen(loading, 20.0f, 20.0f, glm::vec3(0.8f, 0.8f, 0.8f), 2.0f);
+        }
+
+        if (pressed(gWindow, GLFW_KEY_F3)) gShowStats = !gShowStats;
+        if (gShowStats) {
+            std::ostringstream stats;
+            stats.precision(3);
+            stats << "FPS " << int(fps)
+                << "\nvisible " << gRenderStats.visible
+                << "  culled " << gRenderStats.culled
+                << "\ncull " << gRenderStats.cullMs << " ms"
+                << "\ntris " << gRenderStats.triangles << " / " << gRenderStats.trianglesFull << " full"
+                << "\ndraws " << gRenderStats.drawCalls
+                << "  binds " << gRenderStats.stateChanges
+                << " (-" << gRenderStats.stateChangesAvoided << ")"
+                << "\noccluded " << gRenderStats.occluded << (gOcclusionEnabled ? "" : " (off)")
+                << "\nraster " << gRenderStats.rasterMs << "  test " << gRenderStats.occlusionTestMs << " ms"
+                << "\nterrain " << gTerrain.drawnChunks << "/" << gTerrain.chunks.size() << " chunks  "
+                << (gTerrain.residentBytes() >> 10) << " KB";
+            uiRect(fbw - 350.0f, 14.0f, fbw - 14.0f, 214.0f, glm::vec3(0.05f, 0.06f, 0.08f));
+            drawTextScreen(stats.str(), fbw - 340.0f, 22.0f, glm::vec3(0.7f, 1.0f, 0.7f), 2.0f);
         }
+        uiFlush();
 
         glfwSwapBuffers(gWindow);
 
@@ -892,22 +8174,25 @@ int main() {
         }
     }
 
-    glDeleteVertexArrays(1, &ground.vao); glDeleteBuffers(1, &ground.vbo);
+    glDeleteVertexArrays(1, &boxMesh.vao); glDeleteBuffers(1, &boxMesh.vbo);
+    gOcclusionView.release();
     glDeleteProgram(prog);
 
-    glDeleteVertexArrays(1, &gCrossVAO);
-    glDeleteBuffers(1, &gCrossVBO);
-    glDeleteProgram(gCrossProg);
+    shutdownHudText();
 
-    glDeleteVertexArrays(1, &gHudVAO);
-    glDeleteBuffers(1, &gHudVBO);
-    glDeleteProgram(gHudProg);
+    gWorkers.stop();
+    gOcclusionPool.stop();
+    gTerrain.shutdown();
+    gMeshColliders.clear();
+    gPatrols.clear();
+    gStreamer.shutdown();
+    gAssets.shutdown();
 
-    glDeleteVertexArrays(1, &gDialogVAO);
-    glDeleteBuffers(1, &gDialogVBO);
+    frameHist.report("Frame times");
 
     glDeleteProgram(gObjProg);
-    glDeleteTextures(1, &gNPCTexture);
+    glDeleteProgram(gObjInstProg);
+    gFrameUniforms.release();
 
     glfwDestroyWindow(gWindow);
     glfwTerminate();